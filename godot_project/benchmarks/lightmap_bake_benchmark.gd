@@ -0,0 +1,257 @@
+extends SceneTree
+## Headless LightmapBaker benchmark.
+##
+## Generates deterministic scenes at fixed scale tiers, bakes each one with LightmapBaker and
+## prints a JSON report (one entry per tier) so bake performance can be compared commit over commit.
+##
+## Usage, from the repository root:
+##   godot --headless --path godot_project --script res://benchmarks/lightmap_bake_benchmark.gd -- [options]
+##
+## Options:
+##   --tiers=small,medium   Tiers to run (default: small,medium,large). See TIERS.
+##   --repeat=N             Bakes per tier; the fastest one is reported (default: 3).
+##   --quality=NAME         low, medium, high or ultra (default: medium).
+##   --threads=N            LightmapBaker thread count (default: 0, all cores).
+##   --output=PATH          Also write the report to PATH.
+##   --baseline=PATH        Compare with an earlier report. Exits with code 1 if the total time or
+##                          any stage of a tier got slower by more than --max-regression.
+##   --max-regression=F     Allowed relative slowdown against the baseline (default: 0.15).
+##
+## Stage times, ray counts and peak intermediate memory come from LightmapBaker.get_last_bake_stats().
+
+const SEED := 1234
+
+## mesh_count: occluder meshes on the ground plane; triangles: per mesh (approximate);
+## lights: omni lights (a directional light is always added); atlas_size: atlas_size_override.
+const TIERS := {
+	"small": { "mesh_count": 16, "triangles": 512, "lights": 2, "atlas_size": 512 },
+	"medium": { "mesh_count": 128, "triangles": 2048, "lights": 8, "atlas_size": 1024 },
+	"large": { "mesh_count": 512, "triangles": 8192, "lights": 32, "atlas_size": 2048 },
+	"huge": { "mesh_count": 2048, "triangles": 8192, "lights": 64, "atlas_size": 4096 },
+}
+const DEFAULT_TIERS := ["small", "medium", "large"]
+
+var _options := {
+	"tiers": DEFAULT_TIERS,
+	"repeat": 3,
+	"quality": "medium",
+	"threads": 0,
+	"output": "",
+	"baseline": "",
+	"max_regression": 0.15,
+}
+
+
+func _initialize() -> void:
+	_run.call_deferred()
+
+
+func _run() -> void:
+	if not _parse_options(OS.get_cmdline_user_args()):
+		quit(2)
+		return
+	var report := {
+		"engine": Engine.get_version_info().string,
+		"processor_count": OS.get_processor_count(),
+		"quality": _options.quality,
+		"threads": _options.threads,
+		"tiers": {},
+	}
+	for tier_name in _options.tiers:
+		var best := {}
+		for i in _options.repeat:
+			var result := _bake_tier(tier_name, TIERS[tier_name])
+			if result.is_empty():
+				quit(1)
+				return
+			if best.is_empty() or result.total_sec < best.total_sec:
+				best = result
+		report.tiers[tier_name] = best
+
+	var json := JSON.stringify(report, "\t", false)
+	print(json)
+	if not _options.output.is_empty():
+		var file := FileAccess.open(_options.output, FileAccess.WRITE)
+		if file == null:
+			printerr("Can't write ", _options.output)
+		else:
+			file.store_string(json + "\n")
+
+	var exit_code := 0
+	if not _options.baseline.is_empty() and not _compare_with_baseline(report, _options.baseline):
+		exit_code = 1
+	quit(exit_code)
+
+
+func _parse_options(args: PackedStringArray) -> bool:
+	for arg in args:
+		var parts := arg.trim_prefix("--").split("=", true, 1)
+		var key := parts[0].replace("-", "_")
+		var value := parts[1] if parts.size() > 1 else ""
+		match key:
+			"tiers":
+				var tiers := []
+				for tier_name in value.split(",", false):
+					if not TIERS.has(tier_name):
+						printerr("Unknown tier '", tier_name, "', expected one of ", TIERS.keys())
+						return false
+					tiers.append(tier_name)
+				_options.tiers = tiers
+			"repeat", "threads":
+				_options[key] = maxi(int(value), 1 if key == "repeat" else 0)
+			"max_regression":
+				_options[key] = float(value)
+			"quality":
+				if not value in ["low", "medium", "high", "ultra"]:
+					printerr("Unknown quality '", value, "'")
+					return false
+				_options[key] = value
+			"output", "baseline":
+				_options[key] = value
+			_:
+				printerr("Unknown option ", arg)
+				return false
+	return true
+
+
+func _bake_tier(tier_name: String, tier: Dictionary) -> Dictionary:
+	var scene := _build_scene(tier)
+	root.add_child(scene)
+
+	var baker := LightmapBaker.new()
+	baker.set_bake_quality(["low", "medium", "high", "ultra"].find(_options.quality))
+	baker.set_thread_count(_options.threads)
+	baker.set_atlas_size_override(tier.atlas_size)
+	var data := LightmapGIData.new()
+
+	_reset_peak_memory()
+	var start := Time.get_ticks_usec()
+	var result := baker.bake(scene, data)
+	var end := Time.get_ticks_usec()
+	# Tiers run back to back within one frame, so free the scene right away.
+	scene.free()
+	if result != LightmapBaker.BAKE_ERROR_OK:
+		printerr("Tier ", tier_name, ": bake failed with error ", result)
+		return {}
+
+	var total_sec := (end - start) / 1000000.0
+	var stats: Dictionary = baker.get_last_bake_stats()
+	var stage_sec: Dictionary = stats.stage_sec
+	var texels: float = stats.atlas_occupancy * tier.atlas_size * tier.atlas_size * stats.slice_count
+	var ray_sec: float = stage_sec.direct + stage_sec.indirect
+	return {
+		"scene": tier,
+		"gathered_meshes": baker.get_gathered_mesh_count(),
+		"gathered_lights": baker.get_gathered_light_count(),
+		"total_sec": total_sec,
+		"stage_sec": stage_sec,
+		"slice_count": stats.slice_count,
+		"atlas_occupancy": stats.atlas_occupancy,
+		"texels": int(texels),
+		"texels_per_sec": texels / total_sec if total_sec > 0.0 else 0.0,
+		"rays_cast": stats.rays_cast,
+		"rays_per_sec": stats.rays_cast / ray_sec if ray_sec > 0.0 else 0.0,
+		"triangles_tested": stats.triangles_tested,
+		"peak_intermediate_memory_mb": stats.peak_memory_bytes / 1048576.0,
+		"peak_memory_mb": _get_peak_memory() / 1048576.0,
+	}
+
+
+## Ground plane with randomly placed spheres above it, lit by omni lights above and a directional light.
+## Generated from SEED, so every run (and commit) bakes the same scene.
+func _build_scene(tier: Dictionary) -> Node3D:
+	var rng := RandomNumberGenerator.new()
+	rng.seed = SEED
+	var scene := Node3D.new()
+	var extent := sqrt(float(tier.mesh_count)) * 3.0
+
+	var ground := PlaneMesh.new()
+	ground.size = Vector2(extent * 2.0 + 4.0, extent * 2.0 + 4.0)
+	ground.add_uv2 = true
+	var ground_instance := MeshInstance3D.new()
+	ground_instance.mesh = ground
+	scene.add_child(ground_instance)
+
+	# Sphere with rings r and 2r radial segments: about 4r^2 triangles.
+	var rings := maxi(2, int(sqrt(tier.triangles / 4.0)))
+	var meshes: Array[PrimitiveMesh] = []
+	for i in 4:
+		var sphere := SphereMesh.new()
+		sphere.rings = rings
+		sphere.radial_segments = rings * 2
+		sphere.radius = 0.5 + 0.25 * i
+		sphere.height = sphere.radius * 2.0
+		sphere.add_uv2 = true
+		meshes.append(sphere)
+
+	for i in tier.mesh_count:
+		var instance := MeshInstance3D.new()
+		instance.mesh = meshes[rng.randi() % meshes.size()]
+		instance.position = Vector3(rng.randf_range(-extent, extent), rng.randf_range(0.5, 3.0), rng.randf_range(-extent, extent))
+		instance.rotation = Vector3(0.0, rng.randf() * TAU, 0.0)
+		scene.add_child(instance)
+
+	var sun := DirectionalLight3D.new()
+	sun.rotation = Vector3(deg_to_rad(-50.0), deg_to_rad(30.0), 0.0)
+	sun.shadow_enabled = true
+	sun.light_bake_mode = Light3D.BAKE_STATIC
+	scene.add_child(sun)
+
+	for i in tier.lights:
+		var light := OmniLight3D.new()
+		light.position = Vector3(rng.randf_range(-extent, extent), rng.randf_range(3.0, 6.0), rng.randf_range(-extent, extent))
+		light.omni_range = 8.0
+		light.light_color = Color.from_hsv(rng.randf(), 0.4, 1.0)
+		light.shadow_enabled = true
+		light.light_bake_mode = Light3D.BAKE_STATIC
+		scene.add_child(light)
+	return scene
+
+
+## Peak resident memory of the process. On Linux the high-water mark is reset before every bake, so
+## it covers that bake only; elsewhere it falls back to Godot's own allocator peak.
+func _reset_peak_memory() -> void:
+	if OS.get_name() == "Linux":
+		var file := FileAccess.open("/proc/self/clear_refs", FileAccess.WRITE)
+		if file != null:
+			file.store_string("5")
+
+
+func _get_peak_memory() -> int:
+	if OS.get_name() == "Linux":
+		var file := FileAccess.open("/proc/self/status", FileAccess.READ)
+		if file != null:
+			while not file.eof_reached():
+				var line := file.get_line()
+				if line.begins_with("VmHWM:"):
+					return int(line.trim_prefix("VmHWM:").strip_edges().split(" ")[0]) * 1024
+	return OS.get_static_memory_peak_usage()
+
+
+func _compare_with_baseline(report: Dictionary, path: String) -> bool:
+	var text := FileAccess.get_file_as_string(path)
+	var baseline = JSON.parse_string(text)
+	if not baseline is Dictionary or not baseline.has("tiers"):
+		printerr("Can't read baseline report ", path)
+		return false
+
+	var ok := true
+	for tier_name in report.tiers:
+		if not baseline.tiers.has(tier_name):
+			continue
+		var current: Dictionary = report.tiers[tier_name]
+		var previous: Dictionary = baseline.tiers[tier_name]
+		var timings := { "total": [current.total_sec, previous.total_sec] }
+		for stage in current.stage_sec:
+			timings[stage] = [current.stage_sec[stage], previous.stage_sec.get(stage, 0.0)]
+		for name in timings:
+			var now: float = timings[name][0]
+			var before: float = timings[name][1]
+			# Ignore stages too short to time reliably.
+			if before < 0.05:
+				continue
+			var change := now / before - 1.0
+			if change > _options.max_regression:
+				printerr("%s/%s: %.3fs -> %.3fs (+%.0f%%)" % [tier_name, name, before, now, change * 100.0])
+				ok = false
+	return ok
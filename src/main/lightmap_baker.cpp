@@ -7,11 +7,13 @@
 
 #include <godot_cpp/variant/utility_functions.hpp>
 
+#include <godot_cpp/classes/dir_access.hpp>
 #include <godot_cpp/classes/directional_light3d.hpp>
 #include <godot_cpp/classes/engine.hpp>
 #include <godot_cpp/classes/array_mesh.hpp>
 #include <godot_cpp/classes/global_constants.hpp>
 #include <godot_cpp/classes/environment.hpp>
+#include <godot_cpp/classes/file_access.hpp>
 #include <godot_cpp/classes/node3d.hpp>
 #include <godot_cpp/classes/viewport.hpp>
 #include <godot_cpp/classes/world3d.hpp>
@@ -19,20 +21,48 @@
 #include <godot_cpp/classes/image_texture_layered.hpp>
 #include <godot_cpp/classes/mesh.hpp>
 #include <godot_cpp/classes/omni_light3d.hpp>
+#include <godot_cpp/classes/os.hpp>
 #include <godot_cpp/classes/project_settings.hpp>
+#include <godot_cpp/classes/rendering_server.hpp>
 #include <godot_cpp/classes/spot_light3d.hpp>
 #include <godot_cpp/classes/texture2d_array.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
 
+#include <atomic>
+#include <chrono>
+#include <list>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 
+// SSE2 is part of the x86-64 baseline (MSVC does not define __SSE2__, hence the _M_* checks).
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LM_RAY_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace godot {
 
 namespace {
 
+// Adds the time until the end of the scope to one of the bake's stage timers.
+struct _LM_StageTimer {
+	uint64_t &total_usec;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	explicit _LM_StageTimer(uint64_t &r_total_usec) :
+			total_usec(r_total_usec) {}
+	~_LM_StageTimer() {
+		total_usec += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
 static inline uint64_t _lm_mix64(uint64_t x) {
 	x ^= x >> 33;
 	x *= 0xff51afd7ed558ccdULL;
@@ -42,6 +72,32 @@ static inline uint64_t _lm_mix64(uint64_t x) {
 	return x;
 }
 
+static inline uint64_t _lm_hash_combine(uint64_t p_hash, uint64_t p_value) {
+	return _lm_mix64(p_hash ^ (p_value + 0x9e3779b97f4a7c15ULL + (p_hash << 6) + (p_hash >> 2)));
+}
+
+static inline uint64_t _lm_hash_float(uint64_t p_hash, float p_value) {
+	uint32_t bits = 0;
+	memcpy(&bits, &p_value, sizeof(bits));
+	return _lm_hash_combine(p_hash, bits);
+}
+
+static uint64_t _lm_hash_bytes(uint64_t p_hash, const void *p_data, size_t p_size) {
+	const uint8_t *bytes = (const uint8_t *)p_data;
+	size_t i = 0;
+	for (; i + 8 <= p_size; i += 8) {
+		uint64_t word = 0;
+		memcpy(&word, bytes + i, 8);
+		p_hash = _lm_hash_combine(p_hash, word);
+	}
+	uint64_t tail = 0;
+	if (i < p_size) {
+		memcpy(&tail, bytes + i, p_size - i);
+	}
+	return _lm_hash_combine(p_hash, tail ^ ((uint64_t)p_size << 40));
+}
+
+// 128-bit content hash of the unwrap inputs (positions, normals, indices and texel size).
 struct _LM_UnwrapCacheKey {
 	uint64_t a = 0;
 	uint64_t b = 0;
@@ -60,10 +116,110 @@ struct _LM_UnwrapCacheEntry {
 	PackedVector2Array uv2;
 	PackedInt32Array indices;
 	Vector2i size_hint;
+
+	size_t get_memory_usage() const {
+		return sizeof(_LM_UnwrapCacheEntry) + (size_t)xrefs.size() * sizeof(int32_t) + (size_t)uv2.size() * sizeof(Vector2) + (size_t)indices.size() * sizeof(int32_t);
+	}
+};
+
+// Least recently used entries are evicted once the payload exceeds max_memory.
+struct _LM_UnwrapCache {
+	struct Node {
+		_LM_UnwrapCacheEntry entry;
+		std::list<_LM_UnwrapCacheKey>::iterator lru;
+		size_t memory = 0;
+	};
+
+	std::mutex mutex;
+	std::unordered_map<_LM_UnwrapCacheKey, Node, _LM_UnwrapCacheKeyHash> entries;
+	std::list<_LM_UnwrapCacheKey> lru; // Most recently used first.
+	size_t memory = 0;
+	size_t max_memory = (size_t)256 * 1024 * 1024;
+
+	// Callers hold the mutex.
+	bool find(const _LM_UnwrapCacheKey &p_key, _LM_UnwrapCacheEntry &r_entry) {
+		auto it = entries.find(p_key);
+		if (it == entries.end()) {
+			return false;
+		}
+		lru.splice(lru.begin(), lru, it->second.lru);
+		r_entry = it->second.entry;
+		return true;
+	}
+
+	void insert(const _LM_UnwrapCacheKey &p_key, const _LM_UnwrapCacheEntry &p_entry) {
+		auto it = entries.find(p_key);
+		if (it != entries.end()) {
+			memory -= it->second.memory;
+			lru.erase(it->second.lru);
+			entries.erase(it);
+		}
+		Node node;
+		node.entry = p_entry;
+		node.memory = p_entry.get_memory_usage();
+		lru.push_front(p_key);
+		node.lru = lru.begin();
+		memory += node.memory;
+		entries.emplace(p_key, node);
+		evict();
+	}
+
+	void evict() {
+		// The newest entry is kept even if it alone exceeds the budget.
+		while (memory > max_memory && lru.size() > 1) {
+			auto it = entries.find(lru.back());
+			memory -= it->second.memory;
+			entries.erase(it);
+			lru.pop_back();
+		}
+	}
+
+	void clear() {
+		entries.clear();
+		lru.clear();
+		memory = 0;
+	}
 };
 
-static std::mutex _lm_unwrap_cache_mutex;
-static std::unordered_map<_LM_UnwrapCacheKey, _LM_UnwrapCacheEntry, _LM_UnwrapCacheKeyHash> _lm_unwrap_cache;
+static _LM_UnwrapCache _lm_unwrap_cache;
+
+// On-disk unwrap cache: "LMUC", version, entry count, then per entry (most recent first) the key,
+// size hint and the three arrays as count-prefixed little-endian data.
+static constexpr uint32_t LM_UNWRAP_CACHE_MAGIC = 0x43554d4c; // "LMUC"
+static constexpr uint32_t LM_UNWRAP_CACHE_VERSION = 1;
+
+static void _lm_append_bytes(PackedByteArray &r_data, const void *p_src, size_t p_size) {
+	const int64_t offset = r_data.size();
+	r_data.resize(offset + (int64_t)p_size);
+	if (p_size > 0) {
+		memcpy(r_data.ptrw() + offset, p_src, p_size);
+	}
+}
+
+template <typename T>
+static void _lm_append_value(PackedByteArray &r_data, const T &p_value) {
+	_lm_append_bytes(r_data, &p_value, sizeof(T));
+}
+
+struct _LM_ByteReader {
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	size_t pos = 0;
+
+	bool read(void *r_dst, size_t p_size) {
+		if (p_size > size - pos) {
+			return false;
+		}
+		memcpy(r_dst, data + pos, p_size);
+		pos += p_size;
+		return true;
+	}
+
+	template <typename T>
+	bool read_value(T &r_value) {
+		return read(&r_value, sizeof(T));
+	}
+};
 
 static PackedInt32Array _lm_build_triangle_indices(const PackedVector3Array &p_vertices, const PackedInt32Array &p_indices) {
 	if (!p_indices.is_empty()) {
@@ -192,22 +348,36 @@ static bool _lm_xatlas_unwrap(float p_texel_size,
 	}
 	ERR_FAIL_COND_V_MSG(p_texel_size <= 0.0f, false, "Texel size must be greater than 0.");
 
-	uint64_t tex_bits = 0;
-	static_assert(sizeof(float) == sizeof(uint32_t), "unexpected float size");
-	memcpy(&tex_bits, &p_texel_size, sizeof(uint32_t));
-	const uint64_t a = (uint64_t)(uintptr_t)p_positions_for_unwrap.ptr() ^ ((uint64_t)vertex_count << 32) ^ tex_bits;
-	const uint64_t b = (uint64_t)(uintptr_t)p_tri_indices.ptr() ^ ((uint64_t)p_tri_indices.size() << 32) ^ (uint64_t)(uintptr_t)p_normals_for_unwrap.ptr();
+	// Keyed on content, so identical meshes loaded separately share an entry and a reused buffer
+	// address can't return a stale unwrap. Two independently seeded hashes form a 128-bit key.
 	_LM_UnwrapCacheKey key;
-	key.a = _lm_mix64(a);
-	key.b = _lm_mix64(b);
 	{
-		std::lock_guard<std::mutex> lock(_lm_unwrap_cache_mutex);
-		auto it = _lm_unwrap_cache.find(key);
-		if (it != _lm_unwrap_cache.end()) {
-			r_out_xrefs = it->second.xrefs;
-			r_out_uv2 = it->second.uv2;
-			r_out_indices = it->second.indices;
-			r_out_size_hint = it->second.size_hint;
+		const size_t pos_bytes = (size_t)vertex_count * sizeof(Vector3);
+		const size_t nrm_bytes = (size_t)p_normals_for_unwrap.size() * sizeof(Vector3);
+		const size_t idx_bytes = (size_t)p_tri_indices.size() * sizeof(int32_t);
+		uint64_t a = _lm_hash_float(0x243f6a8885a308d3ULL, p_texel_size);
+		a = _lm_hash_bytes(a, p_positions_for_unwrap.ptr(), pos_bytes);
+		a = _lm_hash_bytes(a, p_normals_for_unwrap.ptr(), nrm_bytes);
+		a = _lm_hash_bytes(a, p_tri_indices.ptr(), idx_bytes);
+		uint64_t b = _lm_hash_float(0x13198a2e03707344ULL, p_texel_size);
+		b = _lm_hash_bytes(b, p_tri_indices.ptr(), idx_bytes);
+		b = _lm_hash_bytes(b, p_normals_for_unwrap.ptr(), nrm_bytes);
+		b = _lm_hash_bytes(b, p_positions_for_unwrap.ptr(), pos_bytes);
+		key.a = a;
+		key.b = b;
+	}
+	{
+		_LM_UnwrapCacheEntry cached;
+		bool found = false;
+		{
+			std::lock_guard<std::mutex> lock(_lm_unwrap_cache.mutex);
+			found = _lm_unwrap_cache.find(key, cached);
+		}
+		if (found) {
+			r_out_xrefs = cached.xrefs;
+			r_out_uv2 = cached.uv2;
+			r_out_indices = cached.indices;
+			r_out_size_hint = cached.size_hint;
 			return true;
 		}
 	}
@@ -315,13 +485,349 @@ static bool _lm_xatlas_unwrap(float p_texel_size,
 		entry.uv2 = r_out_uv2;
 		entry.indices = r_out_indices;
 		entry.size_hint = r_out_size_hint;
-		std::lock_guard<std::mutex> lock(_lm_unwrap_cache_mutex);
-		_lm_unwrap_cache.emplace(key, entry);
+		std::lock_guard<std::mutex> lock(_lm_unwrap_cache.mutex);
+		_lm_unwrap_cache.insert(key, entry);
 	}
 
 	return true;
 }
 
+// IEEE 754 binary16 conversion (round to nearest even), used when writing Image::FORMAT_RGBH data.
+static inline uint16_t _lm_float_to_half(float p_value) {
+	uint32_t bits = 0;
+	memcpy(&bits, &p_value, sizeof(bits));
+	const uint32_t sign = (bits >> 16) & 0x8000u;
+	const uint32_t abs_bits = bits & 0x7fffffffu;
+
+	if (abs_bits >= 0x7f800000u) {
+		// Inf stays Inf, NaN stays a quiet NaN.
+		return (uint16_t)(sign | 0x7c00u | (abs_bits > 0x7f800000u ? 0x200u : 0u));
+	}
+	if (abs_bits >= 0x477ff000u) {
+		// Rounds past the largest finite half (65504): clamp to Inf like a hardware conversion.
+		return (uint16_t)(sign | 0x7c00u);
+	}
+	if (abs_bits < 0x38800000u) {
+		// Subnormal half (or zero).
+		if (abs_bits < 0x33000000u) {
+			return (uint16_t)sign;
+		}
+		const uint32_t exponent = abs_bits >> 23;
+		const uint32_t mantissa = (abs_bits & 0x7fffffu) | 0x800000u;
+		const uint32_t shift = 126u - exponent;
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1u);
+		const uint32_t halfway = 1u << (shift - 1u);
+		if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+			half++;
+		}
+		return (uint16_t)(sign | half);
+	}
+
+	uint32_t half = ((abs_bits - 0x38000000u) >> 13);
+	const uint32_t remainder = abs_bits & 0x1fffu;
+	if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+		half++;
+	}
+	return (uint16_t)(sign | half);
+}
+
+// Shared-exponent packing for Image::FORMAT_RGBE9995 (same rounding as Color::to_rgbe9995).
+static inline uint32_t _lm_float_to_rgbe9995(float p_r, float p_g, float p_b) {
+	constexpr float max_value = 65408.0f; // (2^9 - 1) / 2^9 * 2^16
+	constexpr int exp_bias = 15;
+	constexpr int mantissa_bits = 9;
+	const float r = std::clamp(p_r, 0.0f, max_value); // Also maps NaN to 0.
+	const float g = std::clamp(p_g, 0.0f, max_value);
+	const float b = std::clamp(p_b, 0.0f, max_value);
+	const float max_channel = std::max(r, std::max(g, b));
+	if (!(max_channel > 0.0f)) {
+		return 0;
+	}
+
+	int exponent = std::max(-exp_bias - 1, (int)std::floor(std::log2(max_channel))) + 1 + exp_bias;
+	if ((int)std::floor(max_channel / std::ldexp(1.0f, exponent - exp_bias - mantissa_bits) + 0.5f) == (1 << mantissa_bits)) {
+		exponent++;
+	}
+	const float scale = 1.0f / std::ldexp(1.0f, exponent - exp_bias - mantissa_bits);
+	const uint32_t mr = (uint32_t)std::floor(r * scale + 0.5f);
+	const uint32_t mg = (uint32_t)std::floor(g * scale + 0.5f);
+	const uint32_t mb = (uint32_t)std::floor(b * scale + 0.5f);
+	return (mr & 0x1ffu) | ((mg & 0x1ffu) << 9) | ((mb & 0x1ffu) << 18) | (((uint32_t)exponent & 0x1fu) << 27);
+}
+
+// BC6H unsigned (Image::FORMAT_BPTC_RGBFU) encoder for one 4x4 block of half-float RGB texels,
+// always using mode 11: one region, two 10-bit RGB endpoints and 4-bit indices. Lightmaps are
+// smooth, so a single principal-axis line per block is close to what the multi-region modes
+// give, at a fraction of the search cost. Like the hardware, it works on the half bit patterns,
+// which for non-negative halves are monotonic and roughly logarithmic.
+static const int _lm_bc6h_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static inline int _lm_bc6h_quantize(float p_half_bits) {
+	// Inverse of the decoder's unquantize ((q << 6) + 32) followed by (x * 31) >> 6.
+	return std::clamp((int)std::lround((p_half_bits - 15.0f) / 31.0f), 0, 1023);
+}
+
+static inline int _lm_bc6h_unquantize(int p_q) {
+	if (p_q == 0) {
+		return 0;
+	}
+	if (p_q == 1023) {
+		return 0xffff;
+	}
+	return (p_q << 6) + 32;
+}
+
+// Picks the best index per texel for the quantized endpoints; returns the summed squared error.
+static int64_t _lm_bc6h_assign_indices(const int p_texels[16][3], const int p_q0[3], const int p_q1[3], int r_indices[16]) {
+	int palette[16][3];
+	for (int c = 0; c < 3; c++) {
+		const int a = _lm_bc6h_unquantize(p_q0[c]);
+		const int b = _lm_bc6h_unquantize(p_q1[c]);
+		for (int i = 0; i < 16; i++) {
+			const int w = _lm_bc6h_weights[i];
+			palette[i][c] = ((((64 - w) * a + w * b + 32) >> 6) * 31) >> 6;
+		}
+	}
+	int64_t total = 0;
+	for (int t = 0; t < 16; t++) {
+		int64_t best = std::numeric_limits<int64_t>::max();
+		for (int i = 0; i < 16; i++) {
+			int64_t err = 0;
+			for (int c = 0; c < 3; c++) {
+				const int64_t d = palette[i][c] - p_texels[t][c];
+				err += d * d;
+			}
+			if (err < best) {
+				best = err;
+				r_indices[t] = i;
+			}
+		}
+		total += best;
+	}
+	return total;
+}
+
+static void _lm_encode_bc6h_block(const uint16_t *const p_rows[4], uint8_t r_block[16]) {
+	int texels[16][3];
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int y = 0; y < 4; y++) {
+		for (int x = 0; x < 4; x++) {
+			for (int c = 0; c < 3; c++) {
+				const uint16_t h = p_rows[y][x * 3 + c];
+				// Unsigned BC6H can't store negatives or Inf/NaN.
+				const int v = (h & 0x8000u) ? 0 : std::min((int)h, 0x7bff);
+				texels[y * 4 + x][c] = v;
+				mean[c] += (float)v;
+			}
+		}
+	}
+	for (int c = 0; c < 3; c++) {
+		mean[c] *= 1.0f / 16.0f;
+	}
+
+	// Principal axis by power iteration on the covariance matrix.
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int t = 0; t < 16; t++) {
+		const float d0 = texels[t][0] - mean[0];
+		const float d1 = texels[t][1] - mean[1];
+		const float d2 = texels[t][2] - mean[2];
+		cov[0] += d0 * d0;
+		cov[1] += d0 * d1;
+		cov[2] += d0 * d2;
+		cov[3] += d1 * d1;
+		cov[4] += d1 * d2;
+		cov[5] += d2 * d2;
+	}
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iter = 0; iter < 8; iter++) {
+		const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		const float len = std::max(std::abs(x), std::max(std::abs(y), std::abs(z)));
+		if (!(len > 0.0f)) {
+			break;
+		}
+		axis[0] = x / len;
+		axis[1] = y / len;
+		axis[2] = z / len;
+	}
+	const float axis_len_sq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float t_min = 0.0f;
+	float t_max = 0.0f;
+	for (int t = 0; t < 16; t++) {
+		const float proj = ((texels[t][0] - mean[0]) * axis[0] + (texels[t][1] - mean[1]) * axis[1] + (texels[t][2] - mean[2]) * axis[2]) / axis_len_sq;
+		t_min = std::min(t_min, proj);
+		t_max = std::max(t_max, proj);
+	}
+
+	int q0[3];
+	int q1[3];
+	for (int c = 0; c < 3; c++) {
+		q0[c] = _lm_bc6h_quantize(mean[c] + axis[c] * t_min);
+		q1[c] = _lm_bc6h_quantize(mean[c] + axis[c] * t_max);
+	}
+	int indices[16];
+	int64_t error = _lm_bc6h_assign_indices(texels, q0, q1, indices);
+
+	// Second candidate: the bounding box diagonal, with each channel's direction following its
+	// correlation with the principal axis.
+	{
+		int b0[3];
+		int b1[3];
+		for (int c = 0; c < 3; c++) {
+			int lo = texels[0][c];
+			int hi = lo;
+			for (int t = 1; t < 16; t++) {
+				lo = std::min(lo, texels[t][c]);
+				hi = std::max(hi, texels[t][c]);
+			}
+			const bool flip = axis[c] < 0.0f;
+			b0[c] = _lm_bc6h_quantize((float)(flip ? hi : lo));
+			b1[c] = _lm_bc6h_quantize((float)(flip ? lo : hi));
+		}
+		int box_indices[16];
+		const int64_t box_error = _lm_bc6h_assign_indices(texels, b0, b1, box_indices);
+		if (box_error < error) {
+			error = box_error;
+			memcpy(q0, b0, sizeof(q0));
+			memcpy(q1, b1, sizeof(q1));
+			memcpy(indices, box_indices, sizeof(indices));
+		}
+	}
+
+	// Least-squares refits of the endpoints to the chosen indices.
+	for (int refit = 0; refit < 2 && error > 0; refit++) {
+		float aa = 0.0f;
+		float ab = 0.0f;
+		float bb = 0.0f;
+		float ax[3] = { 0, 0, 0 };
+		float bx[3] = { 0, 0, 0 };
+		for (int t = 0; t < 16; t++) {
+			const float w = _lm_bc6h_weights[indices[t]] / 64.0f;
+			aa += (1.0f - w) * (1.0f - w);
+			ab += (1.0f - w) * w;
+			bb += w * w;
+			for (int c = 0; c < 3; c++) {
+				ax[c] += (1.0f - w) * texels[t][c];
+				bx[c] += w * texels[t][c];
+			}
+		}
+		const float det = aa * bb - ab * ab;
+		if (std::abs(det) <= 1e-6f) {
+			break;
+		}
+		int r0[3];
+		int r1[3];
+		for (int c = 0; c < 3; c++) {
+			r0[c] = _lm_bc6h_quantize((ax[c] * bb - bx[c] * ab) / det);
+			r1[c] = _lm_bc6h_quantize((bx[c] * aa - ax[c] * ab) / det);
+		}
+		int refit_indices[16];
+		const int64_t refit_error = _lm_bc6h_assign_indices(texels, r0, r1, refit_indices);
+		if (refit_error >= error) {
+			break;
+		}
+		error = refit_error;
+		memcpy(q0, r0, sizeof(q0));
+		memcpy(q1, r1, sizeof(q1));
+		memcpy(indices, refit_indices, sizeof(indices));
+	}
+
+	// The first texel's index is stored with its top bit implied 0; swap the endpoints if needed.
+	if (indices[0] >= 8) {
+		for (int c = 0; c < 3; c++) {
+			std::swap(q0[c], q1[c]);
+		}
+		for (int t = 0; t < 16; t++) {
+			indices[t] = 15 - indices[t];
+		}
+	}
+
+	memset(r_block, 0, 16);
+	int bit = 0;
+	auto put_bits = [&](uint32_t p_value, int p_count) {
+		for (int i = 0; i < p_count; i++, bit++) {
+			r_block[bit >> 3] |= (uint8_t)(((p_value >> i) & 1u) << (bit & 7));
+		}
+	};
+	put_bits(0x03, 5); // Mode 11.
+	for (int c = 0; c < 3; c++) {
+		put_bits((uint32_t)q0[c], 10);
+	}
+	for (int c = 0; c < 3; c++) {
+		put_bits((uint32_t)q1[c], 10);
+	}
+	put_bits((uint32_t)indices[0], 3);
+	for (int t = 1; t < 16; t++) {
+		put_bits((uint32_t)indices[t], 4);
+	}
+}
+
+// Shared state of one _lm_parallel_for() call; run() is the WorkerThreadPool group task body.
+template <typename F>
+struct _LM_ParallelForTask {
+	F *func = nullptr;
+	int count = 0;
+	std::atomic<int> next_item{ 0 };
+	std::atomic<int> completed{ 0 };
+
+	static void run(void *p_userdata, uint32_t p_element) {
+		_LM_ParallelForTask *task = static_cast<_LM_ParallelForTask *>(p_userdata);
+		for (int i = task->next_item.fetch_add(1); i < task->count; i = task->next_item.fetch_add(1)) {
+			(*task->func)(i);
+			task->completed.fetch_add(1);
+		}
+	}
+};
+
+// Runs p_func(i) for every i in [0, p_count) on up to p_thread_count threads, the calling
+// thread included; the others are WorkerThreadPool threads, so no thread is created per call.
+// Items are handed out dynamically, so callers must make each item write a disjoint part of
+// the output for results to be independent of the thread count.
+// p_on_progress(completed, total) is only ever invoked on the calling thread, with a
+// non-decreasing completed count. Calls must not be nested inside another call's p_func: the
+// wait would hold a pool thread.
+template <typename F, typename P>
+static void _lm_parallel_for(int p_count, int p_thread_count, F &&p_func, P &&p_on_progress) {
+	if (p_count <= 0) {
+		return;
+	}
+	const int thread_count = std::max(1, std::min(p_thread_count, p_count));
+
+	_LM_ParallelForTask<std::remove_reference_t<F>> task;
+	task.func = &p_func;
+	task.count = p_count;
+
+	WorkerThreadPool *pool = WorkerThreadPool::get_singleton();
+	int64_t group_id = -1;
+	if (thread_count > 1 && pool != nullptr) {
+		group_id = pool->add_native_group_task(&_LM_ParallelForTask<std::remove_reference_t<F>>::run, &task, thread_count - 1, thread_count - 1, true, "LightmapBaker");
+	}
+
+	int last_reported = 0;
+	for (int i = task.next_item.fetch_add(1); i < p_count; i = task.next_item.fetch_add(1)) {
+		p_func(i);
+		const int done = task.completed.fetch_add(1) + 1;
+		if (done > last_reported) {
+			last_reported = done;
+			p_on_progress(done, p_count);
+		}
+	}
+
+	if (group_id >= 0) {
+		pool->wait_for_group_task_completion(group_id);
+	}
+	if (last_reported < p_count) {
+		p_on_progress(p_count, p_count);
+	}
+}
+
+template <typename F>
+static void _lm_parallel_for(int p_count, int p_thread_count, F &&p_func) {
+	_lm_parallel_for(p_count, p_thread_count, std::forward<F>(p_func), [](int, int) {});
+}
+
 } // namespace
 
 struct _LM_RayTri {
@@ -330,9 +836,126 @@ struct _LM_RayTri {
 	Vector3 c;
 };
 
-struct LightmapBaker::RayMesh {
-	AABB aabb;
-	std::vector<_LM_RayTri> tris;
+// Four triangles of a BVH leaf in SoA form with precomputed edges, tested against one ray at a
+// time by the 4-wide intersection kernel. Unused lanes hold zero edges and never report a hit.
+struct alignas(16) _LM_RayTri4 {
+	float v0[3][4];
+	float e1[3][4];
+	float e2[3][4];
+};
+
+// Shading data for a ray triangle, kept in the same (BVH leaf) order as the triangles.
+struct _LM_RayTriInfo {
+	uint32_t surface = 0; // Index into gathered_meshes.
+	uint32_t triangle = 0; // Index into bake_geometry, for the UV2 of hits.
+	Vector3 normal; // Sum of the world-space vertex normals; only its direction is used for facing tests.
+};
+
+struct _LM_RayHit {
+	uint32_t tri = 0;
+	float t = 0.0f;
+	// Barycentric weights of the second and third vertex.
+	float u = 0.0f;
+	float v = 0.0f;
+};
+
+// Flattened BVH node (32 bytes in float builds). Nodes are stored depth-first, so the
+// first child of an interior node always directly follows it in the array.
+struct _LM_BVHNode {
+	Vector3 aabb_min;
+	Vector3 aabb_max;
+	// Leaf: index of the first triangle (always a multiple of 4). Interior: index of the second child.
+	uint32_t offset = 0;
+	// 0 for interior nodes.
+	uint32_t tri_count = 0;
+};
+
+struct LightmapBaker::RayBVH {
+	std::vector<_LM_BVHNode> nodes;
+	// Triangles reordered so each leaf references a contiguous range, packed four per entry.
+	// Leaves start on a packet boundary, so triangle i lives in lane i % 4 of packet i / 4.
+	std::vector<_LM_RayTri4> tri_packets;
+	// Indexed like the packet lanes; padding lanes hold default-constructed entries.
+	std::vector<_LM_RayTriInfo> tri_infos;
+	uint32_t triangle_count = 0;
+
+	// Traversal statistics (reset per bake).
+	mutable std::atomic<uint64_t> rays_cast{ 0 };
+	mutable std::atomic<uint64_t> nodes_visited{ 0 };
+	mutable std::atomic<uint64_t> triangles_tested{ 0 };
+
+	void build(std::vector<_LM_RayTri> &&p_tris, std::vector<_LM_RayTriInfo> &&p_infos);
+	bool intersects_any(const Vector3 &p_origin, const Vector3 &p_dir, float p_max_dist) const;
+	bool intersect_closest(const Vector3 &p_origin, const Vector3 &p_dir, float p_max_dist, _LM_RayHit &r_hit) const;
+	// Adds the calling thread's pending counters to the totals above.
+	void flush_thread_stats() const;
+
+	size_t get_memory_usage() const {
+		return nodes.capacity() * sizeof(_LM_BVHNode) + tri_packets.capacity() * sizeof(_LM_RayTri4) + tri_infos.capacity() * sizeof(_LM_RayTriInfo);
+	}
+};
+
+// Depth of the closest occluder per texel, rendered on the CPU from a directional light
+// (orthographic, fitted to the scene bounds) or a spot light (perspective over its cone).
+// Texels lit by such a light do a PCF lookup here instead of casting a shadow ray.
+struct LightmapBaker::LightShadowMap {
+	bool perspective = false;
+	int size = 0;
+	Vector3 origin; // Light position, or the center of the scene bounds for directional lights.
+	Vector3 axis_x;
+	Vector3 axis_y;
+	Vector3 axis_z; // Direction the light travels in; depth is measured along it.
+	float scale = 1.0f; // Texels per world unit (orthographic) or per unit of x / depth (perspective).
+	float near = 0.01f; // Perspective only.
+	float bias = 0.0f;
+	std::vector<float> depth;
+
+	Vector3 to_light_space(const Vector3 &p_world) const {
+		const Vector3 d = p_world - origin;
+		return Vector3(d.dot(axis_x), d.dot(axis_y), d.dot(axis_z));
+	}
+	// Texel coordinates of a light-space point (in front of the near plane for perspective maps).
+	Vector2 to_texel(const Vector3 &p_light) const {
+		const float inv_depth = perspective ? 1.0f / (float)p_light.z : 1.0f;
+		const float half = (float)size * 0.5f;
+		return Vector2((float)p_light.x * inv_depth * scale + half, (float)p_light.y * inv_depth * scale + half);
+	}
+	float texel_world_size(float p_depth) const { return perspective ? p_depth / scale : 1.0f / scale; }
+
+	// Renders every triangle of the ray BVH (padding lanes are degenerate and skipped).
+	void render(const std::vector<_LM_RayTri4> &p_packets, int p_thread_count);
+	// Fraction of the 3x3 texels around the point not occluded from the light (1.0 = fully lit).
+	float sample(const Vector3 &p_world_pos, const Vector3 &p_world_normal) const;
+};
+
+// One entry of a cell's alias table (Vose): a uniform pick of entry i returns i's light with
+// probability threshold and the alias entry's light otherwise.
+struct _LM_LightAlias {
+	uint32_t light = 0; // Index into gathered_lights.
+	uint32_t alias = 0; // Entry index within the same cell.
+	float threshold = 1.0f;
+	float pdf = 0.0f; // Probability of picking this entry's light.
+};
+
+// Uniform grid over the scene bounds. Each cell holds the omni and spot lights that can reach it,
+// with an alias table over their estimated contribution to the cell.
+struct LightmapBaker::LightSampleGrid {
+	Vector3 origin;
+	float inv_cell_size = 1.0f;
+	int dims[3] = { 1, 1, 1 };
+	std::vector<uint32_t> cell_first; // Cell c's entries are [cell_first[c], cell_first[c + 1]).
+	std::vector<_LM_LightAlias> entries;
+
+	int cell_index(const Vector3 &p_world_pos) const {
+		int cell[3];
+		for (int axis = 0; axis < 3; axis++) {
+			cell[axis] = CLAMP((int)Math::floor((float)(p_world_pos[axis] - origin[axis]) * inv_cell_size), 0, dims[axis] - 1);
+		}
+		return (cell[2] * dims[1] + cell[1]) * dims[0] + cell[0];
+	}
+	size_t get_memory_usage() const {
+		return cell_first.capacity() * sizeof(uint32_t) + entries.capacity() * sizeof(_LM_LightAlias);
+	}
 };
 
 LightmapBaker::LightmapBaker() {
@@ -366,6 +989,19 @@ LightmapBaker::LightmapBaker() {
 }
 
 LightmapBaker::~LightmapBaker() {
+	if (active_job.is_valid()) {
+		// Freed mid-bake (e.g. on quit, before the deferred completion ran): stop the worker here
+		// rather than leave it running on a dead baker.
+		bake_abort.store(true);
+		if (active_job->thread.joinable()) {
+			active_job->thread.join();
+		}
+		if (active_job->result == BAKE_ERROR_OK) {
+			active_job->result = BAKE_ERROR_USER_ABORTED;
+		}
+		active_job->baker = nullptr;
+		active_job.unref();
+	}
 	gathered_meshes.clear();
 	gathered_lights.clear();
 }
@@ -393,9 +1029,21 @@ void LightmapBaker::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("set_atlas_padding", "padding"), &LightmapBaker::set_atlas_padding);
 	ClassDB::bind_method(D_METHOD("get_atlas_padding"), &LightmapBaker::get_atlas_padding);
 
+	ClassDB::bind_method(D_METHOD("set_atlas_packer", "packer"), &LightmapBaker::set_atlas_packer);
+	ClassDB::bind_method(D_METHOD("get_atlas_packer"), &LightmapBaker::get_atlas_packer);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "atlas_packer", PROPERTY_HINT_ENUM, "Shelf,MaxRects"), "set_atlas_packer", "get_atlas_packer");
+	ClassDB::bind_method(D_METHOD("get_atlas_occupancy"), &LightmapBaker::get_atlas_occupancy);
+
+	ClassDB::bind_method(D_METHOD("set_output_format", "format"), &LightmapBaker::set_output_format);
+	ClassDB::bind_method(D_METHOD("get_output_format"), &LightmapBaker::get_output_format);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "output_format", PROPERTY_HINT_ENUM, "RGBH,RGBE9995,BC6H"), "set_output_format", "get_output_format");
+
 	ClassDB::bind_method(D_METHOD("set_seam_dilation_radius", "radius"), &LightmapBaker::set_seam_dilation_radius);
 	ClassDB::bind_method(D_METHOD("get_seam_dilation_radius"), &LightmapBaker::get_seam_dilation_radius);
 	ADD_PROPERTY(PropertyInfo(Variant::INT, "seam_dilation_radius", PROPERTY_HINT_RANGE, "0,8,1"), "set_seam_dilation_radius", "get_seam_dilation_radius");
+	ClassDB::bind_method(D_METHOD("set_seam_dilation_fill", "enabled"), &LightmapBaker::set_seam_dilation_fill);
+	ClassDB::bind_method(D_METHOD("get_seam_dilation_fill"), &LightmapBaker::get_seam_dilation_fill);
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "seam_dilation_fill"), "set_seam_dilation_fill", "get_seam_dilation_fill");
 
 	ClassDB::bind_method(D_METHOD("set_texel_scale", "scale"), &LightmapBaker::set_texel_scale);
 	ClassDB::bind_method(D_METHOD("get_texel_scale"), &LightmapBaker::get_texel_scale);
@@ -419,6 +1067,37 @@ void LightmapBaker::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("set_use_shadowing", "enabled"), &LightmapBaker::set_use_shadowing);
 	ClassDB::bind_method(D_METHOD("get_use_shadowing"), &LightmapBaker::get_use_shadowing);
 	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "use_shadowing"), "set_use_shadowing", "get_use_shadowing");
+	ClassDB::bind_method(D_METHOD("set_shadow_mode", "mode"), &LightmapBaker::set_shadow_mode);
+	ClassDB::bind_method(D_METHOD("get_shadow_mode"), &LightmapBaker::get_shadow_mode);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "shadow_mode", PROPERTY_HINT_ENUM, "RayTraced,ShadowMap"), "set_shadow_mode", "get_shadow_mode");
+	ClassDB::bind_method(D_METHOD("set_shadow_map_size", "size"), &LightmapBaker::set_shadow_map_size);
+	ClassDB::bind_method(D_METHOD("get_shadow_map_size"), &LightmapBaker::get_shadow_map_size);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "shadow_map_size", PROPERTY_HINT_RANGE, "256,16384,1"), "set_shadow_map_size", "get_shadow_map_size");
+	ClassDB::bind_method(D_METHOD("set_soft_shadow_samples", "samples"), &LightmapBaker::set_soft_shadow_samples);
+	ClassDB::bind_method(D_METHOD("get_soft_shadow_samples"), &LightmapBaker::get_soft_shadow_samples);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "soft_shadow_samples", PROPERTY_HINT_RANGE, "1,64,1"), "set_soft_shadow_samples", "get_soft_shadow_samples");
+
+	ClassDB::bind_method(D_METHOD("set_use_irradiance_cache", "enabled"), &LightmapBaker::set_use_irradiance_cache);
+	ClassDB::bind_method(D_METHOD("get_use_irradiance_cache"), &LightmapBaker::get_use_irradiance_cache);
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "use_irradiance_cache"), "set_use_irradiance_cache", "get_use_irradiance_cache");
+	ClassDB::bind_method(D_METHOD("set_irradiance_cache_error", "error"), &LightmapBaker::set_irradiance_cache_error);
+	ClassDB::bind_method(D_METHOD("get_irradiance_cache_error"), &LightmapBaker::get_irradiance_cache_error);
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "irradiance_cache_error", PROPERTY_HINT_RANGE, "0.05,1,0.01"), "set_irradiance_cache_error", "get_irradiance_cache_error");
+
+	ClassDB::bind_method(D_METHOD("set_use_denoiser", "enabled"), &LightmapBaker::set_use_denoiser);
+	ClassDB::bind_method(D_METHOD("get_use_denoiser"), &LightmapBaker::get_use_denoiser);
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "use_denoiser"), "set_use_denoiser", "get_use_denoiser");
+	ClassDB::bind_method(D_METHOD("set_denoiser_strength", "strength"), &LightmapBaker::set_denoiser_strength);
+	ClassDB::bind_method(D_METHOD("get_denoiser_strength"), &LightmapBaker::get_denoiser_strength);
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "denoiser_strength", PROPERTY_HINT_RANGE, "0,1,0.01"), "set_denoiser_strength", "get_denoiser_strength");
+
+	ClassDB::bind_method(D_METHOD("set_supersample_count", "count"), &LightmapBaker::set_supersample_count);
+	ClassDB::bind_method(D_METHOD("get_supersample_count"), &LightmapBaker::get_supersample_count);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "supersample_count", PROPERTY_HINT_ENUM, "Disabled:0,4 Samples:4,9 Samples:9,16 Samples:16"), "set_supersample_count", "get_supersample_count");
+
+	ClassDB::bind_method(D_METHOD("set_light_sample_count", "count"), &LightmapBaker::set_light_sample_count);
+	ClassDB::bind_method(D_METHOD("get_light_sample_count"), &LightmapBaker::get_light_sample_count);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "light_sample_count", PROPERTY_HINT_RANGE, "0,256,1"), "set_light_sample_count", "get_light_sample_count");
 
 	ClassDB::bind_method(D_METHOD("set_light_falloff_mode", "mode"), &LightmapBaker::set_light_falloff_mode);
 	ClassDB::bind_method(D_METHOD("get_light_falloff_mode"), &LightmapBaker::get_light_falloff_mode);
@@ -439,16 +1118,54 @@ void LightmapBaker::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("get_mesh_layer_mask"), &LightmapBaker::get_mesh_layer_mask);
 	ADD_PROPERTY(PropertyInfo(Variant::INT, "mesh_layer_mask", PROPERTY_HINT_LAYERS_3D_RENDER), "set_mesh_layer_mask", "get_mesh_layer_mask");
 
+	ClassDB::bind_method(D_METHOD("set_texel_budget_mb", "megabytes"), &LightmapBaker::set_texel_budget_mb);
+	ClassDB::bind_method(D_METHOD("get_texel_budget_mb"), &LightmapBaker::get_texel_budget_mb);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "texel_budget_mb", PROPERTY_HINT_RANGE, "0,4096,1,or_greater,suffix:MB"), "set_texel_budget_mb", "get_texel_budget_mb");
+
+	ClassDB::bind_method(D_METHOD("set_thread_count", "count"), &LightmapBaker::set_thread_count);
+	ClassDB::bind_method(D_METHOD("get_thread_count"), &LightmapBaker::get_thread_count);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "thread_count", PROPERTY_HINT_RANGE, "0,256,1"), "set_thread_count", "get_thread_count");
+
+	ClassDB::bind_method(D_METHOD("set_use_bake_cache", "enabled"), &LightmapBaker::set_use_bake_cache);
+	ClassDB::bind_method(D_METHOD("get_use_bake_cache"), &LightmapBaker::get_use_bake_cache);
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "use_bake_cache"), "set_use_bake_cache", "get_use_bake_cache");
+	ClassDB::bind_method(D_METHOD("clear_bake_cache"), &LightmapBaker::clear_bake_cache);
+
+	ClassDB::bind_method(D_METHOD("set_max_memory_mb", "megabytes"), &LightmapBaker::set_max_memory_mb);
+	ClassDB::bind_method(D_METHOD("get_max_memory_mb"), &LightmapBaker::get_max_memory_mb);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "max_memory_mb", PROPERTY_HINT_RANGE, "0,65536,1,or_greater,suffix:MB"), "set_max_memory_mb", "get_max_memory_mb");
+
 	// Main bake methods
 	ClassDB::bind_method(D_METHOD("bake", "from_node", "output_data"), &LightmapBaker::bake);
+	ClassDB::bind_method(D_METHOD("bake_async", "from_node", "output_data"), &LightmapBaker::bake_async);
+	ClassDB::bind_method(D_METHOD("is_baking"), &LightmapBaker::is_baking);
 	ClassDB::bind_static_method(get_class_static(), D_METHOD("lightmap_unwrap", "mesh", "transform", "texel_size"), &LightmapBaker::lightmap_unwrap, DEFVAL(0.0f));
+	ClassDB::bind_static_method(get_class_static(), D_METHOD("lightmap_unwrap_many", "meshes", "texel_size"), &LightmapBaker::lightmap_unwrap_many, DEFVAL(0.0f));
+	ClassDB::bind_static_method(get_class_static(), D_METHOD("set_unwrap_cache_max_memory_mb", "megabytes"), &LightmapBaker::set_unwrap_cache_max_memory_mb);
+	ClassDB::bind_static_method(get_class_static(), D_METHOD("get_unwrap_cache_max_memory_mb"), &LightmapBaker::get_unwrap_cache_max_memory_mb);
+	ClassDB::bind_static_method(get_class_static(), D_METHOD("get_unwrap_cache_memory_usage"), &LightmapBaker::get_unwrap_cache_memory_usage);
+	ClassDB::bind_static_method(get_class_static(), D_METHOD("clear_unwrap_cache"), &LightmapBaker::clear_unwrap_cache);
+	ClassDB::bind_static_method(get_class_static(), D_METHOD("save_unwrap_cache", "path"), &LightmapBaker::save_unwrap_cache, DEFVAL("user://lightmap_unwrap_cache.bin"));
+	ClassDB::bind_static_method(get_class_static(), D_METHOD("load_unwrap_cache", "path"), &LightmapBaker::load_unwrap_cache, DEFVAL("user://lightmap_unwrap_cache.bin"));
 	ClassDB::bind_method(D_METHOD("get_gathered_mesh_count"), &LightmapBaker::get_gathered_mesh_count);
 	ClassDB::bind_method(D_METHOD("get_gathered_light_count"), &LightmapBaker::get_gathered_light_count);
+	ClassDB::bind_method(D_METHOD("get_ray_stats"), &LightmapBaker::get_ray_stats);
+	ClassDB::bind_method(D_METHOD("get_last_bake_stats"), &LightmapBaker::get_last_bake_stats);
 
 	// Enums
 	BIND_ENUM_CONSTANT(LIGHT_FALLOFF_LEGACY);
 	BIND_ENUM_CONSTANT(LIGHT_FALLOFF_INVERSE_SQUARE);
 
+	BIND_ENUM_CONSTANT(ATLAS_PACKER_SHELF);
+	BIND_ENUM_CONSTANT(ATLAS_PACKER_MAX_RECTS);
+
+	BIND_ENUM_CONSTANT(OUTPUT_FORMAT_RGBH);
+	BIND_ENUM_CONSTANT(OUTPUT_FORMAT_RGBE9995);
+	BIND_ENUM_CONSTANT(OUTPUT_FORMAT_BC6H);
+
+	BIND_ENUM_CONSTANT(SHADOW_MODE_RAY_TRACED);
+	BIND_ENUM_CONSTANT(SHADOW_MODE_SHADOW_MAP);
+
 	BIND_ENUM_CONSTANT(BAKE_QUALITY_LOW);
 	BIND_ENUM_CONSTANT(BAKE_QUALITY_MEDIUM);
 	BIND_ENUM_CONSTANT(BAKE_QUALITY_HIGH);
@@ -464,14 +1181,19 @@ void LightmapBaker::_bind_methods() {
 	BIND_ENUM_CONSTANT(BAKE_ERROR_TEXTURE_SIZE_TOO_SMALL);
 	BIND_ENUM_CONSTANT(BAKE_ERROR_LIGHTMAP_TOO_SMALL);
 	BIND_ENUM_CONSTANT(BAKE_ERROR_ATLAS_TOO_SMALL);
+	BIND_ENUM_CONSTANT(BAKE_ERROR_IN_PROGRESS);
 }
 
-int LightmapBaker::lightmap_unwrap(const Ref<ArrayMesh> &p_mesh, const Transform3D &p_transform, float p_texel_size) {
-	if (p_mesh.is_null()) {
-		UtilityFunctions::push_error("LightmapBaker::lightmap_unwrap: mesh is null");
-		return ERR_INVALID_PARAMETER;
+static int _lm_get_processor_count() {
+	OS *os = OS::get_singleton();
+	int count = os != nullptr ? os->get_processor_count() : 0;
+	if (count <= 0) {
+		count = (int)std::thread::hardware_concurrency();
 	}
+	return MAX(1, count);
+}
 
+static float _lm_resolve_unwrap_texel_size(float p_texel_size) {
 	float texel_size = p_texel_size;
 	if (!(texel_size > 0.0f)) {
 		ProjectSettings *ps = ProjectSettings::get_singleton();
@@ -482,152 +1204,424 @@ int LightmapBaker::lightmap_unwrap(const Ref<ArrayMesh> &p_mesh, const Transform
 			texel_size = 0.1f;
 		}
 	}
+	return texel_size;
+}
 
-	struct _SurfaceTmp {
-		Mesh::PrimitiveType primitive = Mesh::PRIMITIVE_TRIANGLES;
-		Array arrays;
-		Ref<Material> material;
-		String name;
-	};
-	std::vector<_SurfaceTmp> rebuilt;
-	rebuilt.reserve((size_t)p_mesh->get_surface_count());
-
-	const bool is_identity = p_transform.is_equal_approx(Transform3D());
-	Vector2i computed_size_hint;
-
-	for (int surface_idx = 0; surface_idx < p_mesh->get_surface_count(); surface_idx++) {
-		Array arrays = p_mesh->surface_get_arrays(surface_idx);
-		if (arrays.is_empty() || arrays.size() < Mesh::ARRAY_MAX) {
-			continue;
-		}
-		PackedVector3Array vertices = arrays[Mesh::ARRAY_VERTEX];
-		PackedVector3Array normals = arrays[Mesh::ARRAY_NORMAL];
-		PackedInt32Array indices = arrays[Mesh::ARRAY_INDEX];
-		PackedVector2Array uv2_existing = arrays[Mesh::ARRAY_TEX_UV2];
-		if (vertices.is_empty()) {
+static bool _lm_mesh_has_uv2(const Ref<Mesh> &p_mesh) {
+	for (int i = 0; i < p_mesh->get_surface_count(); i++) {
+		Array arrays = p_mesh->surface_get_arrays(i);
+		if (arrays.is_empty()) {
 			continue;
 		}
-		if (!uv2_existing.is_empty() && uv2_existing.size() == vertices.size()) {
-			_SurfaceTmp tmp;
-			tmp.primitive = p_mesh->surface_get_primitive_type(surface_idx);
-			tmp.arrays = arrays;
-			tmp.material = p_mesh->surface_get_material(surface_idx);
-			tmp.name = p_mesh->surface_get_name(surface_idx);
-			rebuilt.push_back(tmp);
-			continue;
+		PackedVector2Array uv2 = arrays[Mesh::ARRAY_TEX_UV2];
+		if (!uv2.is_empty()) {
+			return true;
 		}
+	}
+	return false;
+}
 
-		PackedInt32Array tri_indices = _lm_build_triangle_indices(vertices, indices);
-		if (tri_indices.is_empty() || (tri_indices.size() % 3) != 0) {
-			continue;
-		}
-		if (normals.size() != vertices.size()) {
-			normals = _lm_compute_vertex_normals(vertices, tri_indices);
-		}
+// One surface of a mesh being unwrapped. Reading and rebuilding the mesh resource happens on the
+// calling thread; _lm_unwrap_surface() only touches these arrays, so surfaces can run in parallel.
+struct _LM_UnwrapSurface {
+	Mesh::PrimitiveType primitive = Mesh::PRIMITIVE_TRIANGLES;
+	Array arrays;
+	Ref<Material> material;
+	String name;
+	bool needs_unwrap = false;
+	bool keep = false;
+	Vector2i size_hint;
+};
 
-		PackedVector3Array unwrap_pos;
-		PackedVector3Array unwrap_nrm;
-		const PackedVector3Array *pos_for_unwrap = &vertices;
-		const PackedVector3Array *nrm_for_unwrap = &normals;
-		if (!is_identity) {
-			unwrap_pos.resize(vertices.size());
-			unwrap_nrm.resize(normals.size());
-			Basis nxf = p_transform.basis.inverse().transposed();
-			for (int i = 0; i < vertices.size(); i++) {
-				unwrap_pos.set(i, p_transform.xform(vertices[i]));
-				unwrap_nrm.set(i, nxf.xform(normals[i]).normalized());
+struct _LM_UnwrapMesh {
+	Ref<ArrayMesh> mesh;
+	std::vector<_LM_UnwrapSurface> surfaces;
+	int error = OK;
+};
+
+static void _lm_gather_unwrap_surfaces(_LM_UnwrapMesh &r_mesh) {
+	const Ref<ArrayMesh> &mesh = r_mesh.mesh;
+	r_mesh.surfaces.reserve((size_t)mesh->get_surface_count());
+	for (int surface_idx = 0; surface_idx < mesh->get_surface_count(); surface_idx++) {
+		_LM_UnwrapSurface surface;
+		surface.arrays = mesh->surface_get_arrays(surface_idx);
+		surface.primitive = mesh->surface_get_primitive_type(surface_idx);
+		surface.material = mesh->surface_get_material(surface_idx);
+		surface.name = mesh->surface_get_name(surface_idx);
+		if (!surface.arrays.is_empty() && surface.arrays.size() >= Mesh::ARRAY_MAX) {
+			const PackedVector3Array vertices = surface.arrays[Mesh::ARRAY_VERTEX];
+			const PackedVector2Array uv2_existing = surface.arrays[Mesh::ARRAY_TEX_UV2];
+			if (!vertices.is_empty()) {
+				// Surfaces that already have UV2 are kept as they are.
+				surface.keep = !uv2_existing.is_empty() && uv2_existing.size() == vertices.size();
+				surface.needs_unwrap = !surface.keep;
 			}
-			pos_for_unwrap = &unwrap_pos;
-			nrm_for_unwrap = &unwrap_nrm;
 		}
+		r_mesh.surfaces.push_back(surface);
+	}
+}
 
-		PackedInt32Array out_xrefs;
-		PackedVector2Array out_uv2;
-		PackedInt32Array out_indices;
-		Vector2i out_hint;
-		if (!_lm_xatlas_unwrap(texel_size, *pos_for_unwrap, *nrm_for_unwrap, tri_indices, out_xrefs, out_uv2, out_indices, out_hint)) {
-			continue;
+// Replaces r_surface.arrays with the unwrapped surface. Surfaces that can't be unwrapped are
+// left with keep == false and dropped from the rebuilt mesh.
+static void _lm_unwrap_surface(_LM_UnwrapSurface &r_surface, const Transform3D &p_transform, bool p_is_identity, float p_texel_size) {
+	const Array &arrays = r_surface.arrays;
+	PackedVector3Array vertices = arrays[Mesh::ARRAY_VERTEX];
+	PackedVector3Array normals = arrays[Mesh::ARRAY_NORMAL];
+	PackedInt32Array indices = arrays[Mesh::ARRAY_INDEX];
+
+	PackedInt32Array tri_indices = _lm_build_triangle_indices(vertices, indices);
+	if (tri_indices.is_empty() || (tri_indices.size() % 3) != 0) {
+		return;
+	}
+	if (normals.size() != vertices.size()) {
+		normals = _lm_compute_vertex_normals(vertices, tri_indices);
+	}
+
+	PackedVector3Array unwrap_pos;
+	PackedVector3Array unwrap_nrm;
+	const PackedVector3Array *pos_for_unwrap = &vertices;
+	const PackedVector3Array *nrm_for_unwrap = &normals;
+	if (!p_is_identity) {
+		unwrap_pos.resize(vertices.size());
+		unwrap_nrm.resize(normals.size());
+		Basis nxf = p_transform.basis.inverse().transposed();
+		for (int i = 0; i < vertices.size(); i++) {
+			unwrap_pos.set(i, p_transform.xform(vertices[i]));
+			unwrap_nrm.set(i, nxf.xform(normals[i]).normalized());
+		}
+		pos_for_unwrap = &unwrap_pos;
+		nrm_for_unwrap = &unwrap_nrm;
+	}
+
+	PackedInt32Array out_xrefs;
+	PackedVector2Array out_uv2;
+	PackedInt32Array out_indices;
+	Vector2i out_hint;
+	if (!_lm_xatlas_unwrap(p_texel_size, *pos_for_unwrap, *nrm_for_unwrap, tri_indices, out_xrefs, out_uv2, out_indices, out_hint)) {
+		return;
+	}
+
+	Array surface_arrays;
+	surface_arrays.resize(Mesh::ARRAY_MAX);
+	PackedVector3Array out_vertices;
+	PackedVector3Array out_normals;
+	out_vertices.resize(out_xrefs.size());
+	out_normals.resize(out_xrefs.size());
+	for (int i = 0; i < out_xrefs.size(); i++) {
+		const int xref = out_xrefs[i];
+		out_vertices.set(i, (xref >= 0 && xref < vertices.size()) ? vertices[xref] : Vector3());
+		out_normals.set(i, (xref >= 0 && xref < normals.size()) ? normals[xref] : Vector3(0, 1, 0));
+	}
+	surface_arrays[Mesh::ARRAY_VERTEX] = out_vertices;
+	surface_arrays[Mesh::ARRAY_NORMAL] = out_normals;
+	surface_arrays[Mesh::ARRAY_TEX_UV2] = out_uv2;
+	surface_arrays[Mesh::ARRAY_INDEX] = out_indices;
+	_lm_remap_surface_attributes_by_xref(surface_arrays, arrays, out_xrefs, vertices.size());
+
+	r_surface.arrays = surface_arrays;
+	r_surface.size_hint = out_hint;
+	r_surface.keep = true;
+}
+
+static int _lm_apply_unwrap(_LM_UnwrapMesh &r_mesh) {
+	const Ref<ArrayMesh> &mesh = r_mesh.mesh;
+	Vector2i computed_size_hint;
+	int kept = 0;
+	for (const _LM_UnwrapSurface &surface : r_mesh.surfaces) {
+		if (surface.keep) {
+			kept++;
+			computed_size_hint.x = MAX(computed_size_hint.x, surface.size_hint.x);
+			computed_size_hint.y = MAX(computed_size_hint.y, surface.size_hint.y);
 		}
-		computed_size_hint.x = MAX(computed_size_hint.x, out_hint.x);
-		computed_size_hint.y = MAX(computed_size_hint.y, out_hint.y);
-
-		Array surface_arrays;
-		surface_arrays.resize(Mesh::ARRAY_MAX);
-		PackedVector3Array out_vertices;
-		PackedVector3Array out_normals;
-		out_vertices.resize(out_xrefs.size());
-		out_normals.resize(out_xrefs.size());
-		for (int i = 0; i < out_xrefs.size(); i++) {
-			const int xref = out_xrefs[i];
-			out_vertices.set(i, (xref >= 0 && xref < vertices.size()) ? vertices[xref] : Vector3());
-			out_normals.set(i, (xref >= 0 && xref < normals.size()) ? normals[xref] : Vector3(0, 1, 0));
-		}
-		surface_arrays[Mesh::ARRAY_VERTEX] = out_vertices;
-		surface_arrays[Mesh::ARRAY_NORMAL] = out_normals;
-		surface_arrays[Mesh::ARRAY_TEX_UV2] = out_uv2;
-		surface_arrays[Mesh::ARRAY_INDEX] = out_indices;
-		_lm_remap_surface_attributes_by_xref(surface_arrays, arrays, out_xrefs, vertices.size());
-
-		_SurfaceTmp tmp;
-		tmp.primitive = p_mesh->surface_get_primitive_type(surface_idx);
-		tmp.arrays = surface_arrays;
-		tmp.material = p_mesh->surface_get_material(surface_idx);
-		tmp.name = p_mesh->surface_get_name(surface_idx);
-		rebuilt.push_back(tmp);
-	}
-
-	if (rebuilt.empty()) {
+	}
+	if (kept == 0) {
 		return ERR_UNAVAILABLE;
 	}
 
-	p_mesh->clear_surfaces();
-	for (size_t i = 0; i < rebuilt.size(); i++) {
-		p_mesh->add_surface_from_arrays(rebuilt[i].primitive, rebuilt[i].arrays);
-		p_mesh->surface_set_material((int)i, rebuilt[i].material);
-		if (!rebuilt[i].name.is_empty()) {
-			p_mesh->surface_set_name((int)i, rebuilt[i].name);
+	mesh->clear_surfaces();
+	int surface_index = 0;
+	for (const _LM_UnwrapSurface &surface : r_mesh.surfaces) {
+		if (!surface.keep) {
+			continue;
+		}
+		mesh->add_surface_from_arrays(surface.primitive, surface.arrays);
+		mesh->surface_set_material(surface_index, surface.material);
+		if (!surface.name.is_empty()) {
+			mesh->surface_set_name(surface_index, surface.name);
 		}
+		surface_index++;
 	}
 
 	// Propagate the unwrap size hint (critical for downstream baking/atlas packing).
 	if (computed_size_hint.x > 0 && computed_size_hint.y > 0) {
-		Vector2i existing_hint = p_mesh->get_lightmap_size_hint();
+		Vector2i existing_hint = mesh->get_lightmap_size_hint();
 		if (existing_hint.x <= 0 || existing_hint.y <= 0) {
-			p_mesh->set_lightmap_size_hint(computed_size_hint);
+			mesh->set_lightmap_size_hint(computed_size_hint);
 		} else {
-			p_mesh->set_lightmap_size_hint(Vector2i(MAX(existing_hint.x, computed_size_hint.x), MAX(existing_hint.y, computed_size_hint.y)));
+			mesh->set_lightmap_size_hint(Vector2i(MAX(existing_hint.x, computed_size_hint.x), MAX(existing_hint.y, computed_size_hint.y)));
 		}
 	}
 
 	return OK;
 }
 
-// Configuration methods
-void LightmapBaker::set_bake_quality(BakeQuality p_quality) {
-	bake_quality = p_quality;
-}
+// Unwraps every surface of every mesh, fanning the xatlas work for all surfaces out over
+// p_thread_count threads. r_meshes[i].error receives the per-mesh result.
+static void _lm_unwrap_meshes(std::vector<_LM_UnwrapMesh> &r_meshes, const Transform3D &p_transform, float p_texel_size, int p_thread_count) {
+	std::vector<_LM_UnwrapSurface *> work;
+	for (_LM_UnwrapMesh &mesh : r_meshes) {
+		if (mesh.mesh.is_null()) {
+			continue;
+		}
+		_lm_gather_unwrap_surfaces(mesh);
+		for (_LM_UnwrapSurface &surface : mesh.surfaces) {
+			if (surface.needs_unwrap) {
+				work.push_back(&surface);
+			}
+		}
+	}
 
-LightmapBaker::BakeQuality LightmapBaker::get_bake_quality() const {
-	return bake_quality;
-}
+	// Largest surfaces first, so one big chunk doesn't end up last on a single thread.
+	std::vector<int64_t> work_cost(work.size());
+	for (size_t i = 0; i < work.size(); i++) {
+		const PackedInt32Array indices = work[i]->arrays[Mesh::ARRAY_INDEX];
+		const PackedVector3Array vertices = work[i]->arrays[Mesh::ARRAY_VERTEX];
+		work_cost[i] = indices.is_empty() ? vertices.size() : indices.size();
+	}
+	std::vector<int> order(work.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = (int)i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return work_cost[(size_t)a] > work_cost[(size_t)b]; });
 
-void LightmapBaker::set_bounces(int p_bounces) {
-	bounces = p_bounces;
+	const bool is_identity = p_transform.is_equal_approx(Transform3D());
+	_lm_parallel_for((int)order.size(), p_thread_count, [&](int p_index) {
+		_lm_unwrap_surface(*work[(size_t)order[(size_t)p_index]], p_transform, is_identity, p_texel_size);
+	});
+
+	for (_LM_UnwrapMesh &mesh : r_meshes) {
+		if (mesh.mesh.is_null()) {
+			mesh.error = ERR_INVALID_PARAMETER;
+			continue;
+		}
+		mesh.error = _lm_apply_unwrap(mesh);
+	}
 }
 
-int LightmapBaker::get_bounces() const {
-	return bounces;
+int LightmapBaker::lightmap_unwrap(const Ref<ArrayMesh> &p_mesh, const Transform3D &p_transform, float p_texel_size) {
+	if (p_mesh.is_null()) {
+		UtilityFunctions::push_error("LightmapBaker::lightmap_unwrap: mesh is null");
+		return ERR_INVALID_PARAMETER;
+	}
+
+	std::vector<_LM_UnwrapMesh> meshes(1);
+	meshes[0].mesh = p_mesh;
+	_lm_unwrap_meshes(meshes, p_transform, _lm_resolve_unwrap_texel_size(p_texel_size), _lm_get_processor_count());
+	return meshes[0].error;
 }
 
-void LightmapBaker::set_bounce_indirect_energy(float p_energy) {
-	bounce_indirect_energy = p_energy;
+PackedInt32Array LightmapBaker::lightmap_unwrap_many(const Array &p_meshes, float p_texel_size) {
+	return _unwrap_many(p_meshes, p_texel_size, _lm_get_processor_count());
 }
 
-float LightmapBaker::get_bounce_indirect_energy() const {
+PackedInt32Array LightmapBaker::_unwrap_many(const Array &p_meshes, float p_texel_size, int p_thread_count) {
+	PackedInt32Array errors;
+	errors.resize(p_meshes.size());
+
+	// The same mesh listed twice is unwrapped once; later entries share the first one's result.
+	std::vector<_LM_UnwrapMesh> meshes;
+	std::vector<int> entry_to_mesh((size_t)p_meshes.size(), -1);
+	std::unordered_map<const ArrayMesh *, int> mesh_lookup;
+	for (int i = 0; i < p_meshes.size(); i++) {
+		Ref<ArrayMesh> mesh = p_meshes[i];
+		if (mesh.is_null()) {
+			UtilityFunctions::push_error("LightmapBaker::lightmap_unwrap_many: entry " + String::num_int64(i) + " is not an ArrayMesh");
+			continue;
+		}
+		auto it = mesh_lookup.find(mesh.ptr());
+		if (it != mesh_lookup.end()) {
+			entry_to_mesh[(size_t)i] = it->second;
+			continue;
+		}
+		entry_to_mesh[(size_t)i] = (int)meshes.size();
+		mesh_lookup.emplace(mesh.ptr(), (int)meshes.size());
+		meshes.emplace_back();
+		meshes.back().mesh = mesh;
+	}
+
+	_lm_unwrap_meshes(meshes, Transform3D(), _lm_resolve_unwrap_texel_size(p_texel_size), p_thread_count);
+
+	for (int i = 0; i < p_meshes.size(); i++) {
+		const int mesh_index = entry_to_mesh[(size_t)i];
+		errors.set(i, mesh_index >= 0 ? meshes[(size_t)mesh_index].error : (int)ERR_INVALID_PARAMETER);
+	}
+	return errors;
+}
+
+void LightmapBaker::set_unwrap_cache_max_memory_mb(int p_megabytes) {
+	std::lock_guard<std::mutex> lock(_lm_unwrap_cache.mutex);
+	_lm_unwrap_cache.max_memory = (size_t)MAX(0, p_megabytes) * 1024 * 1024;
+	_lm_unwrap_cache.evict();
+}
+
+int LightmapBaker::get_unwrap_cache_max_memory_mb() {
+	std::lock_guard<std::mutex> lock(_lm_unwrap_cache.mutex);
+	return (int)(_lm_unwrap_cache.max_memory / (1024 * 1024));
+}
+
+int64_t LightmapBaker::get_unwrap_cache_memory_usage() {
+	std::lock_guard<std::mutex> lock(_lm_unwrap_cache.mutex);
+	return (int64_t)_lm_unwrap_cache.memory;
+}
+
+void LightmapBaker::clear_unwrap_cache() {
+	std::lock_guard<std::mutex> lock(_lm_unwrap_cache.mutex);
+	_lm_unwrap_cache.clear();
+}
+
+int LightmapBaker::save_unwrap_cache(const String &p_path) {
+	PackedByteArray data;
+	{
+		std::lock_guard<std::mutex> lock(_lm_unwrap_cache.mutex);
+		_lm_append_value(data, LM_UNWRAP_CACHE_MAGIC);
+		_lm_append_value(data, LM_UNWRAP_CACHE_VERSION);
+		_lm_append_value(data, (uint32_t)_lm_unwrap_cache.lru.size());
+		for (const _LM_UnwrapCacheKey &key : _lm_unwrap_cache.lru) {
+			const _LM_UnwrapCacheEntry &entry = _lm_unwrap_cache.entries.find(key)->second.entry;
+			_lm_append_value(data, key.a);
+			_lm_append_value(data, key.b);
+			_lm_append_value(data, (int32_t)entry.size_hint.x);
+			_lm_append_value(data, (int32_t)entry.size_hint.y);
+			_lm_append_value(data, (uint32_t)entry.xrefs.size());
+			_lm_append_bytes(data, entry.xrefs.ptr(), (size_t)entry.xrefs.size() * sizeof(int32_t));
+			_lm_append_value(data, (uint32_t)entry.uv2.size());
+			for (int i = 0; i < entry.uv2.size(); i++) {
+				_lm_append_value(data, (float)entry.uv2[i].x);
+				_lm_append_value(data, (float)entry.uv2[i].y);
+			}
+			_lm_append_value(data, (uint32_t)entry.indices.size());
+			_lm_append_bytes(data, entry.indices.ptr(), (size_t)entry.indices.size() * sizeof(int32_t));
+		}
+	}
+
+	Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::WRITE);
+	if (file.is_null()) {
+		UtilityFunctions::push_error("LightmapBaker: can't write unwrap cache to " + p_path);
+		return (int)FileAccess::get_open_error();
+	}
+	file->store_buffer(data);
+	file->close();
+	return (int)OK;
+}
+
+int LightmapBaker::load_unwrap_cache(const String &p_path) {
+	if (!FileAccess::file_exists(p_path)) {
+		return (int)ERR_FILE_NOT_FOUND;
+	}
+	const PackedByteArray data = FileAccess::get_file_as_bytes(p_path);
+	_LM_ByteReader reader;
+	reader.data = data.ptr();
+	reader.size = (size_t)data.size();
+
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint32_t count = 0;
+	if (!reader.read_value(magic) || !reader.read_value(version) || !reader.read_value(count) || magic != LM_UNWRAP_CACHE_MAGIC) {
+		UtilityFunctions::push_error("LightmapBaker: " + p_path + " is not an unwrap cache file");
+		return (int)ERR_FILE_CORRUPT;
+	}
+	if (version != LM_UNWRAP_CACHE_VERSION) {
+		return (int)ERR_FILE_UNRECOGNIZED;
+	}
+
+	std::vector<std::pair<_LM_UnwrapCacheKey, _LM_UnwrapCacheEntry>> loaded;
+	for (uint32_t e = 0; e < count; e++) {
+		_LM_UnwrapCacheKey key;
+		int32_t hint_x = 0;
+		int32_t hint_y = 0;
+		uint32_t xref_count = 0;
+		if (!reader.read_value(key.a) || !reader.read_value(key.b) || !reader.read_value(hint_x) || !reader.read_value(hint_y) || !reader.read_value(xref_count)) {
+			return (int)ERR_FILE_CORRUPT;
+		}
+		if ((size_t)xref_count * sizeof(int32_t) > reader.size - reader.pos) {
+			return (int)ERR_FILE_CORRUPT;
+		}
+		_LM_UnwrapCacheEntry entry;
+		entry.size_hint = Vector2i(hint_x, hint_y);
+		entry.xrefs.resize((int64_t)xref_count);
+		reader.read(entry.xrefs.ptrw(), (size_t)xref_count * sizeof(int32_t));
+
+		uint32_t uv_count = 0;
+		if (!reader.read_value(uv_count) || uv_count != xref_count || (size_t)uv_count * sizeof(float) * 2 > reader.size - reader.pos) {
+			return (int)ERR_FILE_CORRUPT;
+		}
+		entry.uv2.resize((int64_t)uv_count);
+		for (uint32_t i = 0; i < uv_count; i++) {
+			float uv[2];
+			reader.read(uv, sizeof(uv));
+			entry.uv2.set((int64_t)i, Vector2(uv[0], uv[1]));
+		}
+
+		uint32_t index_count = 0;
+		if (!reader.read_value(index_count) || (size_t)index_count * sizeof(int32_t) > reader.size - reader.pos) {
+			return (int)ERR_FILE_CORRUPT;
+		}
+		entry.indices.resize((int64_t)index_count);
+		reader.read(entry.indices.ptrw(), (size_t)index_count * sizeof(int32_t));
+		for (uint32_t i = 0; i < index_count; i++) {
+			if (entry.indices[(int64_t)i] < 0 || (uint32_t)entry.indices[(int64_t)i] >= xref_count) {
+				return (int)ERR_FILE_CORRUPT;
+			}
+		}
+		loaded.emplace_back(key, entry);
+	}
+
+	// Insert oldest first so the file's recency order is kept.
+	std::lock_guard<std::mutex> lock(_lm_unwrap_cache.mutex);
+	for (auto it = loaded.rbegin(); it != loaded.rend(); ++it) {
+		_lm_unwrap_cache.insert(it->first, it->second);
+	}
+	return (int)OK;
+}
+
+// Configuration methods
+void LightmapBaker::set_bake_quality(BakeQuality p_quality) {
+	if (_reject_while_baking("set_bake_quality")) {
+		return;
+	}
+	bake_quality = p_quality;
+}
+
+LightmapBaker::BakeQuality LightmapBaker::get_bake_quality() const {
+	return bake_quality;
+}
+
+void LightmapBaker::set_bounces(int p_bounces) {
+	if (_reject_while_baking("set_bounces")) {
+		return;
+	}
+	bounces = p_bounces;
+}
+
+int LightmapBaker::get_bounces() const {
+	return bounces;
+}
+
+void LightmapBaker::set_bounce_indirect_energy(float p_energy) {
+	if (_reject_while_baking("set_bounce_indirect_energy")) {
+		return;
+	}
+	bounce_indirect_energy = p_energy;
+}
+
+float LightmapBaker::get_bounce_indirect_energy() const {
 	return bounce_indirect_energy;
 }
 
 void LightmapBaker::set_mesh_layer_mask(uint32_t p_mask) {
+	if (_reject_while_baking("set_mesh_layer_mask")) {
+		return;
+	}
 	mesh_layer_mask = p_mask;
 }
 
@@ -636,6 +1630,9 @@ uint32_t LightmapBaker::get_mesh_layer_mask() const {
 }
 
 void LightmapBaker::set_bias(float p_bias) {
+	if (_reject_while_baking("set_bias")) {
+		return;
+	}
 	bias = p_bias;
 }
 
@@ -644,6 +1641,9 @@ float LightmapBaker::get_bias() const {
 }
 
 void LightmapBaker::set_max_texture_size(int p_size) {
+	if (_reject_while_baking("set_max_texture_size")) {
+		return;
+	}
 	max_texture_size = p_size;
 }
 
@@ -652,6 +1652,9 @@ int LightmapBaker::get_max_texture_size() const {
 }
 
 void LightmapBaker::set_atlas_size_override(int p_size) {
+	if (_reject_while_baking("set_atlas_size_override")) {
+		return;
+	}
 	atlas_size_override = p_size;
 }
 
@@ -660,6 +1663,9 @@ int LightmapBaker::get_atlas_size_override() const {
 }
 
 void LightmapBaker::set_atlas_padding(int p_padding) {
+	if (_reject_while_baking("set_atlas_padding")) {
+		return;
+	}
 	atlas_padding = p_padding;
 }
 
@@ -668,6 +1674,9 @@ int LightmapBaker::get_atlas_padding() const {
 }
 
 void LightmapBaker::set_seam_dilation_radius(int p_radius) {
+	if (_reject_while_baking("set_seam_dilation_radius")) {
+		return;
+	}
 	seam_dilation_radius = p_radius;
 }
 
@@ -675,7 +1684,21 @@ int LightmapBaker::get_seam_dilation_radius() const {
 	return seam_dilation_radius;
 }
 
+void LightmapBaker::set_seam_dilation_fill(bool p_enabled) {
+	if (_reject_while_baking("set_seam_dilation_fill")) {
+		return;
+	}
+	seam_dilation_fill = p_enabled;
+}
+
+bool LightmapBaker::get_seam_dilation_fill() const {
+	return seam_dilation_fill;
+}
+
 void LightmapBaker::set_texel_scale(float p_scale) {
+	if (_reject_while_baking("set_texel_scale")) {
+		return;
+	}
 	texel_scale = p_scale;
 }
 
@@ -684,6 +1707,9 @@ float LightmapBaker::get_texel_scale() const {
 }
 
 void LightmapBaker::set_lightmap_energy_scale(float p_scale) {
+	if (_reject_while_baking("set_lightmap_energy_scale")) {
+		return;
+	}
 	lightmap_energy_scale = p_scale;
 }
 
@@ -692,6 +1718,9 @@ float LightmapBaker::get_lightmap_energy_scale() const {
 }
 
 void LightmapBaker::set_ambient_energy(float p_energy) {
+	if (_reject_while_baking("set_ambient_energy")) {
+		return;
+	}
 	ambient_energy = p_energy;
 }
 
@@ -700,6 +1729,9 @@ float LightmapBaker::get_ambient_energy() const {
 }
 
 void LightmapBaker::set_use_material_albedo(bool p_enabled) {
+	if (_reject_while_baking("set_use_material_albedo")) {
+		return;
+	}
 	use_material_albedo = p_enabled;
 }
 
@@ -708,6 +1740,9 @@ bool LightmapBaker::get_use_material_albedo() const {
 }
 
 void LightmapBaker::set_use_lambert_normalization(bool p_enabled) {
+	if (_reject_while_baking("set_use_lambert_normalization")) {
+		return;
+	}
 	use_lambert_normalization = p_enabled;
 }
 
@@ -716,6 +1751,9 @@ bool LightmapBaker::get_use_lambert_normalization() const {
 }
 
 void LightmapBaker::set_use_shadowing(bool p_enabled) {
+	if (_reject_while_baking("set_use_shadowing")) {
+		return;
+	}
 	use_shadowing = p_enabled;
 }
 
@@ -723,7 +1761,115 @@ bool LightmapBaker::get_use_shadowing() const {
 	return use_shadowing;
 }
 
+void LightmapBaker::set_shadow_mode(ShadowMode p_mode) {
+	if (_reject_while_baking("set_shadow_mode")) {
+		return;
+	}
+	shadow_mode = p_mode;
+}
+
+LightmapBaker::ShadowMode LightmapBaker::get_shadow_mode() const {
+	return shadow_mode;
+}
+
+void LightmapBaker::set_shadow_map_size(int p_size) {
+	if (_reject_while_baking("set_shadow_map_size")) {
+		return;
+	}
+	shadow_map_size = CLAMP(p_size, 256, 16384);
+}
+
+int LightmapBaker::get_shadow_map_size() const {
+	return shadow_map_size;
+}
+
+void LightmapBaker::set_soft_shadow_samples(int p_samples) {
+	if (_reject_while_baking("set_soft_shadow_samples")) {
+		return;
+	}
+	soft_shadow_samples = CLAMP(p_samples, 1, 64);
+}
+
+int LightmapBaker::get_soft_shadow_samples() const {
+	return soft_shadow_samples;
+}
+
+void LightmapBaker::set_use_irradiance_cache(bool p_enabled) {
+	if (_reject_while_baking("set_use_irradiance_cache")) {
+		return;
+	}
+	use_irradiance_cache = p_enabled;
+}
+
+bool LightmapBaker::get_use_irradiance_cache() const {
+	return use_irradiance_cache;
+}
+
+void LightmapBaker::set_irradiance_cache_error(float p_error) {
+	if (_reject_while_baking("set_irradiance_cache_error")) {
+		return;
+	}
+	irradiance_cache_error = CLAMP(p_error, 0.05f, 1.0f);
+}
+
+float LightmapBaker::get_irradiance_cache_error() const {
+	return irradiance_cache_error;
+}
+
+void LightmapBaker::set_use_denoiser(bool p_enabled) {
+	if (_reject_while_baking("set_use_denoiser")) {
+		return;
+	}
+	use_denoiser = p_enabled;
+}
+
+bool LightmapBaker::get_use_denoiser() const {
+	return use_denoiser;
+}
+
+void LightmapBaker::set_denoiser_strength(float p_strength) {
+	if (_reject_while_baking("set_denoiser_strength")) {
+		return;
+	}
+	denoiser_strength = CLAMP(p_strength, 0.0f, 1.0f);
+}
+
+float LightmapBaker::get_denoiser_strength() const {
+	return denoiser_strength;
+}
+
+void LightmapBaker::set_supersample_count(int p_count) {
+	if (_reject_while_baking("set_supersample_count")) {
+		return;
+	}
+	// Rounded to a square grid of 2x2, 3x3 or 4x4 stratified sub-samples.
+	if (p_count <= 1) {
+		supersample_count = 0;
+		return;
+	}
+	const int grid = CLAMP((int)Math::round(Math::sqrt((float)p_count)), 2, 4);
+	supersample_count = grid * grid;
+}
+
+int LightmapBaker::get_supersample_count() const {
+	return supersample_count;
+}
+
+void LightmapBaker::set_light_sample_count(int p_count) {
+	if (_reject_while_baking("set_light_sample_count")) {
+		return;
+	}
+	light_sample_count = CLAMP(p_count, 0, 256);
+}
+
+int LightmapBaker::get_light_sample_count() const {
+	return light_sample_count;
+}
+
 void LightmapBaker::set_light_falloff_mode(LightFalloffMode p_mode) {
+	if (_reject_while_baking("set_light_falloff_mode")) {
+		return;
+	}
 	light_falloff_mode = p_mode;
 }
 
@@ -731,7 +1877,36 @@ LightmapBaker::LightFalloffMode LightmapBaker::get_light_falloff_mode() const {
 	return light_falloff_mode;
 }
 
+void LightmapBaker::set_output_format(OutputFormat p_format) {
+	if (_reject_while_baking("set_output_format")) {
+		return;
+	}
+	output_format = p_format;
+}
+
+LightmapBaker::OutputFormat LightmapBaker::get_output_format() const {
+	return output_format;
+}
+
+void LightmapBaker::set_atlas_packer(AtlasPacker p_packer) {
+	if (_reject_while_baking("set_atlas_packer")) {
+		return;
+	}
+	atlas_packer = p_packer;
+}
+
+LightmapBaker::AtlasPacker LightmapBaker::get_atlas_packer() const {
+	return atlas_packer;
+}
+
+float LightmapBaker::get_atlas_occupancy() const {
+	return atlas_occupancy;
+}
+
 void LightmapBaker::set_use_environment_ambient(bool p_enabled) {
+	if (_reject_while_baking("set_use_environment_ambient")) {
+		return;
+	}
 	use_environment_ambient = p_enabled;
 }
 
@@ -740,6 +1915,9 @@ bool LightmapBaker::get_use_environment_ambient() const {
 }
 
 void LightmapBaker::set_environment_ambient_scale(float p_scale) {
+	if (_reject_while_baking("set_environment_ambient_scale")) {
+		return;
+	}
 	environment_ambient_scale = p_scale;
 }
 
@@ -748,6 +1926,9 @@ float LightmapBaker::get_environment_ambient_scale() const {
 }
 
 void LightmapBaker::set_auto_unwrap_uv2(bool p_enabled) {
+	if (_reject_while_baking("set_auto_unwrap_uv2")) {
+		return;
+	}
 	auto_unwrap_uv2 = p_enabled;
 }
 
@@ -755,6 +1936,60 @@ bool LightmapBaker::get_auto_unwrap_uv2() const {
 	return auto_unwrap_uv2;
 }
 
+void LightmapBaker::set_thread_count(int p_count) {
+	if (_reject_while_baking("set_thread_count")) {
+		return;
+	}
+	thread_count = MAX(0, p_count);
+}
+
+int LightmapBaker::get_thread_count() const {
+	return thread_count;
+}
+
+void LightmapBaker::set_use_bake_cache(bool p_enabled) {
+	if (_reject_while_baking("set_use_bake_cache")) {
+		return;
+	}
+	use_bake_cache = p_enabled;
+	if (!use_bake_cache) {
+		bake_cache.clear();
+	}
+}
+
+bool LightmapBaker::get_use_bake_cache() const {
+	return use_bake_cache;
+}
+
+void LightmapBaker::clear_bake_cache() {
+	if (_reject_while_baking("clear_bake_cache")) {
+		return;
+	}
+	bake_cache.clear();
+}
+
+void LightmapBaker::set_texel_budget_mb(int p_megabytes) {
+	if (_reject_while_baking("set_texel_budget_mb")) {
+		return;
+	}
+	texel_budget_mb = MAX(0, p_megabytes);
+}
+
+int LightmapBaker::get_texel_budget_mb() const {
+	return texel_budget_mb;
+}
+
+void LightmapBaker::set_max_memory_mb(int p_megabytes) {
+	if (_reject_while_baking("set_max_memory_mb")) {
+		return;
+	}
+	max_memory_mb = MAX(0, p_megabytes);
+}
+
+int LightmapBaker::get_max_memory_mb() const {
+	return max_memory_mb;
+}
+
 // Main bake entry point
 LightmapBaker::BakeError LightmapBaker::bake(Node *p_from_node, Ref<LightmapGIData> p_output_data) {
 	return bake_with_progress(p_from_node, p_output_data, nullptr, nullptr);
@@ -771,10 +2006,78 @@ LightmapBaker::BakeError LightmapBaker::bake_with_progress(Node *p_from_node, Re
 		return BAKE_ERROR_NO_MESHES;
 	}
 
+	bool expected = false;
+	if (!bake_running.compare_exchange_strong(expected, true)) {
+		UtilityFunctions::push_error("LightmapBaker: a bake is already running on this baker");
+		return BAKE_ERROR_IN_PROGRESS;
+	}
+	bake_abort.store(false);
+
+	_report_progress(0.0f, "Gathering meshes and lights...", p_progress_func, p_userdata);
+	BakeError error = _prepare_bake(p_from_node);
+	if (error == BAKE_ERROR_OK) {
+		error = _run_bake(p_progress_func, p_userdata);
+	}
+	if (error == BAKE_ERROR_OK) {
+		_report_progress(0.9f, "Finalizing lightmaps...", p_progress_func, p_userdata);
+		error = _finish_bake(p_output_data);
+	}
+	bake_running.store(false);
+	if (error != BAKE_ERROR_OK) {
+		return error;
+	}
+
+	_report_progress(1.0f, "Bake complete!", p_progress_func, p_userdata);
+
+	return BAKE_ERROR_OK;
+}
+
+Ref<LightmapBakeJob> LightmapBaker::bake_async(Node *p_from_node, Ref<LightmapGIData> p_output_data) {
+	if (p_from_node == nullptr) {
+		UtilityFunctions::push_error("LightmapBaker: bake_async() needs a scene root");
+		return Ref<LightmapBakeJob>();
+	}
+	if (p_output_data.is_null()) {
+		UtilityFunctions::push_error("LightmapBaker: output LightmapGIData is null");
+		return Ref<LightmapBakeJob>();
+	}
+
+	bool expected = false;
+	if (!bake_running.compare_exchange_strong(expected, true)) {
+		UtilityFunctions::push_error("LightmapBaker: a bake is already running on this baker");
+		return Ref<LightmapBakeJob>();
+	}
+	bake_abort.store(false);
+
+	Ref<LightmapBakeJob> job;
+	job.instantiate();
+	job->baker = this;
+	job->output_data = p_output_data;
+	// Keeps the job alive until completed has been emitted, even if the caller drops it.
+	active_job = job;
+
+	// Scene gathering touches nodes and resources, so it stays on the calling (main) thread.
+	job->_set_progress(0.0f, "Gathering meshes and lights...");
+	const BakeError error = _prepare_bake(p_from_node);
+	if (error != BAKE_ERROR_OK) {
+		// Completion is still deferred, so callers can connect to the signals first.
+		job->result = error;
+		job->work_done.store(true);
+		job->call_deferred("_finish");
+		return job;
+	}
+
+	job->thread = std::thread(&LightmapBakeJob::_thread_main, job.ptr());
+	return job;
+}
+
+LightmapBaker::BakeError LightmapBaker::_prepare_bake(Node *p_from_node) {
 	// Clear previous data
 	gathered_meshes.clear();
 	gathered_lights.clear();
-	ray_meshes.clear();
+	ray_bvh.reset();
+	bake_geometry = BakeGeometry();
+	bake_stats = BakeStats();
 	baked_environment_ambient = Vector3();
 
 	// Cache environment ambient once per bake (optional).
@@ -814,10 +2117,23 @@ LightmapBaker::BakeError LightmapBaker::bake_with_progress(Node *p_from_node, Re
 		}
 	}
 
-	_report_progress(0.0f, "Gathering meshes and lights...", p_progress_func, p_userdata);
+	if (auto_unwrap_uv2) {
+		_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_UNWRAP]);
+		_auto_unwrap_meshes(p_from_node);
+	}
+
+	// Texture format support is a rendering device query, so it is resolved here on the main thread.
+	output_bc6h_supported = false;
+	if (output_format == OUTPUT_FORMAT_BC6H) {
+		RenderingServer *rs = RenderingServer::get_singleton();
+		output_bc6h_supported = rs != nullptr && rs->has_os_feature("bptc");
+	}
 
 	// Gather geometry and lights from scene
+	_LM_StageTimer gather_timer(bake_stats.stage_usec[BAKE_STAGE_GATHER]);
+	gathered_mesh_cache.clear();
 	_find_meshes_and_lights(p_from_node, gathered_meshes, gathered_lights);
+	gathered_mesh_cache.clear();
 
 	if (gathered_meshes.empty()) {
 		UtilityFunctions::push_error("No meshes with lightmap UV2 found in scene");
@@ -829,21 +2145,65 @@ LightmapBaker::BakeError LightmapBaker::bake_with_progress(Node *p_from_node, Re
 		return BAKE_ERROR_MESHES_INVALID;
 	}
 
+	return BAKE_ERROR_OK;
+}
+
+LightmapBaker::BakeError LightmapBaker::_run_bake(BakeProgressFunc p_progress_func, void *p_userdata) {
 	_report_progress(0.1f, "Baking direct lighting...", p_progress_func, p_userdata);
 
 	// Phase 1: Direct lighting
-	BakeError error = _bake_direct_light(p_output_data, p_progress_func, p_userdata);
+	BakeError error = _bake_direct_light(p_progress_func, p_userdata);
+	_clear_shadow_maps();
+	_clear_light_sample_grid();
+	_clear_bake_geometry();
 	if (error != BAKE_ERROR_OK) {
-		return error;
+		baked_layers.clear();
+		_clear_spilled_layers();
 	}
+	return error;
+}
 
-	_report_progress(0.9f, "Finalizing lightmaps...", p_progress_func, p_userdata);
+LightmapBaker::BakeError LightmapBaker::_finish_bake(Ref<LightmapGIData> p_output_data) {
+	Ref<Texture2DArray> tex_array;
+	{
+		_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_TEXTURE_CREATION]);
+		// Out-of-core bakes leave their layers on disk.
+		for (size_t i = 0; i < spilled_layers.size(); i++) {
+			if (spilled_layers[i].is_empty()) {
+				continue;
+			}
+			Ref<Image> layer = _load_spilled_layer(spilled_layers[i]);
+			if (layer.is_null() || layer->is_empty()) {
+				UtilityFunctions::push_error("LightmapBaker: can't read spilled atlas layer " + spilled_layers[i]);
+				baked_layers.clear();
+				_clear_spilled_layers();
+				return BAKE_ERROR_CANT_CREATE_IMAGE;
+			}
+			baked_layers.set((int64_t)i, layer);
+		}
+		_clear_spilled_layers();
 
-	_report_progress(1.0f, "Bake complete!", p_progress_func, p_userdata);
+		tex_array = _create_texture_array_from_images(baked_layers);
+		bake_stats.slice_count = (int)baked_layers.size();
+		baked_layers.clear();
+	}
+	if (tex_array.is_null()) {
+		UtilityFunctions::push_error("Failed to create Texture2DArray from atlas layers");
+		return BAKE_ERROR_CANT_CREATE_IMAGE;
+	}
 
+	_write_output_data(p_output_data, tex_array);
+
+	if (ray_bvh) {
+		bake_stats.rays_cast = ray_bvh->rays_cast.load();
+		bake_stats.triangles_tested = ray_bvh->triangles_tested.load();
+	}
+	bake_stats.atlas_occupancy = atlas_occupancy;
+	last_bake_stats = bake_stats;
 	return BAKE_ERROR_OK;
 }
 
+
 void LightmapBaker::_find_meshes_and_lights(Node *p_at_node, std::vector<MeshData> &r_meshes, std::vector<LightData> &r_lights) {
 	if (p_at_node == nullptr) {
 		return;
@@ -867,57 +2227,79 @@ void LightmapBaker::_find_meshes_and_lights(Node *p_at_node, std::vector<MeshDat
 	}
 }
 
-void LightmapBaker::_process_mesh_instance(MeshInstance3D *p_mesh, std::vector<MeshData> &r_meshes) {
-	if ((p_mesh->get_layer_mask() & mesh_layer_mask) == 0) {
+void LightmapBaker::_collect_meshes_to_unwrap(Node *p_at_node, std::vector<MeshInstance3D *> &r_instances, std::unordered_map<uint64_t, bool> &r_has_uv2) {
+	if (p_at_node == nullptr) {
 		return;
 	}
 
-	Ref<Mesh> mesh = p_mesh->get_mesh();
-	if (mesh.is_null()) {
+	// Same filtering as _find_meshes_and_lights(), so only meshes that will be baked are unwrapped.
+	MeshInstance3D *mesh_instance = Object::cast_to<MeshInstance3D>(p_at_node);
+	if (mesh_instance != nullptr && mesh_instance->is_visible_in_tree() && (mesh_instance->get_layer_mask() & mesh_layer_mask) != 0) {
+		Ref<Mesh> mesh = mesh_instance->get_mesh();
+		if (mesh.is_valid()) {
+			// Instances sharing a mesh only read its arrays once.
+			auto it = r_has_uv2.find(mesh->get_rid().get_id());
+			if (it == r_has_uv2.end()) {
+				it = r_has_uv2.emplace(mesh->get_rid().get_id(), _lm_mesh_has_uv2(mesh)).first;
+			}
+			if (!it->second) {
+				r_instances.push_back(mesh_instance);
+			}
+		}
+	}
+
+	for (int i = 0; i < p_at_node->get_child_count(); i++) {
+		_collect_meshes_to_unwrap(p_at_node->get_child(i), r_instances, r_has_uv2);
+	}
+}
+
+void LightmapBaker::_auto_unwrap_meshes(Node *p_from_node) {
+	std::vector<MeshInstance3D *> instances;
+	std::unordered_map<uint64_t, bool> has_uv2;
+	_collect_meshes_to_unwrap(p_from_node, instances, has_uv2);
+	if (instances.empty()) {
 		return;
 	}
 
-	// Check if mesh has UV2 (required for lightmapping)
-	auto mesh_has_uv2 = [&]() {
-		for (int i = 0; i < mesh->get_surface_count(); i++) {
-			Array arrays = mesh->surface_get_arrays(i);
-			if (arrays.is_empty()) {
-				continue;
-			}
-			PackedVector2Array uv2 = arrays[Mesh::ARRAY_TEX_UV2];
-			if (!uv2.is_empty()) {
-				return true;
-			}
+	// NOTE: This modifies the mesh resources in-place.
+	// For most runtime chunk meshes that's desired; if you share a mesh across instances,
+	// it will gain UV2 everywhere.
+	Array meshes;
+	std::vector<MeshInstance3D *> owners;
+	for (MeshInstance3D *instance : instances) {
+		Ref<ArrayMesh> array_mesh = instance->get_mesh();
+		if (array_mesh.is_null()) {
+			UtilityFunctions::push_warning("LightmapBaker: auto_unwrap_uv2 is enabled but mesh '" + instance->get_name() + "' is not an ArrayMesh; skipping");
+			continue;
 		}
-		return false;
-	};
+		meshes.push_back(array_mesh);
+		owners.push_back(instance);
+	}
+	if (meshes.is_empty()) {
+		return;
+	}
 
-	bool has_uv2 = mesh_has_uv2();
-	if (!has_uv2 && auto_unwrap_uv2) {
-		Ref<ArrayMesh> array_mesh = mesh;
-		if (array_mesh.is_valid()) {
-			// NOTE: This modifies the mesh resource in-place.
-			// For most runtime chunk meshes that's desired; if you share a mesh across instances,
-			// it will gain UV2 everywhere.
-			const int err = LightmapBaker::lightmap_unwrap(array_mesh, Transform3D(), 0.0f);
-			if (err != OK) {
-				UtilityFunctions::push_warning("LightmapBaker: auto_unwrap_uv2 failed for mesh '" + p_mesh->get_name() + "' (err=" + String::num_int64(err) + ")");
-			} else {
-				has_uv2 = mesh_has_uv2();
-			}
-		} else {
-			UtilityFunctions::push_warning("LightmapBaker: auto_unwrap_uv2 is enabled but mesh '" + p_mesh->get_name() + "' is not an ArrayMesh; skipping");
+	// Unlike the static entry point, a bake's unwrap honors thread_count.
+	const PackedInt32Array errors = _unwrap_many(meshes, 0.0f, _get_worker_thread_count());
+	for (int i = 0; i < errors.size(); i++) {
+		if (errors[i] != OK) {
+			UtilityFunctions::push_warning("LightmapBaker: auto_unwrap_uv2 failed for mesh '" + owners[(size_t)i]->get_name() + "' (err=" + String::num_int64(errors[i]) + ")");
 		}
 	}
+}
 
-	if (!has_uv2) {
-		// Not an error; we intentionally skip meshes that can't be baked.
-		return;
+const LightmapBaker::GatheredMesh &LightmapBaker::_gather_mesh(const Ref<Mesh> &p_mesh) {
+	const uint64_t key = p_mesh->get_rid().get_id();
+	auto it = gathered_mesh_cache.find(key);
+	if (it != gathered_mesh_cache.end()) {
+		return it->second;
 	}
 
-	// Extract mesh data
-	for (int surface_idx = 0; surface_idx < mesh->get_surface_count(); surface_idx++) {
-		Array arrays = mesh->surface_get_arrays(surface_idx);
+	// Each surface's arrays are fetched once; a mesh has UV2 when any of its surfaces does.
+	GatheredMesh gathered;
+	gathered.lightmap_size_hint = p_mesh->get_lightmap_size_hint();
+	for (int surface_idx = 0; surface_idx < p_mesh->get_surface_count(); surface_idx++) {
+		Array arrays = p_mesh->surface_get_arrays(surface_idx);
 		if (arrays.is_empty()) {
 			continue;
 		}
@@ -926,24 +2308,62 @@ void LightmapBaker::_process_mesh_instance(MeshInstance3D *p_mesh, std::vector<M
 			continue;
 		}
 
+		GatheredSurface surface;
+		surface.surface_idx = surface_idx;
+		surface.vertices = arrays[Mesh::ARRAY_VERTEX];
+		surface.normals = arrays[Mesh::ARRAY_NORMAL];
+		surface.uv2s = uv2s;
+		surface.indices = arrays[Mesh::ARRAY_INDEX];
+		surface.material = p_mesh->surface_get_material(surface_idx);
+		gathered.surfaces.push_back(surface);
+	}
+	return gathered_mesh_cache.emplace(key, std::move(gathered)).first->second;
+}
+
+void LightmapBaker::_process_mesh_instance(MeshInstance3D *p_mesh, std::vector<MeshData> &r_meshes) {
+	if ((p_mesh->get_layer_mask() & mesh_layer_mask) == 0) {
+		return;
+	}
+
+	Ref<Mesh> mesh = p_mesh->get_mesh();
+	if (mesh.is_null()) {
+		return;
+	}
+
+	// Surfaces without UV2 (required for lightmapping) are left out of the gathered mesh. With
+	// auto_unwrap_uv2, _auto_unwrap_meshes() has already given UV2 to every mesh it could.
+	const GatheredMesh &gathered = _gather_mesh(mesh);
+	if (gathered.surfaces.empty()) {
+		// Not an error; we intentionally skip meshes that can't be baked.
+		return;
+	}
+
+	// Packed arrays are copy-on-write, so instances share the cached surface data.
+	const Transform3D transform = p_mesh->get_global_transform();
+	for (const GatheredSurface &surface : gathered.surfaces) {
 		MeshData mesh_data;
-		mesh_data.vertices = arrays[Mesh::ARRAY_VERTEX];
-		mesh_data.normals = arrays[Mesh::ARRAY_NORMAL];
-		mesh_data.uv2s = uv2s;
-		mesh_data.indices = arrays[Mesh::ARRAY_INDEX];
-		mesh_data.transform = p_mesh->get_global_transform();
+		mesh_data.vertices = surface.vertices;
+		mesh_data.normals = surface.normals;
+		mesh_data.uv2s = surface.uv2s;
+		mesh_data.indices = surface.indices;
+		mesh_data.transform = transform;
 		mesh_data.owner_node = p_mesh;
-		mesh_data.sub_instance = surface_idx;
-		mesh_data.lightmap_size_hint = mesh->get_lightmap_size_hint();
-		mesh_data.lightmap_slice = 0; // TODO: Handle multiple slices
+		mesh_data.sub_instance = surface.surface_idx;
+		mesh_data.lightmap_size_hint = gathered.lightmap_size_hint;
+		mesh_data.lightmap_importance = (float)p_mesh->get_meta("lightmap_importance", 1.0);
+		mesh_data.lightmap_slice = 0;
 		mesh_data.lightmap_uv_scale = Rect2(Vector2(0, 0), Vector2(1, 1));
 
 		// Get material for albedo
-		Ref<Material> mat = p_mesh->get_surface_override_material(surface_idx);
+		Ref<Material> mat = p_mesh->get_surface_override_material(surface.surface_idx);
 		if (mat.is_null()) {
-			mat = mesh->surface_get_material(surface_idx);
+			mat = surface.material;
 		}
 		mesh_data.material = mat;
+		// Read here on the main thread; the bake itself may run on a worker thread.
+		if (BaseMaterial3D *bm = Object::cast_to<BaseMaterial3D>(mat.ptr())) {
+			mesh_data.albedo = bm->get_albedo();
+		}
 
 		r_meshes.push_back(mesh_data);
 	}
@@ -960,6 +2380,7 @@ void LightmapBaker::_process_light(Light3D *p_light, std::vector<LightData> &r_l
 	light_data.position = p_light->get_global_transform().origin;
 	light_data.name = p_light->get_name();
 	light_data.cast_shadow = p_light->has_shadow();
+	light_data.use_shadow_map = (int)p_light->get_meta("lightmap_shadow_mode", (int)shadow_mode) == SHADOW_MODE_SHADOW_MAP;
 
 	// Type-specific properties
 	DirectionalLight3D *dir_light = Object::cast_to<DirectionalLight3D>(p_light);
@@ -967,6 +2388,8 @@ void LightmapBaker::_process_light(Light3D *p_light, std::vector<LightData> &r_l
 		light_data.type = 0; // LIGHT_TYPE_DIRECTIONAL
 		light_data.direction = -dir_light->get_global_transform().basis.get_column(Vector3::AXIS_Z).normalized();
 		light_data.range = 1000000.0f; // Infinite
+		// PARAM_SIZE is the angular diameter in degrees here.
+		light_data.size = Math::tan(Math::deg_to_rad((float)dir_light->get_param(Light3D::PARAM_SIZE) * 0.5f));
 		r_lights.push_back(light_data);
 		return;
 	}
@@ -976,6 +2399,7 @@ void LightmapBaker::_process_light(Light3D *p_light, std::vector<LightData> &r_l
 		light_data.type = 1; // LIGHT_TYPE_OMNI
 		light_data.range = omni_light->get_param(Light3D::PARAM_RANGE);
 		light_data.attenuation = omni_light->get_param(Light3D::PARAM_ATTENUATION);
+		light_data.size = omni_light->get_param(Light3D::PARAM_SIZE);
 		r_lights.push_back(light_data);
 		return;
 	}
@@ -986,6 +2410,7 @@ void LightmapBaker::_process_light(Light3D *p_light, std::vector<LightData> &r_l
 		light_data.direction = -spot_light->get_global_transform().basis.get_column(Vector3::AXIS_Z).normalized();
 		light_data.range = spot_light->get_param(Light3D::PARAM_RANGE);
 		light_data.attenuation = spot_light->get_param(Light3D::PARAM_ATTENUATION);
+		light_data.size = spot_light->get_param(Light3D::PARAM_SIZE);
 		float spot_angle = spot_light->get_param(Light3D::PARAM_SPOT_ANGLE);
 		light_data.cos_spot_angle = Math::cos(Math::deg_to_rad(spot_angle));
 		light_data.inv_spot_attenuation = 1.0f / spot_light->get_param(Light3D::PARAM_SPOT_ATTENUATION);
@@ -1012,8 +2437,138 @@ bool LightmapBaker::_validate_meshes(const std::vector<MeshData> &p_meshes) {
 	return true;
 }
 
+// Rows per direct-lighting raster job.
+static constexpr int LM_RASTER_BAND_ROWS = 16;
+
+static int64_t _lm_lightmap_memory(const std::vector<LightmapBuffer> &p_lightmaps) {
+	int64_t bytes = 0;
+	for (const LightmapBuffer &buf : p_lightmaps) {
+		bytes += (int64_t)(buf.color.capacity() * sizeof(float) + buf.coverage.capacity() * sizeof(uint64_t));
+	}
+	return bytes;
+}
+
+static int64_t _lm_guide_memory(const std::vector<LightmapGuide> &p_guides) {
+	int64_t bytes = 0;
+	for (const LightmapGuide &guide : p_guides) {
+		bytes += (int64_t)((guide.position.capacity() + guide.normal.capacity()) * sizeof(Vector3));
+	}
+	return bytes;
+}
+
+// Out-of-core bakes (max_memory_mb > 0): estimated bytes per full-resolution tile texel (color and
+// coverage, plus guides and the filter buffer when denoising) and per texel of the reduced
+// indirect proxies (color, guide, direct snapshot and the two bounce buffers).
+static constexpr int64_t LM_STREAM_TEXEL_BYTES = 16;
+static constexpr int64_t LM_STREAM_DENOISE_TEXEL_BYTES = 36;
+static constexpr int64_t LM_STREAM_PROXY_TEXEL_BYTES = 72;
+static constexpr int LM_STREAM_MAX_PROXY_FACTOR = 16;
+static constexpr uint32_t LM_STREAM_SPILL_MAGIC = 0x4c534d4c; // "LMSL"
+static const char *LM_STREAM_SPILL_DIR = "user://lightmap_bake_spill";
+// Surfaces with more lights than this after per-surface culling are culled again per triangle.
+static constexpr size_t LM_LIGHT_CULL_TRIANGLE_MIN_LIGHTS = 4;
+
+// World-space area of a surface and the fraction of the UV2 square its triangles cover.
+static void _lm_surface_areas(const Vector3 *p_positions, const Vector2 *p_uv2s, const uint32_t *p_indices, uint32_t p_triangle_begin, uint32_t p_triangle_end, double &r_world_area, double &r_uv2_area) {
+	r_world_area = 0.0;
+	r_uv2_area = 0.0;
+	for (uint32_t t = p_triangle_begin; t < p_triangle_end; t++) {
+		const uint32_t *corners = &p_indices[(size_t)t * 3];
+		const Vector3 v0 = p_positions[corners[0]];
+		const Vector2 uv0 = p_uv2s[corners[0]];
+		r_world_area += 0.5 * (double)(p_positions[corners[1]] - v0).cross(p_positions[corners[2]] - v0).length();
+		r_uv2_area += 0.5 * (double)Math::abs((p_uv2s[corners[1]] - uv0).cross(p_uv2s[corners[2]] - uv0));
+	}
+}
+
+void LightmapBaker::_compute_lightmap_sizes(int p_atlas_size, int p_padding, std::vector<Vector2i> &r_sizes) {
+	const size_t surface_count = gathered_meshes.size();
+	r_sizes.assign(surface_count, Vector2i());
+	if (texel_budget_mb <= 0) {
+		for (size_t i = 0; i < surface_count; i++) {
+			Vector2i hint = gathered_meshes[i].lightmap_size_hint;
+			int w = hint.x > 0 ? hint.x : p_atlas_size;
+			int h = hint.y > 0 ? hint.y : p_atlas_size;
+			w = std::clamp((int)Math::round((float)w * texel_scale), 32, p_atlas_size);
+			h = std::clamp((int)Math::round((float)h * texel_scale), 32, p_atlas_size);
+			r_sizes[i] = Vector2i(w, h);
+		}
+		return;
+	}
+
+	// Every surface gets the same texel density over its world-space area, times its importance.
+	// A surface's charts only cover part of its UV2 square, so its lightmap is enlarged by the
+	// uncovered fraction. Hints only keep their aspect ratio.
+	std::vector<double> weights(surface_count, 0.0);
+	std::vector<double> aspects(surface_count, 1.0);
+	_lm_parallel_for((int)surface_count, _get_worker_thread_count(), [&](int p_index) {
+		const MeshData &md = gathered_meshes[(size_t)p_index];
+		double world_area = 0.0;
+		double uv2_area = 0.0;
+		_lm_surface_areas(bake_geometry.positions.data(), bake_geometry.uv2s.data(), bake_geometry.indices.data(), bake_geometry.surface_first_triangle[(size_t)p_index], bake_geometry.surface_first_triangle[(size_t)p_index + 1], world_area, uv2_area);
+		weights[(size_t)p_index] = world_area * (double)std::max(0.0f, md.lightmap_importance) / std::clamp(uv2_area, 0.05, 1.0);
+		if (md.lightmap_size_hint.x > 0 && md.lightmap_size_hint.y > 0) {
+			aspects[(size_t)p_index] = (double)md.lightmap_size_hint.x / (double)md.lightmap_size_hint.y;
+		}
+	});
+
+	// Budget in texels of the output format. Padding and atlas packing come on top of it.
+	double texel_bytes = output_format == OUTPUT_FORMAT_RGBE9995 ? 4.0 : 6.0;
+	if (output_format == OUTPUT_FORMAT_BC6H && output_bc6h_supported) {
+		texel_bytes = 1.0;
+	}
+	const double budget = (double)texel_budget_mb * 1048576.0 / texel_bytes;
+	// Solved sizes must still fit an atlas slice with padding on both sides.
+	const int max_side = std::max(32, p_atlas_size - 2 * p_padding);
+
+	auto solve = [&](double p_density, std::vector<Vector2i> *r_solved) {
+		double total = 0.0;
+		for (size_t i = 0; i < surface_count; i++) {
+			const double texels = p_density * weights[i];
+			const int w = std::clamp((int)Math::round(Math::sqrt(texels * aspects[i])), 32, max_side);
+			const int h = std::clamp((int)Math::round(Math::sqrt(texels / aspects[i])), 32, max_side);
+			total += (double)w * (double)h;
+			if (r_solved != nullptr) {
+				(*r_solved)[i] = Vector2i(w, h);
+			}
+		}
+		return total;
+	};
+
+	// The texel total only grows with the density, so bisect for the largest density that fits.
+	double weight_sum = 0.0;
+	for (double weight : weights) {
+		weight_sum += weight;
+	}
+	double low = 0.0;
+	double high = weight_sum > 0.0 ? budget / weight_sum : 1.0;
+	const double max_total = (double)surface_count * (double)max_side * (double)max_side;
+	for (int i = 0; i < 64; i++) {
+		const double total = solve(high, nullptr);
+		if (total > budget || total >= max_total) {
+			break;
+		}
+		low = high;
+		high *= 2.0;
+	}
+	for (int i = 0; i < 48; i++) {
+		const double mid = (low + high) * 0.5;
+		if (solve(mid, nullptr) <= budget) {
+			low = mid;
+		} else {
+			high = mid;
+		}
+	}
+	const double total = solve(low, &r_sizes);
+	if (total > budget) {
+		UtilityFunctions::push_warning("LightmapBaker: texel_budget_mb is too small for " + String::num_int64((int64_t)surface_count) + " surfaces at the minimum lightmap size of 32x32");
+	}
+}
+
 // Baking stages (Phase 1 - basic implementation)
-LightmapBaker::BakeError LightmapBaker::_bake_direct_light(Ref<LightmapGIData> p_output_data, BakeProgressFunc p_progress, void *p_userdata) {
+LightmapBaker::BakeError LightmapBaker::_bake_direct_light(BakeProgressFunc p_progress, void *p_userdata) {
+	baked_layers.clear();
+	_clear_spilled_layers();
 	if (gathered_meshes.empty()) {
 		return BAKE_ERROR_NO_MESHES;
 	}
@@ -1034,750 +2589,3652 @@ LightmapBaker::BakeError LightmapBaker::_bake_direct_light(Ref<LightmapGIData> p
 	}
 	const int padding = std::max(0, atlas_padding);
 
-	_report_progress(0.15f, "Building ray meshes for shadowing...", p_progress, p_userdata);
+	_report_progress(0.15f, "Building shadow ray BVH...", p_progress, p_userdata);
+	_build_bake_geometry();
 	_build_ray_meshes();
+	if (_is_bake_aborted()) {
+		return BAKE_ERROR_USER_ABORTED;
+	}
 
-	// Bake per-mesh (per-surface) lightmaps first.
-	Vector<Ref<Image>> mesh_lightmaps;
-	mesh_lightmaps.resize((int)gathered_meshes.size());
+	std::vector<Vector2i> lightmap_sizes;
+	_compute_lightmap_sizes(atlas_size, padding, lightmap_sizes);
+
+	// Per-surface light lists: omni/spot lights whose range (and cone) can't reach a surface's
+	// world bounds are skipped for all of its texels.
+	std::vector<uint32_t> all_lights;
+	all_lights.reserve(gathered_lights.size());
+	for (size_t i = 0; i < gathered_lights.size(); i++) {
+		all_lights.push_back((uint32_t)i);
+	}
+	std::vector<std::vector<uint32_t>> mesh_lights;
+	mesh_lights.resize(gathered_meshes.size());
+	{
+		_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_DIRECT]);
+		_lm_parallel_for((int)gathered_meshes.size(), _get_worker_thread_count(), [&](int p_index) {
+			MeshData &md = gathered_meshes[(size_t)p_index];
+			const uint32_t first = bake_geometry.surface_first_vertex[(size_t)p_index];
+			const uint32_t end = bake_geometry.surface_first_vertex[(size_t)p_index + 1];
+			if (first == end) {
+				return;
+			}
+			Vector3 aabb_min = bake_geometry.positions[first];
+			Vector3 aabb_max = aabb_min;
+			for (uint32_t v = first + 1; v < end; v++) {
+				const Vector3 &p = bake_geometry.positions[v];
+				aabb_min = Vector3(Math::min(aabb_min.x, p.x), Math::min(aabb_min.y, p.y), Math::min(aabb_min.z, p.z));
+				aabb_max = Vector3(Math::max(aabb_max.x, p.x), Math::max(aabb_max.y, p.y), Math::max(aabb_max.z, p.z));
+			}
+			md.world_aabb_min = aabb_min;
+			md.world_aabb_max = aabb_max;
+			_cull_lights(aabb_min, aabb_max, all_lights, mesh_lights[(size_t)p_index]);
+		});
+	}
+
+	{
+		_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_DIRECT]);
+		_build_shadow_maps();
+		_build_light_sample_grid();
+	}
+	if (_is_bake_aborted()) {
+		return BAKE_ERROR_USER_ABORTED;
+	}
 
-	for (int i = 0; i < (int)gathered_meshes.size(); i++) {
-		float t = (gathered_meshes.size() <= 1) ? 0.0f : (float)i / (float)(gathered_meshes.size() - 1);
-		_report_progress(0.2f + 0.35f * t, "Rasterizing UV2 and evaluating lights...", p_progress, p_userdata);
+	if (max_memory_mb > 0) {
+		return _bake_streaming(lightmap_sizes, mesh_lights, atlas_size, padding, p_progress, p_userdata);
+	}
 
-		Vector2i hint = gathered_meshes[(size_t)i].lightmap_size_hint;
-		int w = hint.x > 0 ? hint.x : atlas_size;
-		int h = hint.y > 0 ? hint.y : atlas_size;
-		w = std::clamp((int)Math::round((float)w * texel_scale), 32, atlas_size);
-		h = std::clamp((int)Math::round((float)h * texel_scale), 32, atlas_size);
+	// Bake per-mesh (per-surface) lightmaps first.
+	std::vector<LightmapBuffer> mesh_lightmaps;
+	mesh_lightmaps.resize(gathered_meshes.size());
+	// Texel positions/normals are only needed when indirect rays are shot from the texels or the
+	// denoiser needs them as edge-stopping guides.
+	std::vector<LightmapGuide> mesh_guides;
+	if (bounces > 0 || use_denoiser) {
+		mesh_guides.resize(gathered_meshes.size());
+	}
 
-		Ref<Image> img = _create_lightmap_image(w, h);
-		if (img.is_null()) {
+	for (size_t i = 0; i < gathered_meshes.size(); i++) {
+		const int w = lightmap_sizes[i].x;
+		const int h = lightmap_sizes[i].y;
+		// Coverage starts cleared: empty texels (outside UV2 islands) are filled by dilation later.
+		if (!mesh_lightmaps[i].create(w, h)) {
+			UtilityFunctions::push_error("LightmapBaker: failed to allocate lightmap buffer (" + String::num_int64(w) + "x" + String::num_int64(h) + ")");
 			return BAKE_ERROR_CANT_CREATE_IMAGE;
 		}
+		if (!mesh_guides.empty()) {
+			mesh_guides[i].create(w, h);
+		}
+	}
+	_track_bake_memory(_lm_lightmap_memory(mesh_lightmaps) + _lm_guide_memory(mesh_guides));
+
+	// Incremental rebake: surfaces whose inputs hash the same as in the previous bake reuse its
+	// direct lighting. Hits are moved out of the cache; once the surfaces are rasterized the cache
+	// is replaced by one built from this bake's surfaces, so entries of surfaces that changed or
+	// left the scene are dropped. An aborted bake moves the hits back and keeps the old cache.
+	std::vector<uint64_t> surface_hashes;
+	std::vector<uint8_t> surface_cached(gathered_meshes.size(), 0);
+	if (use_bake_cache) {
+		_compute_surface_bake_hashes(mesh_lights, mesh_lightmaps, surface_hashes);
+		for (size_t i = 0; i < gathered_meshes.size(); i++) {
+			auto it = bake_cache.find(surface_hashes[i]);
+			// An empty lightmap was already moved to an identical surface earlier in the list.
+			if (it == bake_cache.end() || it->second.lightmap.is_empty() || (!mesh_guides.empty() && it->second.guide.position.empty())) {
+				continue;
+			}
+			mesh_lightmaps[i] = std::move(it->second.lightmap);
+			if (!mesh_guides.empty()) {
+				mesh_guides[i] = std::move(it->second.guide);
+			}
+			it->second = BakeCacheEntry();
+			surface_cached[i] = 1;
+		}
+	}
+	// Entries that weren't hits stay alive until the new cache replaces them.
+	const int64_t old_cache_memory = _get_bake_cache_memory();
+	_track_bake_memory(old_cache_memory);
+
+	std::vector<int> raster_surfaces;
+	for (size_t i = 0; i < mesh_lightmaps.size(); i++) {
+		if (!surface_cached[i]) {
+			raster_surfaces.push_back((int)i);
+		}
+	}
+	_rasterize_surfaces(raster_surfaces, mesh_lights, mesh_lightmaps, mesh_guides.empty() ? nullptr : &mesh_guides, 0.2f, 0.55f, p_progress, p_userdata);
+	if (_is_bake_aborted()) {
+		for (size_t i = 0; i < gathered_meshes.size(); i++) {
+			if (surface_cached[i]) {
+				BakeCacheEntry &entry = bake_cache[surface_hashes[i]];
+				entry.lightmap = std::move(mesh_lightmaps[i]);
+				if (!mesh_guides.empty()) {
+					entry.guide = std::move(mesh_guides[i]);
+				}
+			}
+		}
+		return BAKE_ERROR_USER_ABORTED;
+	}
 
-		// Alpha is used as a coverage mask: 0=empty texel (outside UV2 islands), 1=valid.
-		img->fill(Color(0, 0, 0, 0));
-		_rasterize_mesh_direct_lighting(gathered_meshes[(size_t)i], img);
-		mesh_lightmaps.set(i, img);
+	if (use_bake_cache) {
+		std::unordered_map<uint64_t, BakeCacheEntry> new_cache;
+		new_cache.reserve(gathered_meshes.size());
+		for (size_t i = 0; i < gathered_meshes.size(); i++) {
+			BakeCacheEntry &entry = new_cache[surface_hashes[i]];
+			entry.lightmap = mesh_lightmaps[i];
+			if (!mesh_guides.empty()) {
+				entry.guide = mesh_guides[i];
+			}
+		}
+		bake_cache.swap(new_cache);
+	} else {
+		bake_cache.clear();
 	}
+	bake_stats.bake_cache_memory = _get_bake_cache_memory();
+	_track_bake_memory(bake_stats.bake_cache_memory - old_cache_memory);
 
+	// Only placements are computed here; atlas pixels are written once, after all post-processing.
 	_report_progress(0.6f, "Packing lightmaps into atlases...", p_progress, p_userdata);
-	Vector<Ref<Image>> atlas_layers = _pack_lightmaps_to_atlas(gathered_meshes, mesh_lightmaps, atlas_size, padding);
-	if (atlas_layers.is_empty()) {
+	const int slice_count = _pack_lightmaps_to_atlas(gathered_meshes, mesh_lightmaps, atlas_size, padding);
+	if (slice_count <= 0) {
 		return BAKE_ERROR_ATLAS_TOO_SMALL;
 	}
 
 	// Phase 2: Indirect lighting (bounces) — modifies mesh_lightmaps in place
 	if (bounces > 0) {
 		_report_progress(0.65f, "Baking indirect lighting...", p_progress, p_userdata);
-		BakeError error = _bake_indirect_light(mesh_lightmaps, p_progress, p_userdata);
+		BakeError error = _bake_indirect_light(mesh_lightmaps, mesh_guides, p_progress, p_userdata);
+		if (error == BAKE_ERROR_USER_ABORTED) {
+			return error;
+		}
 		if (error != BAKE_ERROR_OK) {
 			UtilityFunctions::push_warning("Indirect pass failed, using direct lighting only");
 		}
 	}
 
-	_report_progress(0.75f, "Dilating seams...", p_progress, p_userdata);
-	_dilate_lightmaps(mesh_lightmaps, std::max(0, seam_dilation_radius));
-
-	// Update atlas pixel data in-place (layout/UV scale doesn't change with bounces/dilation).
-	_report_progress(0.8f, "Updating atlas layers...", p_progress, p_userdata);
-	for (int i = 0; i < mesh_lightmaps.size() && i < (int)gathered_meshes.size(); i++) {
-		Ref<Image> src = mesh_lightmaps[i];
-		if (src.is_null() || src->is_empty()) {
-			continue;
-		}
-		const MeshData &md = gathered_meshes[(size_t)i];
-		if (md.lightmap_slice < 0 || md.lightmap_slice >= atlas_layers.size()) {
-			continue;
-		}
-		Ref<Image> dst = atlas_layers[md.lightmap_slice];
-		if (dst.is_null() || dst->is_empty()) {
-			continue;
+	if (use_denoiser) {
+		_report_progress(0.75f, "Denoising lightmaps...", p_progress, p_userdata);
+		_denoise_lightmaps(mesh_lightmaps, mesh_guides, p_progress, p_userdata);
+		if (_is_bake_aborted()) {
+			return BAKE_ERROR_USER_ABORTED;
 		}
+	}
+	_track_bake_memory(-_lm_guide_memory(mesh_guides));
+	mesh_guides.clear();
 
-		Vector2 uv_offset = md.lightmap_uv_scale.position;
-		Vector2i pos(
-				(int)Math::round(uv_offset.x * (float)dst->get_width()),
-				(int)Math::round(uv_offset.y * (float)dst->get_height()));
-
-		if (pos.x < 0 || pos.y < 0 || pos.x + src->get_width() > dst->get_width() || pos.y + src->get_height() > dst->get_height()) {
-			UtilityFunctions::push_warning("LightmapBaker: atlas blit out of bounds for surface index " + String::num_int64(i));
-			continue;
-		}
+	_report_progress(0.78f, "Dilating seams...", p_progress, p_userdata);
+	_dilate_lightmaps(mesh_lightmaps, seam_dilation_fill ? -1 : std::max(0, seam_dilation_radius));
 
-		dst->blit_rect(src, Rect2i(Vector2i(0, 0), src->get_size()), pos);
+	if (_is_bake_aborted()) {
+		return BAKE_ERROR_USER_ABORTED;
 	}
 
-	// Validate atlas layers before texture creation.
-	if (atlas_layers.is_empty()) {
+	_report_progress(0.8f, "Writing atlas layers...", p_progress, p_userdata);
+	// The Texture2DArray and LightmapGIData are only touched by _finish_bake(), on the main thread.
+	baked_layers = _create_atlas_layers(gathered_meshes, mesh_lightmaps, atlas_size, slice_count);
+	_track_bake_memory(-_lm_lightmap_memory(mesh_lightmaps));
+	mesh_lightmaps.clear();
+	if (baked_layers.is_empty()) {
 		UtilityFunctions::push_error("LightmapBaker: atlas_layers is empty");
 		return BAKE_ERROR_CANT_CREATE_IMAGE;
 	}
-	bool has_valid_atlas = false;
-	for (int i = 0; i < atlas_layers.size(); i++) {
-		if (!atlas_layers[i].is_null() && !atlas_layers[i]->is_empty()) {
-			has_valid_atlas = true;
-			break;
+	return BAKE_ERROR_OK;
+}
+
+void LightmapBaker::_rasterize_surfaces(const std::vector<int> &p_surfaces, const std::vector<std::vector<uint32_t>> &p_mesh_lights, std::vector<LightmapBuffer> &p_lightmaps, std::vector<LightmapGuide> *p_guides, float p_progress_from, float p_progress_to, BakeProgressFunc p_progress, void *p_userdata) {
+	_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_DIRECT]);
+	// Split every surface into bands of rows so large surfaces spread across threads as well.
+	// Each band owns disjoint rows and walks triangles in index order, so the result does not
+	// depend on the thread count.
+	struct RasterJob {
+		int mesh = 0;
+		int row_begin = 0;
+		int row_end = 0;
+	};
+	std::vector<RasterJob> raster_jobs;
+	for (int i : p_surfaces) {
+		const int h = p_lightmaps[(size_t)i].height;
+		for (int y = 0; y < h; y += LM_RASTER_BAND_ROWS) {
+			raster_jobs.push_back(RasterJob{ i, y, std::min(h, y + LM_RASTER_BAND_ROWS) });
 		}
 	}
-	if (!has_valid_atlas) {
-		UtilityFunctions::push_error("LightmapBaker: atlas_layers are all null/empty");
-		return BAKE_ERROR_CANT_CREATE_IMAGE;
-	}
 
-	_report_progress(0.85f, "Creating Texture2DArray...", p_progress, p_userdata);
-	// Drop the alpha coverage mask before uploading (kept only for dilation during baking).
-	for (int i = 0; i < atlas_layers.size(); i++) {
-		if (atlas_layers[i].is_null() || atlas_layers[i]->is_empty()) {
-			continue;
-		}
-		if (atlas_layers[i]->get_format() != Image::FORMAT_RGBH) {
-			atlas_layers[i]->convert(Image::FORMAT_RGBH);
+	// Adaptive supersampling records each texel's triangle and light visibility in the first pass,
+	// then re-shades only the texels on edges once every band is done.
+	const bool supersample = supersample_count > 0;
+	std::vector<LightmapEdgeInfo> edges;
+	int64_t edge_memory = 0;
+	if (supersample) {
+		edges.resize(p_lightmaps.size());
+		for (int i : p_surfaces) {
+			const LightmapBuffer &lightmap = p_lightmaps[(size_t)i];
+			edges[(size_t)i].create(lightmap.width, lightmap.height);
+			edge_memory += (int64_t)lightmap.width * lightmap.height * (int64_t)(sizeof(int32_t) + sizeof(uint32_t));
 		}
+		_track_bake_memory(edge_memory);
 	}
-	Ref<Texture2DArray> tex_array = _create_texture_array_from_images(atlas_layers);
-	if (tex_array.is_null()) {
-		UtilityFunctions::push_error("Failed to create Texture2DArray from atlas layers");
-		return BAKE_ERROR_CANT_CREATE_IMAGE;
+	const float progress_split = supersample ? p_progress_from + (p_progress_to - p_progress_from) * 0.6f : p_progress_to;
+
+	for (int pass = 0; pass < (supersample ? 2 : 1); pass++) {
+		const float from = pass == 0 ? p_progress_from : progress_split;
+		const float to = pass == 0 ? progress_split : p_progress_to;
+		_lm_parallel_for(
+				(int)raster_jobs.size(), _get_worker_thread_count(),
+				[&](int p_job) {
+					if (_is_bake_aborted()) {
+						return;
+					}
+					const RasterJob &job = raster_jobs[(size_t)p_job];
+					LightmapGuide *guide = p_guides == nullptr || pass > 0 ? nullptr : &(*p_guides)[(size_t)job.mesh];
+					LightmapEdgeInfo *edge_info = supersample ? &edges[(size_t)job.mesh] : nullptr;
+					_rasterize_mesh_direct_lighting(job.mesh, p_mesh_lights[(size_t)job.mesh], p_lightmaps[(size_t)job.mesh], guide, edge_info, job.row_begin, job.row_end, pass > 0);
+					if (ray_bvh) {
+						ray_bvh->flush_thread_stats();
+					}
+				},
+				[&](int p_done, int p_total) {
+					if (p_progress != nullptr && to > from) {
+						_report_progress(from + (to - from) * (float)p_done / (float)p_total, pass == 0 ? "Rasterizing UV2 and evaluating lights..." : "Supersampling edges...", p_progress, p_userdata);
+					}
+				});
 	}
-
-	_write_output_data(p_output_data, tex_array);
-	return BAKE_ERROR_OK;
+	_track_bake_memory(-edge_memory);
 }
 
-LightmapBaker::BakeError LightmapBaker::_bake_indirect_light(Vector<Ref<Image>> &p_lightmaps, BakeProgressFunc p_progress, void *p_userdata) {
-	if (p_lightmaps.is_empty() || bounces <= 0) {
-		return BAKE_ERROR_OK;
+int LightmapBaker::_get_indirect_ray_count() const {
+	// Same settings (and defaults) the editor's GPU lightmapper uses for its bake quality levels.
+	const char *setting = "rendering/lightmapping/bake_quality/medium_quality_ray_count";
+	int ray_count = 128;
+	switch (bake_quality) {
+		case BAKE_QUALITY_LOW:
+			setting = "rendering/lightmapping/bake_quality/low_quality_ray_count";
+			ray_count = 32;
+			break;
+		case BAKE_QUALITY_MEDIUM:
+			break;
+		case BAKE_QUALITY_HIGH:
+			setting = "rendering/lightmapping/bake_quality/high_quality_ray_count";
+			ray_count = 512;
+			break;
+		case BAKE_QUALITY_ULTRA:
+			setting = "rendering/lightmapping/bake_quality/ultra_quality_ray_count";
+			ray_count = 2048;
+			break;
 	}
 
-	Vector<Ref<Image>> bounce_accum = p_lightmaps;
+	ProjectSettings *ps = ProjectSettings::get_singleton();
+	if (ps != nullptr && ps->has_setting(setting)) {
+		ray_count = (int)ps->get_setting(setting);
+	}
+	return std::clamp(ray_count, 1, 4096);
+}
 
-	for (int bounce = 0; bounce < bounces; bounce++) {
-		float progress = 0.5f + (float)bounce / (float)std::max(1, bounces) * 0.3f;
-		_report_progress(progress, "Computing bounce " + String::num_int64(bounce + 1) + "/" + String::num_int64((int64_t)bounces), p_progress, p_userdata);
-
-		Vector<Ref<Image>> bounce_light;
-		bounce_light.resize(p_lightmaps.size());
-		for (int i = 0; i < p_lightmaps.size(); i++) {
-			Ref<Image> img = _create_lightmap_image(p_lightmaps[i]->get_width(), p_lightmaps[i]->get_height());
-			if (img.is_null()) return BAKE_ERROR_CANT_CREATE_IMAGE;
-			img->fill(Color(0, 0, 0, 0));
-			bounce_light.set(i, img);
-		}
-
-		// Rasterize bounce lighting using neighbor sampling
-		for (int i = 0; i < p_lightmaps.size(); i++) {
-			Ref<Image> src = bounce_accum[i];
-			Ref<Image> dst = bounce_light[i];
-			if (src.is_null() || dst.is_null()) continue;
-
-			for (int y = 0; y < dst->get_height(); y++) {
-				for (int x = 0; x < dst->get_width(); x++) {
-					Color direct_here = src->get_pixel(x, y);
-					if (direct_here.a < 0.5f) continue;
-
-					Vector3 indirect(0, 0, 0);
-					int sample_count = 0;
-
-					// Sample nearby pixels as indirect sources
-					const int samples[] = { -2, -1, 1, 2 };
-					for (int dx : samples) {
-						int nx = x + dx;
-						if (nx >= 0 && nx < dst->get_width()) {
-							Color neighbor = src->get_pixel(nx, y);
-							if (neighbor.a > 0.5f) {
-								indirect += Vector3(neighbor.r, neighbor.g, neighbor.b);
-								sample_count++;
-							}
-						}
-					}
-					for (int dy : samples) {
-						int ny = y + dy;
-						if (ny >= 0 && ny < dst->get_height()) {
-							Color neighbor = src->get_pixel(x, ny);
-							if (neighbor.a > 0.5f) {
-								indirect += Vector3(neighbor.r, neighbor.g, neighbor.b);
-								sample_count++;
-							}
-						}
-					}
+// Rows per indirect-lighting job; rays are far more expensive than raster texels.
+static constexpr int LM_INDIRECT_BAND_ROWS = 4;
 
-					if (sample_count > 0) {
-						indirect /= (float)sample_count;
-						indirect *= 0.5f;
-						dst->set_pixel(x, y, Color(indirect.x, indirect.y, indirect.z, 1.0f));
-					}
-				}
+static inline float _lm_radical_inverse_vdc(uint32_t p_bits) {
+	p_bits = (p_bits << 16u) | (p_bits >> 16u);
+	p_bits = ((p_bits & 0x55555555u) << 1u) | ((p_bits & 0xAAAAAAAAu) >> 1u);
+	p_bits = ((p_bits & 0x33333333u) << 2u) | ((p_bits & 0xCCCCCCCCu) >> 2u);
+	p_bits = ((p_bits & 0x0F0F0F0Fu) << 4u) | ((p_bits & 0xF0F0F0F0u) >> 4u);
+	p_bits = ((p_bits & 0x00FF00FFu) << 8u) | ((p_bits & 0xFF00FF00u) >> 8u);
+	return (float)p_bits * 2.3283064365386963e-10f; // / 2^32
+}
+
+// Looks up the radiance stored at a UV2 position, falling back to the covered texels around it
+// when the hit lands on an island border the rasterizer did not cover.
+static inline bool _lm_sample_lightmap(const LightmapBuffer &p_buffer, const Vector2 &p_uv, Vector3 &r_color) {
+	const int x = std::clamp((int)Math::floor(p_uv.x * (float)p_buffer.width), 0, p_buffer.width - 1);
+	const int y = std::clamp((int)Math::floor(p_uv.y * (float)p_buffer.height), 0, p_buffer.height - 1);
+	if (p_buffer.is_covered(x, y)) {
+		const float *c = p_buffer.texel(x, y);
+		r_color = Vector3(c[0], c[1], c[2]);
+		return true;
+	}
+
+	Vector3 accum(0, 0, 0);
+	int count = 0;
+	for (int ny = std::max(0, y - 1); ny <= std::min(p_buffer.height - 1, y + 1); ny++) {
+		for (int nx = std::max(0, x - 1); nx <= std::min(p_buffer.width - 1, x + 1); nx++) {
+			if (p_buffer.is_covered(nx, ny)) {
+				const float *c = p_buffer.texel(nx, ny);
+				accum += Vector3(c[0], c[1], c[2]);
+				count++;
 			}
 		}
+	}
+	if (count == 0) {
+		return false;
+	}
+	r_color = accum / (float)count;
+	return true;
+}
 
-		// Dilate empty texels around UV islands (0 disables).
-		_dilate_lightmaps(bounce_light, seam_dilation_radius > 0 ? 1 : 0);
-
-		// Accumulate with falloff
-		float bounce_energy = bounce_indirect_energy * Math::pow(0.5f, (float)(bounce + 1));
-		for (int i = 0; i < p_lightmaps.size(); i++) {
-			Ref<Image> dst = p_lightmaps[i];
-			Ref<Image> src = bounce_light[i];
-			if (dst.is_null() || src.is_null()) {
-				UtilityFunctions::push_warning("Bounce " + String::num_int64(bounce + 1) + ": null lightmap at index " + String::num_int64(i));
+// Adds a reduced-resolution lightmap of the same surface to p_target, bilinearly interpolating
+// the covered proxy texels around each covered target texel.
+static void _lm_add_upsampled(LightmapBuffer &p_target, const LightmapBuffer &p_proxy) {
+	const float scale_x = (float)p_proxy.width / (float)p_target.width;
+	const float scale_y = (float)p_proxy.height / (float)p_target.height;
+	for (int y = 0; y < p_target.height; y++) {
+		const float fy = ((float)y + 0.5f) * scale_y - 0.5f;
+		const int y0 = (int)Math::floor(fy);
+		const float wy = fy - (float)y0;
+		for (int x = 0; x < p_target.width; x++) {
+			if (!p_target.is_covered(x, y)) {
 				continue;
 			}
-			if (dst->is_empty() || src->is_empty()) {
-				UtilityFunctions::push_warning("Bounce " + String::num_int64(bounce + 1) + ": empty lightmap at index " + String::num_int64(i));
-				continue;
+			const float fx = ((float)x + 0.5f) * scale_x - 0.5f;
+			const int x0 = (int)Math::floor(fx);
+			const float wx = fx - (float)x0;
+
+			Vector3 accum(0, 0, 0);
+			float weight = 0.0f;
+			for (int j = 0; j < 2; j++) {
+				const int py = y0 + j;
+				if (py < 0 || py >= p_proxy.height) {
+					continue;
+				}
+				for (int i = 0; i < 2; i++) {
+					const int px = x0 + i;
+					if (px < 0 || px >= p_proxy.width || !p_proxy.is_covered(px, py)) {
+						continue;
+					}
+					const float w = (i ? wx : 1.0f - wx) * (j ? wy : 1.0f - wy);
+					const float *c = p_proxy.texel(px, py);
+					accum += Vector3(c[0], c[1], c[2]) * w;
+					weight += w;
+				}
 			}
 
-			for (int y = 0; y < dst->get_height(); y++) {
-				for (int x = 0; x < dst->get_width(); x++) {
-					Color direct = dst->get_pixel(x, y);
-					Color bounce = src->get_pixel(x, y) * bounce_energy;
-					Color result(direct.r + bounce.r, direct.g + bounce.g, direct.b + bounce.b, direct.a);
-					dst->set_pixel(x, y, result);
-				}
+			Vector3 indirect;
+			if (weight > 1e-4f) {
+				indirect = accum / weight;
+			} else if (!_lm_sample_lightmap(p_proxy, Vector2(((float)x + 0.5f) / (float)p_target.width, ((float)y + 0.5f) / (float)p_target.height), indirect)) {
+				continue;
 			}
+			float *c = p_target.texel(x, y);
+			c[0] += indirect.x;
+			c[1] += indirect.y;
+			c[2] += indirect.z;
 		}
-
-		bounce_accum = bounce_light;
 	}
-
-	return BAKE_ERROR_OK;
 }
 
-void LightmapBaker::_dilate_lightmaps(Vector<Ref<Image>> &p_lightmaps, int p_dilation_radius) {
-	if (p_dilation_radius <= 0) return;
+// Typical world-space size of a texel per lightmap. The median of neighbor distances ignores
+// pairs that straddle two islands.
+static void _lm_texel_world_sizes(const std::vector<LightmapBuffer> &p_lightmaps, const std::vector<LightmapGuide> &p_guides, int p_thread_count, std::vector<float> &r_sizes) {
+	r_sizes.assign(p_lightmaps.size(), 0.0f);
+	_lm_parallel_for((int)p_lightmaps.size(), p_thread_count, [&](int p_index) {
+		const LightmapBuffer &buf = p_lightmaps[(size_t)p_index];
+		const LightmapGuide &guide = p_guides[(size_t)p_index];
+		if (buf.is_empty() || guide.position.empty()) {
+			return;
+		}
+		std::vector<float> distances;
+		for (int y = 0; y < buf.height; y += 2) {
+			for (int x = 0; x + 1 < buf.width; x++) {
+				if (buf.is_covered(x, y) && buf.is_covered(x + 1, y)) {
+					const size_t i = (size_t)y * (size_t)buf.width + (size_t)x;
+					distances.push_back((guide.position[i + 1] - guide.position[i]).length());
+				}
+			}
+		}
+		if (!distances.empty()) {
+			std::nth_element(distances.begin(), distances.begin() + distances.size() / 2, distances.end());
+			r_sizes[(size_t)p_index] = distances[distances.size() / 2];
+		}
+	});
+}
 
-	for (Ref<Image> &img : p_lightmaps) {
-		if (img.is_null()) continue;
+// Irradiance cache (Ward et al. 1988, "A Ray Tracing Solution for Diffuse Interreflection"):
+// full hemisphere gathers at sparse records, interpolated for the texels between them.
+// Records are placed on successively finer texel grids, wherever no earlier record is valid.
+static constexpr int LM_IRRADIANCE_CACHE_MAX_STEP = 8;
+// Record radius (harmonic mean hit distance) limits, in texels of the record's lightmap.
+static constexpr float LM_IRRADIANCE_CACHE_MIN_RADIUS = 1.5f;
+static constexpr float LM_IRRADIANCE_CACHE_MAX_RADIUS = 32.0f;
+// Octree levels below the root. A lookup pushes at most 8 children per level and pops one, so
+// its stack never holds more than 7 * depth + 1 nodes.
+static constexpr int LM_IRRADIANCE_CACHE_MAX_DEPTH = 24;
+
+struct _LM_IrradianceRecord {
+	Vector3 position;
+	Vector3 normal;
+	Vector3 irradiance;
+	// Change of each color channel for a small rotation of the normal and a small move of the
+	// position (Ward and Heckbert 1992, "Irradiance Gradients").
+	Vector3 rotation_gradient[3];
+	Vector3 translation_gradient[3];
+	float radius = 0.0f;
+};
 
-		Ref<Image> dilated = _create_lightmap_image(img->get_width(), img->get_height());
-		if (dilated.is_null()) continue;
+// Loose octree over the records: a node of half size h holds the records centered inside it
+// whose influence radius is at most h, so lookups only visit nodes within 2h of the point.
+struct _LM_IrradianceOctree {
+	struct Node {
+		Vector3 center;
+		float half_size = 0.0f;
+		int children[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+		std::vector<uint32_t> records;
+	};
+	std::vector<Node> nodes;
+	std::vector<_LM_IrradianceRecord> records;
+	float error = 0.3f;
+
+	void create(const Vector3 &p_min, const Vector3 &p_max, float p_error) {
+		nodes.clear();
+		records.clear();
+		error = p_error;
+		Node root;
+		root.center = (p_min + p_max) * 0.5f;
+		root.half_size = std::max({ (float)(p_max.x - p_min.x), (float)(p_max.y - p_min.y), (float)(p_max.z - p_min.z), 1e-3f }) * 0.51f;
+		nodes.push_back(root);
+	}
 
-		// Copy original
-		for (int y = 0; y < img->get_height(); y++) {
-			for (int x = 0; x < img->get_width(); x++) {
-				dilated->set_pixel(x, y, img->get_pixel(x, y));
+	void insert(const _LM_IrradianceRecord &p_record) {
+		const uint32_t record_index = (uint32_t)records.size();
+		records.push_back(p_record);
+		const float influence = p_record.radius * error;
+		int node_index = 0;
+		for (int depth = 0; depth < LM_IRRADIANCE_CACHE_MAX_DEPTH && nodes[(size_t)node_index].half_size * 0.5f >= influence; depth++) {
+			const Node &node = nodes[(size_t)node_index];
+			const Vector3 d = p_record.position - node.center;
+			if (Math::abs(d.x) > node.half_size || Math::abs(d.y) > node.half_size || Math::abs(d.z) > node.half_size) {
+				break;
+			}
+			const int octant = (d.x >= 0.0f ? 1 : 0) | (d.y >= 0.0f ? 2 : 0) | (d.z >= 0.0f ? 4 : 0);
+			if (node.children[octant] < 0) {
+				Node child;
+				child.half_size = node.half_size * 0.5f;
+				child.center = node.center + Vector3(octant & 1 ? child.half_size : -child.half_size, octant & 2 ? child.half_size : -child.half_size, octant & 4 ? child.half_size : -child.half_size);
+				nodes[(size_t)node_index].children[octant] = (int)nodes.size();
+				nodes.push_back(child);
 			}
+			node_index = nodes[(size_t)node_index].children[octant];
 		}
+		nodes[(size_t)node_index].records.push_back(record_index);
+	}
 
-		// Dilate empty pixels
-		for (int y = 0; y < img->get_height(); y++) {
-			for (int x = 0; x < img->get_width(); x++) {
-				Color pix = img->get_pixel(x, y);
-				if (pix.a > 0.5f) continue; // Already filled
-
-				Vector3 accum(0, 0, 0);
-				int count = 0;
-				for (int dy = -p_dilation_radius; dy <= p_dilation_radius; dy++) {
-					for (int dx = -p_dilation_radius; dx <= p_dilation_radius; dx++) {
-						if (dx == 0 && dy == 0) continue;
-						int nx = x + dx;
-						int ny = y + dy;
-						if (nx >= 0 && nx < img->get_width() && ny >= 0 && ny < img->get_height()) {
-							Color neighbor = img->get_pixel(nx, ny);
-							if (neighbor.a > 0.5f) {
-								accum += Vector3(neighbor.r, neighbor.g, neighbor.b);
-								count++;
-							}
-						}
-					}
+	// Weighted average of the valid records at the point; false if there are none.
+	bool interpolate(const Vector3 &p_position, const Vector3 &p_normal, Vector3 &r_irradiance) const {
+		const float inv_error = 1.0f / error;
+		Vector3 sum(0, 0, 0);
+		float weight_sum = 0.0f;
+		int stack[LM_IRRADIANCE_CACHE_MAX_DEPTH * 7 + 1];
+		int stack_size = 0;
+		stack[stack_size++] = 0;
+		while (stack_size > 0) {
+			const Node &node = nodes[(size_t)stack[--stack_size]];
+			for (uint32_t index : node.records) {
+				const _LM_IrradianceRecord &record = records[index];
+				const Vector3 offset = p_position - record.position;
+				const float normal_dot = (float)p_normal.dot(record.normal);
+				if (normal_dot <= 0.0f) {
+					continue;
 				}
-
-				if (count > 0) {
-					accum /= (float)count;
-					dilated->set_pixel(x, y, Color(accum.x, accum.y, accum.z, 1.0f));
+				// Records in front of the point may see occluders it doesn't.
+				if ((float)offset.dot((p_normal + record.normal) * 0.5f) < -0.05f * record.radius) {
+					continue;
+				}
+				const float distance_term = (float)offset.length() / record.radius + Math::sqrt(std::max(0.0f, 1.0f - normal_dot));
+				const float weight = 1.0f / std::max(1e-4f, distance_term) - inv_error;
+				if (weight <= 0.0f) {
+					continue;
+				}
+				const Vector3 rotation = record.normal.cross(p_normal);
+				sum += Vector3(
+							   record.irradiance.x + (float)rotation.dot(record.rotation_gradient[0]) + (float)offset.dot(record.translation_gradient[0]),
+							   record.irradiance.y + (float)rotation.dot(record.rotation_gradient[1]) + (float)offset.dot(record.translation_gradient[1]),
+							   record.irradiance.z + (float)rotation.dot(record.rotation_gradient[2]) + (float)offset.dot(record.translation_gradient[2])) *
+						weight;
+				weight_sum += weight;
+			}
+			for (int child : node.children) {
+				if (child < 0) {
+					continue;
+				}
+				const Node &c = nodes[(size_t)child];
+				const Vector3 d = p_position - c.center;
+				const float reach = c.half_size * 2.0f;
+				if (Math::abs(d.x) <= reach && Math::abs(d.y) <= reach && Math::abs(d.z) <= reach) {
+					stack[stack_size++] = child;
 				}
 			}
 		}
+		if (weight_sum <= 0.0f) {
+			return false;
+		}
+		r_irradiance = sum / weight_sum;
+		r_irradiance = Vector3(std::max(0.0f, (float)r_irradiance.x), std::max(0.0f, (float)r_irradiance.y), std::max(0.0f, (float)r_irradiance.z));
+		return true;
+	}
 
-		img = dilated;
+	size_t get_memory_usage() const {
+		size_t bytes = nodes.capacity() * sizeof(Node) + records.capacity() * sizeof(_LM_IrradianceRecord);
+		for (const Node &node : nodes) {
+			bytes += node.records.capacity() * sizeof(uint32_t);
+		}
+		return bytes;
 	}
-}
+};
 
-// Texture management
-Ref<Image> LightmapBaker::_create_lightmap_image(int p_width, int p_height) {
-	if (p_width <= 0 || p_height <= 0) {
-		return Ref<Image>();
+LightmapBaker::BakeError LightmapBaker::_bake_indirect_light(std::vector<LightmapBuffer> &p_lightmaps, const std::vector<LightmapGuide> &p_guides, BakeProgressFunc p_progress, void *p_userdata) {
+	_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_INDIRECT]);
+	if (p_lightmaps.empty() || bounces <= 0) {
+		return BAKE_ERROR_OK;
 	}
-	// RGBAH so alpha can be used as a coverage mask for dilation.
-	Ref<Image> img = Image::create(p_width, p_height, false, Image::FORMAT_RGBAH);
-	if (img.is_null() || img->is_empty()) {
-		UtilityFunctions::push_error("LightmapBaker: failed to create Image (" + String::num_int64(p_width) + "x" + String::num_int64(p_height) + ")");
-		return Ref<Image>();
+	if (!ray_bvh || ray_bvh->triangle_count == 0 || p_guides.size() != p_lightmaps.size()) {
+		return BAKE_ERROR_MESHES_INVALID;
 	}
-	return img;
-}
 
-Vector<Ref<Image>> LightmapBaker::_pack_lightmaps_to_atlas(std::vector<MeshData> &p_meshes, const Vector<Ref<Image>> &p_lightmaps, int p_atlas_size, int p_padding) {
-	if (p_meshes.empty() || p_lightmaps.is_empty() || p_meshes.size() != (size_t)p_lightmaps.size()) {
-		return Vector<Ref<Image>>();
+	const int ray_count = _get_indirect_ray_count();
+	const float inv_ray_count = 1.0f / (float)ray_count;
+	// Irradiance cache records split the same ray budget into about pi times more azimuthal than
+	// polar strata, as Ward and Heckbert suggest.
+	const int strata_theta = std::max(1, (int)Math::sqrt((float)ray_count / (float)Math_PI));
+	const int strata_phi = std::max(1, ray_count / strata_theta);
+	// Step through the polar slices of a cell's azimuth row; coprime with strata_phi, so every
+	// slice is used once per row.
+	int strata_stride = std::max(1, (int)((float)strata_phi * 0.618f));
+	while (std::gcd(strata_stride, strata_phi) != 1) {
+		strata_stride++;
 	}
-	if (p_atlas_size <= 0) {
-		return Vector<Ref<Image>>();
+
+	std::vector<Color> albedos;
+	albedos.reserve(gathered_meshes.size());
+	for (const MeshData &md : gathered_meshes) {
+		albedos.push_back(_get_surface_albedo(md));
 	}
 
-	struct Item {
-		int idx = -1;
-		int w = 0;
-		int h = 0;
+	struct IndirectJob {
+		int mesh = 0;
+		int row_begin = 0;
+		int row_end = 0;
 	};
-
-	Vector<Item> items;
-	items.resize(p_lightmaps.size());
-	for (int i = 0; i < p_lightmaps.size(); i++) {
-		Ref<Image> img = p_lightmaps[i];
-		if (img.is_null() || img->is_empty() || img->get_width() <= 0 || img->get_height() <= 0) {
-			return Vector<Ref<Image>>();
+	std::vector<IndirectJob> jobs;
+	for (size_t i = 0; i < p_lightmaps.size(); i++) {
+		const int h = p_lightmaps[i].height;
+		for (int y = 0; y < h; y += LM_INDIRECT_BAND_ROWS) {
+			jobs.push_back(IndirectJob{ (int)i, y, std::min(h, y + LM_INDIRECT_BAND_ROWS) });
 		}
-		Item it;
-		it.idx = i;
-		it.w = img->get_width() + p_padding * 2;
-		it.h = img->get_height() + p_padding * 2;
-		items.set(i, it);
 	}
 
-	// Sort by height (simple shelf packer works better).
-	struct _ItemHeightComparator {
-		bool operator()(const Item &a, const Item &b) const {
-			return a.h > b.h;
+	// Each bounce gathers the radiance left by the previous one (the direct pass for the first),
+	// so bounce N carries light that has been reflected N times.
+	std::vector<LightmapBuffer> previous = p_lightmaps;
+	std::vector<LightmapBuffer> current;
+	current.resize(p_lightmaps.size());
+	const int64_t scratch_memory = 2 * _lm_lightmap_memory(previous);
+	_track_bake_memory(scratch_memory);
+
+	const int worker_count = _get_worker_thread_count();
+	const int total_steps = (int)jobs.size() * bounces;
+
+	// The irradiance cache is rebuilt every bounce, over the bounds of the whole scene.
+	_LM_IrradianceOctree cache;
+	std::vector<float> texel_world_size;
+	Vector3 scene_min;
+	Vector3 scene_max;
+	int64_t cache_memory = 0;
+	if (use_irradiance_cache) {
+		_lm_texel_world_sizes(p_lightmaps, p_guides, worker_count, texel_world_size);
+		scene_min = gathered_meshes[0].world_aabb_min;
+		scene_max = gathered_meshes[0].world_aabb_max;
+		for (const MeshData &md : gathered_meshes) {
+			scene_min = Vector3(Math::min(scene_min.x, md.world_aabb_min.x), Math::min(scene_min.y, md.world_aabb_min.y), Math::min(scene_min.z, md.world_aabb_min.z));
+			scene_max = Vector3(Math::max(scene_max.x, md.world_aabb_max.x), Math::max(scene_max.y, md.world_aabb_max.y), Math::max(scene_max.z, md.world_aabb_max.z));
 		}
-	};
-	items.sort_custom<_ItemHeightComparator>();
-
-	struct Placement {
-		int slice = 0;
-		Vector2i pos;
-	};
-	Vector<Placement> placement;
-	placement.resize(p_lightmaps.size());
-
-	int slice = 0;
-	int x = 0;
-	int y = 0;
-	int shelf_h = 0;
+	}
 
-	for (int k = 0; k < items.size(); k++) {
-		Item it = items[k];
-		if (it.w > p_atlas_size || it.h > p_atlas_size) {
-			return Vector<Ref<Image>>();
+	for (int bounce = 0; bounce < bounces; bounce++) {
+		for (size_t i = 0; i < p_lightmaps.size(); i++) {
+			if (!current[i].create(p_lightmaps[i].width, p_lightmaps[i].height)) {
+				return BAKE_ERROR_CANT_CREATE_IMAGE;
+			}
 		}
 
-		if (x + it.w > p_atlas_size) {
-			y += shelf_h;
-			x = 0;
-			shelf_h = 0;
-		}
-		if (y + it.h > p_atlas_size) {
-			slice++;
-			x = 0;
-			y = 0;
-			shelf_h = 0;
-		}
+		const String status = "Computing bounce " + String::num_int64(bounce + 1) + "/" + String::num_int64((int64_t)bounces);
+		auto report = [&](int p_done, int p_total) {
+			const float t = (float)(bounce * p_total + p_done) / (float)std::max(1, total_steps);
+			_report_progress(0.65f + 0.1f * t, status, p_progress, p_userdata);
+		};
 
-		Placement pl;
-		pl.slice = slice;
-		pl.pos = Vector2i(x + p_padding, y + p_padding);
-		placement.set(it.idx, pl);
+		// One hemisphere gather from a texel: the average radiance reflected by the surfaces its
+		// rays hit in the previous bounce. With r_record, also the harmonic mean hit distance and
+		// the gradients needed by the irradiance cache; record gathers stratify the hemisphere into
+		// strata_theta x strata_phi cells, one ray each, which the translational gradient needs.
+		auto gather = [&](int p_mesh, int p_x, int p_y, const Vector3 &p_position, const Vector3 &n, _LM_IrradianceRecord *r_record) {
+			const Vector3 origin = p_position + n * bias;
+
+			// Orthonormal basis around the normal (Duff et al. 2017, branchless).
+			const float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+			const float a = -1.0f / (sign + n.z);
+			const float b = n.x * n.y * a;
+			const Vector3 tangent(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+			const Vector3 bitangent(b, sign + n.y * n.y * a, -n.y);
+
+			// Hammersley points with a per-texel Cranley-Patterson rotation (jittered strata for
+			// records); seeded only by the texel and bounce so the result does not depend on
+			// thread scheduling.
+			const uint64_t seed = _lm_mix64(((uint64_t)p_mesh << 40) ^ ((uint64_t)p_y << 20) ^ (uint64_t)p_x ^ ((uint64_t)bounce << 58));
+			const float rot_u = (float)(seed & 0xFFFFFFu) / 16777216.0f;
+			const float rot_v = (float)((seed >> 24) & 0xFFFFFFu) / 16777216.0f;
+			const int sample_count = r_record != nullptr ? strata_theta * strata_phi : ray_count;
+			thread_local std::vector<Vector3> stratum_radiance;
+			thread_local std::vector<float> stratum_distance;
+			if (r_record != nullptr) {
+				stratum_radiance.assign((size_t)sample_count, Vector3(0, 0, 0));
+				stratum_distance.assign((size_t)sample_count, 1e20f);
+			}
 
-		x += it.w;
-		shelf_h = std::max(shelf_h, it.h);
-	}
+			Vector3 gathered(0, 0, 0);
+			float inv_distance_sum = 0.0f;
+			Vector3 gradient[3];
+			for (int r = 0; r < sample_count; r++) {
+				float u1;
+				float u2;
+				if (r_record != nullptr) {
+					// Within its cell, each ray also takes its own slice of the polar range (a
+					// permutation per polar row), so u1 stays stratified over all sample_count levels
+					// like the plain set.
+					const int j = r / strata_phi;
+					const int k = r % strata_phi;
+					const uint64_t jitter = _lm_mix64(seed + (uint64_t)r + 1);
+					const int slice = (int)((_lm_mix64(seed ^ ((uint64_t)j << 32)) + (uint64_t)k * (uint64_t)strata_stride) % (uint64_t)strata_phi);
+					u1 = ((float)j + ((float)slice + (float)(jitter & 0xFFFFFFu) / 16777216.0f) / (float)strata_phi) / (float)strata_theta;
+					u2 = ((float)k + (float)((jitter >> 24) & 0xFFFFFFu) / 16777216.0f) / (float)strata_phi;
+				} else {
+					u1 = ((float)r + 0.5f) * inv_ray_count + rot_u;
+					u2 = _lm_radical_inverse_vdc((uint32_t)r) + rot_v;
+					u1 -= Math::floor(u1);
+					u2 -= Math::floor(u2);
+				}
 
-	Vector<Ref<Image>> atlas_layers;
-	atlas_layers.resize(slice + 1);
-	for (int s = 0; s <= slice; s++) {
-		Ref<Image> atlas = _create_lightmap_image(p_atlas_size, p_atlas_size);
-		if (atlas.is_null() || atlas->is_empty()) {
-			return Vector<Ref<Image>>();
-		}
-		atlas->fill(Color(0, 0, 0, 0));
-		atlas_layers.set(s, atlas);
-	}
+				// Cosine-weighted hemisphere direction: the cosine term and pdf cancel out.
+				const float radius = Math::sqrt(u1);
+				const float phi = (float)Math_TAU * u2;
+				const float cos_theta = Math::sqrt(Math::max(0.0f, 1.0f - u1));
+				const Vector3 dir = tangent * (radius * Math::cos(phi)) + bitangent * (radius * Math::sin(phi)) + n * cos_theta;
+
+				_LM_RayHit hit;
+				if (!ray_bvh->intersect_closest(origin, dir, 1e20f, hit)) {
+					continue; // Sky contribution is handled by the ambient terms.
+				}
+				if (r_record != nullptr) {
+					inv_distance_sum += 1.0f / Math::max(hit.t, 1e-4f);
+					stratum_distance[(size_t)r] = Math::max(hit.t, 1e-4f);
+				}
+				const _LM_RayTriInfo &info = ray_bvh->tri_infos[hit.tri];
+				if (info.normal.dot(dir) > 0.0f) {
+					continue; // Back faces do not reflect light.
+				}
+				const uint32_t *corners = &bake_geometry.indices[(size_t)info.triangle * 3];
+				const Vector2 hit_uv = bake_geometry.uv2s[corners[0]] * (1.0f - hit.u - hit.v) + bake_geometry.uv2s[corners[1]] * hit.u + bake_geometry.uv2s[corners[2]] * hit.v;
+				Vector3 radiance;
+				if (_lm_sample_lightmap(previous[info.surface], hit_uv, radiance)) {
+					gathered += radiance;
+					if (r_record != nullptr) {
+						stratum_radiance[(size_t)r] = radiance;
+						// Undo the cosine weighting: rotating the normal by r changes each sample's
+						// contribution by r . (n x dir) / cos_theta.
+						const Vector3 axis = n.cross(dir) / Math::max(0.1f, cos_theta);
+						gradient[0] += axis * radiance.x;
+						gradient[1] += axis * radiance.y;
+						gradient[2] += axis * radiance.z;
+					}
+				}
+			}
+
+			const float scale = bounce_indirect_energy / (float)sample_count;
+			gathered *= scale;
+			if (r_record != nullptr) {
+				const float texel = Math::max(1e-4f, texel_world_size[(size_t)p_mesh]);
+				const float harmonic = inv_distance_sum > 0.0f ? (float)sample_count / inv_distance_sum : 1e20f;
+				r_record->position = p_position;
+				r_record->normal = n;
+				r_record->irradiance = gathered;
+				r_record->radius = Math::clamp(harmonic, texel * LM_IRRADIANCE_CACHE_MIN_RADIUS, texel * LM_IRRADIANCE_CACHE_MAX_RADIUS);
+
+				// Translational gradient from the radiance change across the walls between
+				// neighboring strata, each wall moving with the nearer of its two hits.
+				Vector3 translation[3];
+				const float phi_step = (float)Math_TAU / (float)strata_phi;
+				for (int k = 0; k < strata_phi; k++) {
+					const int k_prev = (k + strata_phi - 1) % strata_phi;
+					const float phi_center = ((float)k + 0.5f) * phi_step;
+					const float phi_wall = (float)k * phi_step;
+					const Vector3 u_k = tangent * Math::cos(phi_center) + bitangent * Math::sin(phi_center);
+					const Vector3 v_k = tangent * -Math::sin(phi_wall) + bitangent * Math::cos(phi_wall);
+					Vector3 theta_walls(0, 0, 0);
+					Vector3 phi_walls(0, 0, 0);
+					for (int j = 0; j < strata_theta; j++) {
+						const size_t cell = (size_t)(j * strata_phi + k);
+						const float sin2_lo = (float)j / (float)strata_theta;
+						const float sin2_hi = (float)(j + 1) / (float)strata_theta;
+						if (j > 0) {
+							const size_t below = cell - (size_t)strata_phi;
+							const float weight = Math::sqrt(sin2_lo) * (1.0f - sin2_lo) / Math::min(stratum_distance[cell], stratum_distance[below]);
+							theta_walls += (stratum_radiance[cell] - stratum_radiance[below]) * weight;
+						}
+						const size_t side = (size_t)(j * strata_phi + k_prev);
+						const float sin_center = Math::sqrt(((float)j + 0.5f) / (float)strata_theta);
+						const float weight = (Math::sqrt(1.0f - sin2_lo) - Math::sqrt(1.0f - sin2_hi)) / (sin_center * Math::min(stratum_distance[cell], stratum_distance[side]));
+						phi_walls += (stratum_radiance[cell] - stratum_radiance[side]) * weight;
+					}
+					const Vector3 walls = theta_walls * (2.0f / (float)strata_phi);
+					const Vector3 sides = phi_walls * (1.0f / (float)Math_PI);
+					translation[0] += u_k * walls.x + v_k * sides.x;
+					translation[1] += u_k * walls.y + v_k * sides.y;
+					translation[2] += u_k * walls.z + v_k * sides.z;
+				}
+				for (int c = 0; c < 3; c++) {
+					r_record->rotation_gradient[c] = gradient[c] * scale;
+					// Limit the extrapolation across the record's radius to its own irradiance, so
+					// a noisy gradient can't push neighbors negative (Krivanek et al. 2005).
+					Vector3 t = translation[c] * bounce_indirect_energy;
+					const float limit = gathered[c] / r_record->radius;
+					const float length = (float)t.length();
+					if (length > limit) {
+						t *= limit / length;
+					}
+					r_record->translation_gradient[c] = t;
+				}
+			}
+			return gathered;
+		};
+
+		if (use_irradiance_cache) {
+			// Grid levels from coarse to fine: texels on the level's grid that no record covers
+			// yet get a record. The finest level covers every texel, so none is left without one.
+			cache.create(scene_min, scene_max, irradiance_cache_error);
+			for (int step = LM_IRRADIANCE_CACHE_MAX_STEP; step >= 1 && !_is_bake_aborted(); step /= 2) {
+				std::vector<std::vector<_LM_IrradianceRecord>> job_records(jobs.size());
+				_lm_parallel_for((int)jobs.size(), worker_count, [&](int p_job) {
+					if (_is_bake_aborted()) {
+						return;
+					}
+					const IndirectJob &job = jobs[(size_t)p_job];
+					const LightmapBuffer &coverage = p_lightmaps[(size_t)job.mesh];
+					const LightmapGuide &guide = p_guides[(size_t)job.mesh];
+					for (int y = job.row_begin; y < job.row_end; y++) {
+						if (y % step != 0) {
+							continue;
+						}
+						for (int x = 0; x < coverage.width; x += step) {
+							if (!coverage.is_covered(x, y)) {
+								continue;
+							}
+							const size_t index = (size_t)y * (size_t)coverage.width + (size_t)x;
+							Vector3 irradiance;
+							if (cache.interpolate(guide.position[index], guide.normal[index], irradiance)) {
+								continue;
+							}
+							_LM_IrradianceRecord record;
+							gather(job.mesh, x, y, guide.position[index], guide.normal[index], &record);
+							job_records[(size_t)p_job].push_back(record);
+						}
+					}
+					ray_bvh->flush_thread_stats();
+				});
+				// Inserted in job order, so the cache doesn't depend on thread scheduling.
+				for (const std::vector<_LM_IrradianceRecord> &records : job_records) {
+					for (const _LM_IrradianceRecord &record : records) {
+						cache.insert(record);
+					}
+				}
+			}
+			cache_memory = (int64_t)cache.get_memory_usage();
+			_track_bake_memory(cache_memory);
+		}
+
+		_lm_parallel_for(
+				(int)jobs.size(), worker_count,
+				[&](int p_job) {
+					if (_is_bake_aborted()) {
+						return;
+					}
+					const IndirectJob &job = jobs[(size_t)p_job];
+					const LightmapBuffer &coverage = p_lightmaps[(size_t)job.mesh];
+					const LightmapGuide &guide = p_guides[(size_t)job.mesh];
+					LightmapBuffer &dst = current[(size_t)job.mesh];
+					const Color &albedo = albedos[(size_t)job.mesh];
+
+					for (int y = job.row_begin; y < job.row_end; y++) {
+						for (int x = 0; x < dst.width; x++) {
+							if (!coverage.is_covered(x, y)) {
+								continue;
+							}
+							const size_t index = (size_t)y * (size_t)dst.width + (size_t)x;
+							Vector3 gathered;
+							if (!use_irradiance_cache || !cache.interpolate(guide.position[index], guide.normal[index], gathered)) {
+								gathered = gather(job.mesh, x, y, guide.position[index], guide.normal[index], nullptr);
+							}
+							dst.set_texel(x, y, gathered.x * albedo.r, gathered.y * albedo.g, gathered.z * albedo.b);
+							dst.set_covered(x, y);
+						}
+					}
+					ray_bvh->flush_thread_stats();
+				},
+				report);
+		if (_is_bake_aborted()) {
+			return BAKE_ERROR_USER_ABORTED;
+		}
+
+		_lm_parallel_for((int)p_lightmaps.size(), worker_count, [&](int p_index) {
+			LightmapBuffer &dst = p_lightmaps[(size_t)p_index];
+			const LightmapBuffer &src = current[(size_t)p_index];
+			const size_t count = dst.color.size();
+			for (size_t k = 0; k < count; k++) {
+				dst.color[k] += src.color[k];
+			}
+		});
+
+		std::swap(previous, current);
+		_track_bake_memory(-cache_memory);
+		cache_memory = 0;
+	}
+
+	_track_bake_memory(-scratch_memory);
+	return BAKE_ERROR_OK;
+}
+
+// Rows per denoiser job.
+static constexpr int LM_DENOISE_BAND_ROWS = 16;
+
+// Edge-avoiding A-Trous wavelet filter (Dammertz et al., "Edge-Avoiding A-Trous Wavelet
+// Transform for fast Global Illumination Filtering"). Each iteration applies the 5x5 B3-spline
+// kernel with taps 2^i texels apart, weighted by world position, normal and luminance. Only
+// covered texels are read, and texels of other UV islands are far away in world space, so
+// lighting never bleeds across island borders.
+void LightmapBaker::_denoise_lightmaps(std::vector<LightmapBuffer> &p_lightmaps, const std::vector<LightmapGuide> &p_guides, BakeProgressFunc p_progress, void *p_userdata) {
+	_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_DENOISE]);
+	if (p_guides.size() != p_lightmaps.size()) {
+		return;
+	}
+
+	// Noisier (cheaper) qualities get wider filters.
+	int iterations = 4;
+	switch (bake_quality) {
+		case BAKE_QUALITY_LOW: iterations = 5; break;
+		case BAKE_QUALITY_MEDIUM: iterations = 4; break;
+		case BAKE_QUALITY_HIGH: iterations = 3; break;
+		case BAKE_QUALITY_ULTRA: iterations = 2; break;
+	}
+	const float strength = std::clamp(denoiser_strength, 0.0f, 1.0f);
+	if (strength <= 0.0f) {
+		return;
+	}
+	const int worker_count = _get_worker_thread_count();
+
+	// Typical world-space size of a texel per lightmap, to scale the position weight.
+	std::vector<float> texel_world_size;
+	_lm_texel_world_sizes(p_lightmaps, p_guides, worker_count, texel_world_size);
+
+	struct DenoiseJob {
+		int mesh = 0;
+		int row_begin = 0;
+		int row_end = 0;
+	};
+	std::vector<DenoiseJob> jobs;
+	for (size_t i = 0; i < p_lightmaps.size(); i++) {
+		if (p_lightmaps[i].is_empty() || p_guides[i].position.empty() || !(texel_world_size[i] > 0.0f)) {
+			continue;
+		}
+		for (int y = 0; y < p_lightmaps[i].height; y += LM_DENOISE_BAND_ROWS) {
+			jobs.push_back(DenoiseJob{ (int)i, y, std::min(p_lightmaps[i].height, y + LM_DENOISE_BAND_ROWS) });
+		}
+	}
+	if (jobs.empty()) {
+		return;
+	}
+
+	std::vector<std::vector<float>> filtered(p_lightmaps.size());
+	int64_t filtered_memory = 0;
+	for (const DenoiseJob &job : jobs) {
+		if (job.row_begin == 0) {
+			filtered[(size_t)job.mesh].resize(p_lightmaps[(size_t)job.mesh].color.size());
+			filtered_memory += (int64_t)(filtered[(size_t)job.mesh].size() * sizeof(float));
+		}
+	}
+	_track_bake_memory(filtered_memory);
+
+	static const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+	// Relative luminance difference at which a neighbor's weight drops to 1/e on the first pass.
+	const float color_sigma = 0.05f + 0.95f * strength;
+
+	for (int iteration = 0; iteration < iterations; iteration++) {
+		const int step = 1 << iteration;
+		const float color_sigma_i = color_sigma / (float)step;
+		const float inv_color_sigma_sq = 1.0f / (color_sigma_i * color_sigma_i);
+
+		_lm_parallel_for((int)jobs.size(), worker_count, [&](int p_job) {
+			if (_is_bake_aborted()) {
+				return;
+			}
+			const DenoiseJob &job = jobs[(size_t)p_job];
+			const LightmapBuffer &buf = p_lightmaps[(size_t)job.mesh];
+			const LightmapGuide &guide = p_guides[(size_t)job.mesh];
+			std::vector<float> &out = filtered[(size_t)job.mesh];
+			const float position_sigma = 2.0f * (float)step * texel_world_size[(size_t)job.mesh];
+			const float inv_position_sigma_sq = 1.0f / (position_sigma * position_sigma);
+
+			for (int y = job.row_begin; y < job.row_end; y++) {
+				for (int x = 0; x < buf.width; x++) {
+					const size_t index = (size_t)y * (size_t)buf.width + (size_t)x;
+					const float *c = buf.texel(x, y);
+					float *o = &out[index * 3];
+					if (!buf.is_covered(x, y)) {
+						o[0] = c[0];
+						o[1] = c[1];
+						o[2] = c[2];
+						continue;
+					}
+					const Vector3 p = guide.position[index];
+					const Vector3 n = guide.normal[index];
+					const float lum = 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+
+					float sum[3] = { 0.0f, 0.0f, 0.0f };
+					float weight_sum = 0.0f;
+					for (int ky = 0; ky < 5; ky++) {
+						const int qy = y + (ky - 2) * step;
+						if (qy < 0 || qy >= buf.height) continue;
+						for (int kx = 0; kx < 5; kx++) {
+							const int qx = x + (kx - 2) * step;
+							if (qx < 0 || qx >= buf.width || !buf.is_covered(qx, qy)) continue;
+							const size_t q_index = (size_t)qy * (size_t)buf.width + (size_t)qx;
+							const float *qc = buf.texel(qx, qy);
+
+							float weight = kernel[kx] * kernel[ky];
+							if (q_index != index) {
+								const float n_dot = n.dot(guide.normal[q_index]);
+								if (n_dot <= 0.0f) continue;
+								float normal_weight = n_dot * n_dot; // n_dot^32
+								normal_weight *= normal_weight;
+								normal_weight *= normal_weight;
+								normal_weight *= normal_weight;
+								normal_weight *= normal_weight;
+
+								const float dist_sq = (guide.position[q_index] - p).length_squared();
+								const float q_lum = 0.2126f * qc[0] + 0.7152f * qc[1] + 0.0722f * qc[2];
+								const float lum_diff = Math::abs(q_lum - lum) / (Math::max(q_lum, lum) + 1e-4f);
+								weight *= normal_weight * std::exp(-dist_sq * inv_position_sigma_sq - lum_diff * lum_diff * inv_color_sigma_sq);
+							}
+							sum[0] += qc[0] * weight;
+							sum[1] += qc[1] * weight;
+							sum[2] += qc[2] * weight;
+							weight_sum += weight;
+						}
+					}
+					const float inv_weight = 1.0f / weight_sum; // The center tap always contributes.
+					o[0] = sum[0] * inv_weight;
+					o[1] = sum[1] * inv_weight;
+					o[2] = sum[2] * inv_weight;
+				}
+			}
+		});
+		if (_is_bake_aborted()) {
+			return;
+		}
+		for (size_t i = 0; i < filtered.size(); i++) {
+			if (!filtered[i].empty()) {
+				p_lightmaps[i].color.swap(filtered[i]);
+			}
+		}
+		_report_progress(0.75f + 0.03f * (float)(iteration + 1) / (float)iterations, "Denoising lightmaps...", p_progress, p_userdata);
+	}
+	_track_bake_memory(-filtered_memory);
+}
+
+// Fills uncovered texels from their nearest covered texel. The nearest texel comes from an exact
+// Euclidean feature transform (Felzenszwalb & Huttenlocher, "Distance Transforms of Sampled
+// Functions"): a column sweep finds the nearest covered row per column, then each row takes the
+// lower envelope of the resulting parabolas. Both passes are linear, so the radius is free;
+// a negative radius fills every uncovered texel.
+void LightmapBaker::_dilate_lightmaps(std::vector<LightmapBuffer> &p_lightmaps, int p_dilation_radius) {
+	if (p_dilation_radius == 0) return;
+	_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_DILATION]);
+
+	const int worker_count = _get_worker_thread_count();
+	const int64_t max_dist_sq = p_dilation_radius < 0 ? std::numeric_limits<int64_t>::max() : (int64_t)p_dilation_radius * p_dilation_radius;
+	constexpr int COLUMN_STRIP = 64;
+
+	// Lightmaps are dilated one at a time, so the largest one sets the scratch memory.
+	int64_t scratch_memory = 0;
+	for (const LightmapBuffer &buf : p_lightmaps) {
+		scratch_memory = std::max(scratch_memory, (int64_t)buf.width * buf.height * (int64_t)sizeof(int));
+	}
+	_track_bake_memory(scratch_memory);
+
+	for (LightmapBuffer &buf : p_lightmaps) {
+		if (buf.is_empty()) continue;
+		const int w = buf.width;
+		const int h = buf.height;
+
+		// Pass 1: nearest covered row in each texel's column (-1 if the column is empty).
+		// Columns are swept in strips so each thread walks rows in memory order.
+		std::vector<int> nearest_row((size_t)w * (size_t)h, -1);
+		std::atomic<bool> any_covered{ false };
+		_lm_parallel_for((w + COLUMN_STRIP - 1) / COLUMN_STRIP, worker_count, [&](int p_strip) {
+			const int x_begin = p_strip * COLUMN_STRIP;
+			const int x_end = std::min(w, x_begin + COLUMN_STRIP);
+			int last[COLUMN_STRIP];
+			std::fill(last, last + COLUMN_STRIP, -1);
+			for (int y = 0; y < h; y++) {
+				int *row = &nearest_row[(size_t)y * (size_t)w];
+				for (int x = x_begin; x < x_end; x++) {
+					if (buf.is_covered(x, y)) {
+						last[x - x_begin] = y;
+					}
+					row[x] = last[x - x_begin];
+				}
+			}
+			std::fill(last, last + COLUMN_STRIP, -1);
+			for (int y = h - 1; y >= 0; y--) {
+				int *row = &nearest_row[(size_t)y * (size_t)w];
+				for (int x = x_begin; x < x_end; x++) {
+					int &below = last[x - x_begin];
+					if (row[x] == y) {
+						below = y;
+					} else if (below >= 0 && (row[x] < 0 || below - y < y - row[x])) {
+						row[x] = below;
+					}
+				}
+			}
+			for (int x = x_begin; x < x_end; x++) {
+				if (nearest_row[x] >= 0) {
+					any_covered.store(true, std::memory_order_relaxed);
+					break;
+				}
+			}
+		});
+		if (!any_covered.load()) continue;
+
+		// Pass 2: per row, the column q minimizing (x - q)^2 + dy(q)^2. Rows only write their own
+		// texels and coverage words, and only read covered texels, so they can run in place.
+		_lm_parallel_for(h, worker_count, [&](int y) {
+			const int *row = &nearest_row[(size_t)y * (size_t)w];
+			thread_local std::vector<int> hull;
+			thread_local std::vector<double> bounds;
+			hull.resize((size_t)w);
+			bounds.resize((size_t)w + 1);
+
+			auto cost = [&](int q) -> int64_t {
+				const int64_t dy = (int64_t)(y - row[q]);
+				return dy * dy;
+			};
+			int k = -1;
+			for (int q = 0; q < w; q++) {
+				if (row[q] < 0) continue;
+				const double fq = (double)cost(q) + (double)q * q;
+				double s = -std::numeric_limits<double>::infinity();
+				while (k >= 0) {
+					const int v = hull[(size_t)k];
+					s = (fq - ((double)cost(v) + (double)v * v)) / (2.0 * (q - v));
+					if (s > bounds[(size_t)k]) break;
+					k--;
+				}
+				k++;
+				hull[(size_t)k] = q;
+				bounds[(size_t)k] = k == 0 ? -std::numeric_limits<double>::infinity() : s;
+				bounds[(size_t)k + 1] = std::numeric_limits<double>::infinity();
+			}
+			if (k < 0) return; // Unreachable once any column has coverage.
+
+			int j = 0;
+			for (int x = 0; x < w; x++) {
+				while (bounds[(size_t)j + 1] < (double)x) j++;
+				if (buf.is_covered(x, y)) continue;
+				const int q = hull[(size_t)j];
+				const int64_t dx = (int64_t)(x - q);
+				if (dx * dx + cost(q) > max_dist_sq) continue;
+				const float *c = buf.texel(q, row[q]);
+				buf.set_texel(x, y, c[0], c[1], c[2]);
+				buf.set_covered(x, y);
+			}
+		});
+	}
+	_track_bake_memory(-scratch_memory);
+}
+
+// Texture management
+bool LightmapBuffer::create(int p_width, int p_height) {
+	width = 0;
+	height = 0;
+	coverage_stride = 0;
+	color.clear();
+	coverage.clear();
+	if (p_width <= 0 || p_height <= 0) {
+		return false;
+	}
+	width = p_width;
+	height = p_height;
+	coverage_stride = (p_width + 63) / 64;
+	color.assign((size_t)p_width * (size_t)p_height * 3, 0.0f);
+	coverage.assign((size_t)coverage_stride * (size_t)p_height, 0);
+	return true;
+}
+
+// MaxRects bin (Jukka Jylänki, "A Thousand Ways to Pack the Bin"): keeps the maximal free
+// rectangles of one atlas slice and places items with the best short side fit.
+struct _LM_MaxRectsBin {
+	struct Rect {
+		int x = 0;
+		int y = 0;
+		int w = 0;
+		int h = 0;
+	};
+
+	std::vector<Rect> free_rects;
+
+	explicit _LM_MaxRectsBin(int p_size) {
+		free_rects.push_back(Rect{ 0, 0, p_size, p_size });
+	}
+
+	bool find(int p_w, int p_h, Rect &r_rect, int &r_short_fit, int &r_long_fit) const {
+		bool found = false;
+		for (const Rect &fr : free_rects) {
+			if (fr.w < p_w || fr.h < p_h) {
+				continue;
+			}
+			const int leftover_w = fr.w - p_w;
+			const int leftover_h = fr.h - p_h;
+			const int short_fit = std::min(leftover_w, leftover_h);
+			const int long_fit = std::max(leftover_w, leftover_h);
+			if (!found || short_fit < r_short_fit || (short_fit == r_short_fit && long_fit < r_long_fit)) {
+				r_rect = Rect{ fr.x, fr.y, p_w, p_h };
+				r_short_fit = short_fit;
+				r_long_fit = long_fit;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	void place(const Rect &p_used) {
+		std::vector<Rect> split;
+		for (size_t i = 0; i < free_rects.size();) {
+			const Rect fr = free_rects[i];
+			if (p_used.x >= fr.x + fr.w || p_used.x + p_used.w <= fr.x || p_used.y >= fr.y + fr.h || p_used.y + p_used.h <= fr.y) {
+				i++;
+				continue;
+			}
+			// Replace the overlapped free rect by the (up to four) maximal rects around the used one.
+			if (p_used.x > fr.x) {
+				split.push_back(Rect{ fr.x, fr.y, p_used.x - fr.x, fr.h });
+			}
+			if (p_used.x + p_used.w < fr.x + fr.w) {
+				split.push_back(Rect{ p_used.x + p_used.w, fr.y, fr.x + fr.w - (p_used.x + p_used.w), fr.h });
+			}
+			if (p_used.y > fr.y) {
+				split.push_back(Rect{ fr.x, fr.y, fr.w, p_used.y - fr.y });
+			}
+			if (p_used.y + p_used.h < fr.y + fr.h) {
+				split.push_back(Rect{ fr.x, p_used.y + p_used.h, fr.w, fr.y + fr.h - (p_used.y + p_used.h) });
+			}
+			free_rects[i] = free_rects.back();
+			free_rects.pop_back();
+		}
+		free_rects.insert(free_rects.end(), split.begin(), split.end());
+
+		// Drop free rects contained in another one.
+		auto contains = [](const Rect &a, const Rect &b) {
+			return b.x >= a.x && b.y >= a.y && b.x + b.w <= a.x + a.w && b.y + b.h <= a.y + a.h;
+		};
+		for (size_t i = 0; i < free_rects.size(); i++) {
+			for (size_t j = i + 1; j < free_rects.size();) {
+				if (contains(free_rects[i], free_rects[j])) {
+					free_rects[j] = free_rects.back();
+					free_rects.pop_back();
+				} else if (contains(free_rects[j], free_rects[i])) {
+					free_rects[i] = free_rects[j];
+					free_rects[j] = free_rects.back();
+					free_rects.pop_back();
+					j = i + 1;
+				} else {
+					j++;
+				}
+			}
+		}
+	}
+};
+
+int LightmapBaker::_pack_lightmaps_to_atlas(std::vector<MeshData> &p_meshes, const std::vector<LightmapBuffer> &p_lightmaps, int p_atlas_size, int p_padding) {
+	_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_PACKING]);
+	atlas_occupancy = 0.0f;
+	if (p_meshes.empty() || p_lightmaps.empty() || p_meshes.size() != p_lightmaps.size()) {
+		return 0;
+	}
+	if (p_atlas_size <= 0) {
+		return 0;
+	}
+
+	struct Item {
+		int idx = -1;
+		int w = 0;
+		int h = 0;
+	};
+
+	std::vector<Item> items;
+	items.resize(p_lightmaps.size());
+	for (size_t i = 0; i < p_lightmaps.size(); i++) {
+		const LightmapBuffer &buf = p_lightmaps[i];
+		if (buf.is_empty()) {
+			return 0;
+		}
+		Item &it = items[i];
+		it.idx = (int)i;
+		it.w = buf.width + p_padding * 2;
+		it.h = buf.height + p_padding * 2;
+		if (it.w > p_atlas_size || it.h > p_atlas_size) {
+			return 0;
+		}
+	}
 
 	Vector2 inv_atlas = Vector2(1.0f / (float)p_atlas_size, 1.0f / (float)p_atlas_size);
-	for (int i = 0; i < p_lightmaps.size(); i++) {
-		Ref<Image> src = p_lightmaps[i];
-		const Placement &pl = placement[i];
-		Ref<Image> dst = atlas_layers[pl.slice];
-		if (src.is_null() || src->is_empty() || dst.is_null() || dst->is_empty()) {
+	auto assign = [&](const Item &p_item, int p_slice, int p_x, int p_y) {
+		const LightmapBuffer &buf = p_lightmaps[(size_t)p_item.idx];
+		MeshData &md = p_meshes[(size_t)p_item.idx];
+		md.lightmap_slice = p_slice;
+		md.lightmap_atlas_offset = Vector2i(p_x + p_padding, p_y + p_padding);
+		Vector2 uv_offset = Vector2((float)md.lightmap_atlas_offset.x, (float)md.lightmap_atlas_offset.y) * inv_atlas;
+		Vector2 uv_scale = Vector2((float)buf.width, (float)buf.height) * inv_atlas;
+		md.lightmap_uv_scale = Rect2(uv_offset, uv_scale);
+	};
+
+	int slice_count = 0;
+	if (atlas_packer == ATLAS_PACKER_SHELF) {
+		// Sort by height (simple shelf packer works better).
+		std::stable_sort(items.begin(), items.end(), [](const Item &a, const Item &b) {
+			return a.h > b.h;
+		});
+
+		int slice = 0;
+		int x = 0;
+		int y = 0;
+		int shelf_h = 0;
+		for (const Item &it : items) {
+			if (x + it.w > p_atlas_size) {
+				y += shelf_h;
+				x = 0;
+				shelf_h = 0;
+			}
+			if (y + it.h > p_atlas_size) {
+				slice++;
+				x = 0;
+				y = 0;
+				shelf_h = 0;
+			}
+			assign(it, slice, x, y);
+			x += it.w;
+			shelf_h = std::max(shelf_h, it.h);
+		}
+		slice_count = slice + 1;
+	} else {
+		// Big and elongated items first; each goes into the first slice with room for it.
+		std::stable_sort(items.begin(), items.end(), [](const Item &a, const Item &b) {
+			const int a_side = std::max(a.w, a.h);
+			const int b_side = std::max(b.w, b.h);
+			if (a_side != b_side) {
+				return a_side > b_side;
+			}
+			return a.w * a.h > b.w * b.h;
+		});
+
+		std::vector<_LM_MaxRectsBin> bins;
+		for (const Item &it : items) {
+			_LM_MaxRectsBin::Rect rect;
+			int slice = -1;
+			for (size_t b = 0; b < bins.size() && slice < 0; b++) {
+				int short_fit = 0;
+				int long_fit = 0;
+				if (bins[b].find(it.w, it.h, rect, short_fit, long_fit)) {
+					slice = (int)b;
+				}
+			}
+			if (slice < 0) {
+				bins.emplace_back(p_atlas_size);
+				slice = (int)bins.size() - 1;
+				rect = _LM_MaxRectsBin::Rect{ 0, 0, it.w, it.h };
+			}
+			bins[(size_t)slice].place(rect);
+			assign(it, slice, rect.x, rect.y);
+		}
+		slice_count = (int)bins.size();
+	}
+
+	uint64_t used_texels = 0;
+	for (const LightmapBuffer &buf : p_lightmaps) {
+		used_texels += (uint64_t)buf.width * (uint64_t)buf.height;
+	}
+	atlas_occupancy = (float)((double)used_texels / ((double)slice_count * (double)p_atlas_size * (double)p_atlas_size));
+	return slice_count;
+}
+
+// Writes one surface's texels into half-float RGB (or RGBE9995) layer data at its atlas offset.
+// Returns false if the surface doesn't fit inside the layer.
+static bool _lm_blit_to_layer(const LightmapBuffer &p_src, const Vector2i &p_pos, int p_atlas_size, bool p_shared_exponent, uint8_t *p_dst) {
+	if (p_pos.x < 0 || p_pos.y < 0 || p_pos.x + p_src.width > p_atlas_size || p_pos.y + p_src.height > p_atlas_size) {
+		return false;
+	}
+	const size_t texel_bytes = p_shared_exponent ? sizeof(uint32_t) : sizeof(uint16_t) * 3;
+	for (int y = 0; y < p_src.height; y++) {
+		uint8_t *row = p_dst + ((size_t)(p_pos.y + y) * p_atlas_size + p_pos.x) * texel_bytes;
+		const float *texels = p_src.texel(0, y);
+		if (p_shared_exponent) {
+			uint32_t *out = (uint32_t *)row;
+			for (int x = 0; x < p_src.width; x++) {
+				out[x] = _lm_float_to_rgbe9995(texels[x * 3 + 0], texels[x * 3 + 1], texels[x * 3 + 2]);
+			}
+		} else {
+			uint16_t *out = (uint16_t *)row;
+			for (int k = 0; k < p_src.width * 3; k++) {
+				out[k] = _lm_float_to_half(texels[k]);
+			}
+		}
+	}
+	return true;
+}
+
+LightmapBaker::OutputFormat LightmapBaker::_resolve_output_format(int p_atlas_size) const {
+	if (output_format == OUTPUT_FORMAT_BC6H && (!output_bc6h_supported || (p_atlas_size % 4) != 0)) {
+		UtilityFunctions::push_warning("LightmapBaker: BC6H output is not supported by the rendering device (or the atlas size is not a multiple of 4); writing RGBH instead");
+		return OUTPUT_FORMAT_RGBH;
+	}
+	return output_format;
+}
+
+Ref<Image> LightmapBaker::_finish_atlas_layer(PackedByteArray &p_data, int p_atlas_size, OutputFormat p_format, int p_slice) {
+	Image::Format image_format = p_format == OUTPUT_FORMAT_RGBE9995 ? Image::FORMAT_RGBE9995 : Image::FORMAT_RGBH;
+	if (p_format == OUTPUT_FORMAT_BC6H) {
+		// 16 bytes per 4x4 block; each row of blocks is encoded independently.
+		const int blocks = p_atlas_size / 4;
+		PackedByteArray compressed;
+		compressed.resize((int64_t)blocks * blocks * 16);
+		uint8_t *block_dst = compressed.ptrw();
+		const uint16_t *halves = (const uint16_t *)p_data.ptr();
+		_track_bake_memory(compressed.size());
+		_lm_parallel_for(blocks, _get_worker_thread_count(), [&](int p_block_row) {
+			for (int bx = 0; bx < blocks; bx++) {
+				const uint16_t *rows[4];
+				for (int y = 0; y < 4; y++) {
+					rows[y] = halves + ((size_t)(p_block_row * 4 + y) * p_atlas_size + (size_t)bx * 4) * 3;
+				}
+				_lm_encode_bc6h_block(rows, block_dst + ((size_t)p_block_row * blocks + bx) * 16);
+			}
+		});
+		_track_bake_memory(-p_data.size());
+		p_data = compressed;
+		image_format = Image::FORMAT_BPTC_RGBFU;
+	}
+
+	Ref<Image> layer = Image::create_from_data(p_atlas_size, p_atlas_size, false, image_format, p_data);
+	if (layer.is_null() || layer->is_empty()) {
+		UtilityFunctions::push_error("LightmapBaker: failed to create atlas layer " + String::num_int64(p_slice) + " (" + String::num_int64(p_atlas_size) + "x" + String::num_int64(p_atlas_size) + ")");
+		return Ref<Image>();
+	}
+	return layer;
+}
+
+Vector<Ref<Image>> LightmapBaker::_create_atlas_layers(const std::vector<MeshData> &p_meshes, const std::vector<LightmapBuffer> &p_lightmaps, int p_atlas_size, int p_slice_count) {
+	Vector<Ref<Image>> atlas_layers;
+	if (p_slice_count <= 0 || p_atlas_size <= 0 || p_meshes.size() != p_lightmaps.size()) {
+		return atlas_layers;
+	}
+	_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_ATLAS_LAYERS]);
+
+	// Surfaces are written straight into half-float RGB (or RGBE9995) layer data; this is the
+	// only place where bake results cross over into Image. BC6H blocks are encoded from the
+	// half-float data afterwards.
+	const OutputFormat format = _resolve_output_format(p_atlas_size);
+	const bool shared_exponent = format == OUTPUT_FORMAT_RGBE9995;
+	const size_t texel_bytes = shared_exponent ? sizeof(uint32_t) : sizeof(uint16_t) * 3;
+	atlas_layers.resize(p_slice_count);
+	for (int s = 0; s < p_slice_count; s++) {
+		PackedByteArray data;
+		data.resize((int64_t)p_atlas_size * p_atlas_size * (int64_t)texel_bytes);
+		uint8_t *dst = data.ptrw();
+		memset(dst, 0, (size_t)data.size());
+		_track_bake_memory(data.size());
+
+		std::vector<int> surfaces;
+		for (size_t i = 0; i < p_meshes.size(); i++) {
+			if (p_meshes[i].lightmap_slice == s && !p_lightmaps[i].is_empty()) {
+				surfaces.push_back((int)i);
+			}
+		}
+
+		std::atomic<bool> out_of_bounds{ false };
+		_lm_parallel_for((int)surfaces.size(), _get_worker_thread_count(), [&](int p_index) {
+			const int i = surfaces[(size_t)p_index];
+			if (!_lm_blit_to_layer(p_lightmaps[(size_t)i], p_meshes[(size_t)i].lightmap_atlas_offset, p_atlas_size, shared_exponent, dst)) {
+				out_of_bounds.store(true);
+			}
+		});
+		if (out_of_bounds.load()) {
+			UtilityFunctions::push_warning("LightmapBaker: atlas blit out of bounds on slice " + String::num_int64(s));
+		}
+
+		Ref<Image> layer = _finish_atlas_layer(data, p_atlas_size, format, s);
+		if (layer.is_null()) {
 			return Vector<Ref<Image>>();
 		}
-		Vector2i ssize = src->get_size();
-		if (ssize.x <= 0 || ssize.y <= 0) {
-			return Vector<Ref<Image>>();
+		atlas_layers.set(s, layer);
+	}
+
+	return atlas_layers;
+}
+
+LightmapBaker::BakeError LightmapBaker::_bake_streaming(const std::vector<Vector2i> &p_sizes, const std::vector<std::vector<uint32_t>> &p_mesh_lights, int p_atlas_size, int p_padding, BakeProgressFunc p_progress, void *p_userdata) {
+	// The incremental cache keeps every surface at full resolution, which is what this mode avoids.
+	if (use_bake_cache) {
+		UtilityFunctions::push_warning("LightmapBaker: the bake cache isn't used when max_memory_mb is set; cached surfaces were dropped");
+	}
+	bake_cache.clear();
+	const size_t surface_count = gathered_meshes.size();
+
+	// Placements only need the surface sizes, so pack before anything is allocated.
+	_report_progress(0.2f, "Packing lightmaps into atlases...", p_progress, p_userdata);
+	int slice_count = 0;
+	{
+		std::vector<LightmapBuffer> sizes(surface_count);
+		for (size_t i = 0; i < surface_count; i++) {
+			sizes[i].width = p_sizes[i].x;
+			sizes[i].height = p_sizes[i].y;
+		}
+		slice_count = _pack_lightmaps_to_atlas(gathered_meshes, sizes, p_atlas_size, p_padding);
+	}
+	if (slice_count <= 0) {
+		return BAKE_ERROR_ATLAS_TOO_SMALL;
+	}
+
+	const OutputFormat format = _resolve_output_format(p_atlas_size);
+	const bool shared_exponent = format == OUTPUT_FORMAT_RGBE9995;
+	const int64_t texel_bytes = shared_exponent ? (int64_t)sizeof(uint32_t) : (int64_t)sizeof(uint16_t) * 3;
+	const int64_t layer_texels = (int64_t)p_atlas_size * p_atlas_size;
+	// BC6H encodes into a second buffer of one byte per texel.
+	const int64_t layer_bytes = layer_texels * (texel_bytes + (format == OUTPUT_FORMAT_BC6H ? 1 : 0));
+
+	// Whatever the BVH, the bake geometry and the layer being written leave of the budget goes to proxies and tiles.
+	int64_t remaining = (int64_t)max_memory_mb * 1024 * 1024 - layer_bytes - (ray_bvh ? (int64_t)ray_bvh->get_memory_usage() : 0) - (int64_t)bake_geometry.get_memory_usage();
+	if (remaining <= 0) {
+		UtilityFunctions::push_warning("LightmapBaker: max_memory_mb is too small for the ray BVH and one atlas layer; baking one surface at a time");
+		remaining = 0;
+	}
+
+	int64_t total_texels = 0;
+	for (const Vector2i &size : p_sizes) {
+		total_texels += (int64_t)size.x * size.y;
+	}
+
+	// Indirect light: bounces need the whole scene's radiance at once, so they run on proxies
+	// downsampled until they take at most half of the remaining budget, and are upsampled into
+	// every tile below.
+	std::vector<LightmapBuffer> proxies;
+	if (bounces > 0) {
+		int factor = 1;
+		while (factor < LM_STREAM_MAX_PROXY_FACTOR && (total_texels / ((int64_t)factor * factor)) * LM_STREAM_PROXY_TEXEL_BYTES > remaining / 2) {
+			factor *= 2;
+		}
+
+		proxies.resize(surface_count);
+		std::vector<LightmapGuide> guides(surface_count);
+		std::vector<int> surfaces(surface_count);
+		int64_t proxy_texels = 0;
+		for (size_t i = 0; i < surface_count; i++) {
+			const int w = std::max(1, (p_sizes[i].x + factor - 1) / factor);
+			const int h = std::max(1, (p_sizes[i].y + factor - 1) / factor);
+			if (!proxies[i].create(w, h)) {
+				UtilityFunctions::push_error("LightmapBaker: failed to allocate lightmap buffer (" + String::num_int64(w) + "x" + String::num_int64(h) + ")");
+				return BAKE_ERROR_CANT_CREATE_IMAGE;
+			}
+			guides[i].create(w, h);
+			surfaces[i] = (int)i;
+			proxy_texels += (int64_t)w * h;
+		}
+		_track_bake_memory(_lm_lightmap_memory(proxies) + _lm_guide_memory(guides));
+
+		_rasterize_surfaces(surfaces, p_mesh_lights, proxies, &guides, 0.3f, 0.6f, p_progress, p_userdata);
+		if (_is_bake_aborted()) {
+			return BAKE_ERROR_USER_ABORTED;
+		}
+
+		std::vector<std::vector<float>> direct(surface_count);
+		for (size_t i = 0; i < surface_count; i++) {
+			direct[i] = proxies[i].color;
+		}
+		const int64_t direct_memory = proxy_texels * (int64_t)(sizeof(float) * 3);
+		_track_bake_memory(direct_memory);
+		_report_progress(0.65f, "Baking indirect lighting...", p_progress, p_userdata);
+		BakeError error = _bake_indirect_light(proxies, guides, p_progress, p_userdata);
+		if (error == BAKE_ERROR_USER_ABORTED) {
+			return error;
+		}
+		if (error != BAKE_ERROR_OK) {
+			UtilityFunctions::push_warning("Indirect pass failed, using direct lighting only");
+			proxies.clear();
+		} else {
+			// Keep only the indirect part; tiles rasterize their own full-resolution direct light.
+			_lm_parallel_for((int)surface_count, _get_worker_thread_count(), [&](int p_index) {
+				std::vector<float> &color = proxies[(size_t)p_index].color;
+				const std::vector<float> &d = direct[(size_t)p_index];
+				for (size_t k = 0; k < color.size(); k++) {
+					color[k] -= d[k];
+				}
+			});
+			remaining = std::max<int64_t>(0, remaining - proxy_texels * (int64_t)(sizeof(float) * 3));
+		}
+		_track_bake_memory(-direct_memory - _lm_guide_memory(guides));
+	}
+
+	const int64_t tile_texel_bytes = LM_STREAM_TEXEL_BYTES + (use_denoiser ? LM_STREAM_DENOISE_TEXEL_BYTES : 0);
+	const float tile_progress_from = bounces > 0 ? 0.75f : 0.3f;
+	int64_t done_texels = 0;
+
+	_clear_spilled_layers();
+	baked_layers.resize(slice_count);
+	spilled_layers.assign((size_t)slice_count, String());
+	for (int s = 0; s < slice_count; s++) {
+		PackedByteArray data;
+		data.resize(layer_texels * texel_bytes);
+		uint8_t *dst = data.ptrw();
+		memset(dst, 0, (size_t)data.size());
+		_track_bake_memory(data.size());
+
+		std::vector<int> slice_surfaces;
+		for (size_t i = 0; i < surface_count; i++) {
+			if (gathered_meshes[i].lightmap_slice == s) {
+				slice_surfaces.push_back((int)i);
+			}
+		}
+
+		// Tiles: consecutive surfaces of the slice whose buffers fit the remaining budget together
+		// (a surface larger than the budget becomes a tile of its own).
+		size_t next = 0;
+		while (next < slice_surfaces.size()) {
+			std::vector<int> tile;
+			int64_t tile_bytes = 0;
+			while (next < slice_surfaces.size()) {
+				const Vector2i size = p_sizes[(size_t)slice_surfaces[next]];
+				const int64_t bytes = (int64_t)size.x * size.y * tile_texel_bytes;
+				if (!tile.empty() && tile_bytes + bytes > remaining) {
+					break;
+				}
+				tile.push_back(slice_surfaces[next++]);
+				tile_bytes += bytes;
+			}
+
+			std::vector<LightmapBuffer> lightmaps(surface_count);
+			std::vector<LightmapGuide> guides;
+			if (use_denoiser) {
+				guides.resize(surface_count);
+			}
+			for (int i : tile) {
+				const int w = p_sizes[(size_t)i].x;
+				const int h = p_sizes[(size_t)i].y;
+				if (!lightmaps[(size_t)i].create(w, h)) {
+					UtilityFunctions::push_error("LightmapBaker: failed to allocate lightmap buffer (" + String::num_int64(w) + "x" + String::num_int64(h) + ")");
+					return BAKE_ERROR_CANT_CREATE_IMAGE;
+				}
+				if (use_denoiser) {
+					guides[(size_t)i].create(w, h);
+				}
+			}
+			const int64_t tile_memory = _lm_lightmap_memory(lightmaps) + _lm_guide_memory(guides);
+			_track_bake_memory(tile_memory);
+
+			_rasterize_surfaces(tile, p_mesh_lights, lightmaps, use_denoiser ? &guides : nullptr, 0.0f, 0.0f, nullptr, nullptr);
+			if (_is_bake_aborted()) {
+				return BAKE_ERROR_USER_ABORTED;
+			}
+			if (!proxies.empty()) {
+				_lm_parallel_for((int)tile.size(), _get_worker_thread_count(), [&](int p_index) {
+					const size_t i = (size_t)tile[(size_t)p_index];
+					_lm_add_upsampled(lightmaps[i], proxies[i]);
+				});
+			}
+			if (use_denoiser) {
+				_denoise_lightmaps(lightmaps, guides);
+				guides.clear();
+				if (_is_bake_aborted()) {
+					return BAKE_ERROR_USER_ABORTED;
+				}
+			}
+			_dilate_lightmaps(lightmaps, seam_dilation_fill ? -1 : std::max(0, seam_dilation_radius));
+
+			_LM_StageTimer blit_timer(bake_stats.stage_usec[BAKE_STAGE_ATLAS_LAYERS]);
+			std::atomic<bool> out_of_bounds{ false };
+			_lm_parallel_for((int)tile.size(), _get_worker_thread_count(), [&](int p_index) {
+				const size_t i = (size_t)tile[(size_t)p_index];
+				if (!_lm_blit_to_layer(lightmaps[i], gathered_meshes[i].lightmap_atlas_offset, p_atlas_size, shared_exponent, dst)) {
+					out_of_bounds.store(true);
+				}
+			});
+			if (out_of_bounds.load()) {
+				UtilityFunctions::push_warning("LightmapBaker: atlas blit out of bounds on slice " + String::num_int64(s));
+			}
+			_track_bake_memory(-tile_memory);
+			for (int i : tile) {
+				done_texels += (int64_t)p_sizes[(size_t)i].x * p_sizes[(size_t)i].y;
+			}
+			_report_progress(tile_progress_from + (0.9f - tile_progress_from) * (float)((double)done_texels / (double)std::max<int64_t>(1, total_texels)), "Baking atlas tiles...", p_progress, p_userdata);
+		}
+
+		_LM_StageTimer layer_timer(bake_stats.stage_usec[BAKE_STAGE_ATLAS_LAYERS]);
+		Ref<Image> layer = _finish_atlas_layer(data, p_atlas_size, format, s);
+		if (layer.is_null()) {
+			return BAKE_ERROR_CANT_CREATE_IMAGE;
+		}
+		const int64_t layer_memory = data.size();
+		data = PackedByteArray();
+		// Finished layers wait on disk for _finish_bake(); one that can't be written stays in memory.
+		String path;
+		if (_spill_atlas_layer(layer, s, path)) {
+			spilled_layers[(size_t)s] = path;
+			_track_bake_memory(-layer_memory);
+		} else {
+			UtilityFunctions::push_warning("LightmapBaker: can't spill atlas layer " + String::num_int64(s) + " to " + path + "; keeping it in memory");
+			baked_layers.set(s, layer);
+		}
+	}
+	return BAKE_ERROR_OK;
+}
+
+bool LightmapBaker::_spill_atlas_layer(const Ref<Image> &p_layer, int p_slice, String &r_path) const {
+	const String dir = LM_STREAM_SPILL_DIR;
+	r_path = dir.path_join(String::num_uint64(get_instance_id()) + "_" + String::num_int64(p_slice) + ".layer");
+	DirAccess::make_dir_recursive_absolute(dir);
+	Ref<FileAccess> file = FileAccess::open(r_path, FileAccess::WRITE);
+	if (file.is_null()) {
+		return false;
+	}
+	const PackedByteArray data = p_layer->get_data();
+	PackedByteArray header;
+	_lm_append_value(header, LM_STREAM_SPILL_MAGIC);
+	_lm_append_value(header, (uint32_t)p_layer->get_format());
+	_lm_append_value(header, (int32_t)p_layer->get_width());
+	_lm_append_value(header, (int32_t)p_layer->get_height());
+	_lm_append_value(header, (uint64_t)data.size());
+	file->store_buffer(header);
+	file->store_buffer(data);
+	const bool ok = file->get_error() == OK;
+	file->close();
+	return ok;
+}
+
+Ref<Image> LightmapBaker::_load_spilled_layer(const String &p_path) const {
+	const PackedByteArray bytes = FileAccess::get_file_as_bytes(p_path);
+	_LM_ByteReader reader;
+	reader.data = bytes.ptr();
+	reader.size = (size_t)bytes.size();
+
+	uint32_t magic = 0;
+	uint32_t format = 0;
+	int32_t width = 0;
+	int32_t height = 0;
+	uint64_t size = 0;
+	if (!reader.read_value(magic) || magic != LM_STREAM_SPILL_MAGIC || !reader.read_value(format) || !reader.read_value(width) || !reader.read_value(height) || !reader.read_value(size) || size != reader.size - reader.pos) {
+		return Ref<Image>();
+	}
+	PackedByteArray data;
+	data.resize((int64_t)size);
+	reader.read(data.ptrw(), (size_t)size);
+	return Image::create_from_data(width, height, false, (Image::Format)format, data);
+}
+
+void LightmapBaker::_clear_spilled_layers() {
+	for (const String &path : spilled_layers) {
+		if (!path.is_empty()) {
+			DirAccess::remove_absolute(ProjectSettings::get_singleton()->globalize_path(path));
+		}
+	}
+	spilled_layers.clear();
+}
+
+// Utility
+int LightmapBaker::_get_worker_thread_count() const {
+	if (thread_count > 0) {
+		return thread_count;
+	}
+	return _lm_get_processor_count();
+}
+
+bool LightmapBaker::_reject_while_baking(const char *p_method) const {
+	if (!bake_running.load()) {
+		return false;
+	}
+	UtilityFunctions::push_error(String("LightmapBaker: ") + p_method + "() can't be called while a bake is running");
+	return true;
+}
+
+void LightmapBaker::_report_progress(float p_progress, const String &p_status, BakeProgressFunc p_callback, void *p_userdata) {
+	if (p_callback != nullptr) {
+		p_callback(p_progress, p_status, p_userdata);
+	}
+}
+
+int64_t LightmapBaker::_get_bake_cache_memory() const {
+	int64_t bytes = 0;
+	for (const std::pair<const uint64_t, BakeCacheEntry> &entry : bake_cache) {
+		const LightmapBuffer &buf = entry.second.lightmap;
+		const LightmapGuide &guide = entry.second.guide;
+		bytes += (int64_t)(buf.color.capacity() * sizeof(float) + buf.coverage.capacity() * sizeof(uint64_t));
+		bytes += (int64_t)((guide.position.capacity() + guide.normal.capacity()) * sizeof(Vector3));
+	}
+	return bytes;
+}
+
+void LightmapBaker::_track_bake_memory(int64_t p_delta) {
+	bake_stats.memory += p_delta;
+	bake_stats.peak_memory = std::max(bake_stats.peak_memory, bake_stats.memory);
+}
+
+Ref<Texture2DArray> LightmapBaker::_create_texture_array_from_images(const Vector<Ref<Image>> &p_layers) {
+	if (p_layers.is_empty()) {
+		return Ref<Texture2DArray>();
+	}
+	if (p_layers[0].is_null() || p_layers[0]->is_empty()) {
+		return Ref<Texture2DArray>();
+	}
+	const Vector2i expected_size = p_layers[0]->get_size();
+	const Image::Format expected_format = p_layers[0]->get_format();
+	if (expected_size.x <= 0 || expected_size.y <= 0) {
+		return Ref<Texture2DArray>();
+	}
+
+	TypedArray<Ref<Image>> images;
+	images.resize(p_layers.size());
+	for (int i = 0; i < p_layers.size(); i++) {
+		if (p_layers[i].is_null() || p_layers[i]->is_empty()) {
+			UtilityFunctions::push_error("LightmapBaker: Texture2DArray layer is null/empty at index " + String::num_int64(i));
+			return Ref<Texture2DArray>();
+		}
+		if (p_layers[i]->get_size() != expected_size) {
+			UtilityFunctions::push_error("LightmapBaker: Texture2DArray layer size mismatch at index " + String::num_int64(i));
+			return Ref<Texture2DArray>();
+		}
+		if (p_layers[i]->get_format() != expected_format) {
+			UtilityFunctions::push_error("LightmapBaker: Texture2DArray layer format mismatch at index " + String::num_int64(i));
+			return Ref<Texture2DArray>();
+		}
+		images[i] = p_layers[i];
+	}
+
+	Ref<Texture2DArray> tex;
+	tex.instantiate();
+	Error err = tex->create_from_images(images);
+	if (err != OK) {
+		UtilityFunctions::push_error("LightmapBaker: Texture2DArray::create_from_images failed (err=" + String::num_int64((int64_t)err) + ")");
+		return Ref<Texture2DArray>();
+	}
+	return tex;
+}
+
+void LightmapBaker::_write_output_data(Ref<LightmapGIData> p_output_data, const Ref<Texture2DArray> &p_tex_array) {
+	TypedArray<Ref<TextureLayered>> textures;
+	textures.resize(1);
+	textures[0] = p_tex_array;
+	p_output_data->set_lightmap_textures(textures);
+	p_output_data->set_light_texture(p_tex_array);
+	p_output_data->set_uses_spherical_harmonics(false);
+
+	p_output_data->clear_users();
+	for (size_t i = 0; i < gathered_meshes.size(); i++) {
+		const MeshData &md = gathered_meshes[i];
+		if (md.owner_node == nullptr) {
+			continue;
+		}
+		p_output_data->add_user(md.owner_node->get_path(), md.lightmap_uv_scale, md.lightmap_slice, md.sub_instance);
+	}
+}
+
+static inline float _edge_function(const Vector2 &a, const Vector2 &b, const Vector2 &c) {
+	return (c.x - a.x) * (b.y - a.y) - (c.y - a.y) * (b.x - a.x);
+}
+
+Color LightmapBaker::_get_surface_albedo(const MeshData &p_mesh) const {
+	return use_material_albedo ? p_mesh.albedo : Color(1, 1, 1, 1);
+}
+
+void LightmapBaker::_rasterize_mesh_direct_lighting(int p_surface, const std::vector<uint32_t> &p_lights, LightmapBuffer &r_target, LightmapGuide *r_guide, LightmapEdgeInfo *r_edges, int p_row_begin, int p_row_end, bool p_supersample) {
+	const int w = r_target.width;
+	const int h = r_target.height;
+	const int row_begin = std::max(0, p_row_begin);
+	const int row_end = std::min(h, p_row_end);
+	if (row_begin >= row_end || (p_supersample && r_edges == nullptr)) {
+		return;
+	}
+
+	const Color surface_albedo = _get_surface_albedo(gathered_meshes[(size_t)p_surface]);
+
+	const uint32_t triangle_begin = bake_geometry.surface_first_triangle[(size_t)p_surface];
+	const uint32_t triangle_end = bake_geometry.surface_first_triangle[(size_t)p_surface + 1];
+	if (triangle_begin == triangle_end) {
+		return;
+	}
+	const Vector3 *positions = bake_geometry.positions.data();
+	const Vector3 *normals = bake_geometry.normals.data();
+	const Vector2 *uv2s = bake_geometry.uv2s.data();
+	const uint32_t *indices = bake_geometry.indices.data();
+
+	// Surfaces reached by many lights (a long corridor lit by a row of torches) get their light
+	// list narrowed again per triangle.
+	const bool cull_per_triangle = p_lights.size() > LM_LIGHT_CULL_TRIANGLE_MIN_LIGHTS;
+	std::vector<uint32_t> triangle_lights;
+
+	// Supersampling pass: refine the covered texels of the band whose 4-neighbors were shaded from
+	// another triangle or see a different set of lights. The first pass has finished every band,
+	// so neighbors in other bands are final.
+	const int grid = std::max(2, (int)Math::round(Math::sqrt((float)supersample_count)));
+	const float inv_grid = 1.0f / (float)grid;
+	std::vector<uint8_t> refine;
+	std::vector<float> refine_sum; // Lighting summed over the sub-samples, RGB.
+	std::vector<int> refine_count;
+	if (p_supersample) {
+		const size_t band_size = (size_t)(row_end - row_begin) * (size_t)w;
+		refine.assign(band_size, 0);
+		bool any_refined = false;
+		for (int y = row_begin; y < row_end; y++) {
+			for (int x = 0; x < w; x++) {
+				const size_t index = (size_t)y * (size_t)w + (size_t)x;
+				const int32_t triangle = r_edges->triangle[index];
+				if (triangle < 0) {
+					continue;
+				}
+				const uint32_t visibility = r_edges->visibility[index];
+				static const int offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+				for (const int *offset : offsets) {
+					const int nx = x + offset[0];
+					const int ny = y + offset[1];
+					if (nx < 0 || ny < 0 || nx >= w || ny >= h) {
+						continue;
+					}
+					const size_t neighbor = (size_t)ny * (size_t)w + (size_t)nx;
+					if (r_edges->triangle[neighbor] >= 0 && (r_edges->triangle[neighbor] != triangle || r_edges->visibility[neighbor] != visibility)) {
+						refine[(size_t)(y - row_begin) * (size_t)w + (size_t)x] = 1;
+						any_refined = true;
+						break;
+					}
+				}
+			}
+		}
+		if (!any_refined) {
+			return;
+		}
+		refine_sum.assign(band_size * 3, 0.0f);
+		refine_count.assign(band_size, 0);
+	}
+	// Texel centers must fall inside the triangle; sub-samples only need to fall inside the texel.
+	const float reach_low = p_supersample ? 0.0f : 0.5f;
+	const float reach_high = p_supersample ? 1.0f : 0.5f;
+
+	auto sample_triangle = [&](uint32_t p_triangle) {
+		const uint32_t i0 = indices[(size_t)p_triangle * 3 + 0];
+		const uint32_t i1 = indices[(size_t)p_triangle * 3 + 1];
+		const uint32_t i2 = indices[(size_t)p_triangle * 3 + 2];
+		Vector2 uv0 = uv2s[i0];
+		Vector2 uv1 = uv2s[i1];
+		Vector2 uv2 = uv2s[i2];
+
+		Vector2 p0 = uv0 * Vector2((float)w, (float)h);
+		Vector2 p1 = uv1 * Vector2((float)w, (float)h);
+		Vector2 p2 = uv2 * Vector2((float)w, (float)h);
+
+		float area = _edge_function(p0, p1, p2);
+		if (Math::abs(area) < 1e-8f) {
+			return;
+		}
+		float inv_area = 1.0f / area;
+
+		int min_x = (int)Math::floor(std::min({ p0.x, p1.x, p2.x }));
+		int max_x = (int)Math::ceil(std::max({ p0.x, p1.x, p2.x }));
+		int min_y = (int)Math::floor(std::min({ p0.y, p1.y, p2.y }));
+		int max_y = (int)Math::ceil(std::max({ p0.y, p1.y, p2.y }));
+		min_x = std::clamp(min_x, 0, w - 1);
+		max_x = std::clamp(max_x, 0, w - 1);
+		min_y = std::clamp(min_y, row_begin, row_end - 1);
+		max_y = std::clamp(max_y, row_begin, row_end - 1);
+		if (min_y > max_y || (float)max_y + reach_high < std::min({ p0.y, p1.y, p2.y }) || (float)min_y + reach_low > std::max({ p0.y, p1.y, p2.y })) {
+			return;
+		}
+
+		const Vector3 &v0 = positions[i0];
+		const Vector3 &v1 = positions[i1];
+		const Vector3 &v2 = positions[i2];
+
+		const uint32_t *lights = p_lights.data();
+		int light_count = (int)p_lights.size();
+		if (cull_per_triangle) {
+			triangle_lights.clear();
+			const Vector3 tri_min(std::min({ v0.x, v1.x, v2.x }), std::min({ v0.y, v1.y, v2.y }), std::min({ v0.z, v1.z, v2.z }));
+			const Vector3 tri_max(std::max({ v0.x, v1.x, v2.x }), std::max({ v0.y, v1.y, v2.y }), std::max({ v0.z, v1.z, v2.z }));
+			_cull_lights(tri_min, tri_max, p_lights, triangle_lights);
+			lights = triangle_lights.data();
+			light_count = (int)triangle_lights.size();
 		}
-		dst->blit_rect(src, Rect2i(Vector2i(0, 0), ssize), pl.pos);
 
-		MeshData &md = p_meshes[(size_t)i];
-		md.lightmap_slice = pl.slice;
-		Vector2 uv_offset = Vector2((float)pl.pos.x, (float)pl.pos.y) * inv_atlas;
-		Vector2 uv_scale = Vector2((float)src->get_width(), (float)src->get_height()) * inv_atlas;
-		md.lightmap_uv_scale = Rect2(uv_offset, uv_scale);
+		const Vector3 &n0 = normals[i0];
+		const Vector3 &n1 = normals[i1];
+		const Vector3 &n2 = normals[i2];
+
+		if (p_supersample) {
+			for (int y = min_y; y <= max_y; y++) {
+				for (int x = min_x; x <= max_x; x++) {
+					const size_t band_index = (size_t)(y - row_begin) * (size_t)w + (size_t)x;
+					if (!refine[band_index]) {
+						continue;
+					}
+					for (int s = 0; s < grid * grid; s++) {
+						// One jittered sample per grid cell. The jitter only depends on the texel, so the
+						// result doesn't depend on the thread count.
+						const uint64_t jitter = _lm_mix64(((uint64_t)y << 40) ^ ((uint64_t)x << 16) ^ (uint64_t)s);
+						const float jx = (float)(jitter & 0xffff) * (1.0f / 65536.0f);
+						const float jy = (float)((jitter >> 16) & 0xffff) * (1.0f / 65536.0f);
+						Vector2 p((float)x + ((float)(s % grid) + jx) * inv_grid, (float)y + ((float)(s / grid) + jy) * inv_grid);
+						float w0 = _edge_function(p1, p2, p) * inv_area;
+						float w1 = _edge_function(p2, p0, p) * inv_area;
+						float w2 = _edge_function(p0, p1, p) * inv_area;
+						if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+							continue;
+						}
+						Vector3 world_pos = v0 * w0 + v1 * w1 + v2 * w2;
+						Vector3 world_nrm = (n0 * w0 + n1 * w1 + n2 * w2).normalized();
+						Color lit = _evaluate_direct_lighting(world_pos, world_nrm, lights, light_count);
+						refine_sum[band_index * 3 + 0] += lit.r;
+						refine_sum[band_index * 3 + 1] += lit.g;
+						refine_sum[band_index * 3 + 2] += lit.b;
+						refine_count[band_index]++;
+					}
+				}
+			}
+			return;
+		}
+
+		for (int y = min_y; y <= max_y; y++) {
+			for (int x = min_x; x <= max_x; x++) {
+				Vector2 p((float)x + 0.5f, (float)y + 0.5f);
+				float w0 = _edge_function(p1, p2, p) * inv_area;
+				float w1 = _edge_function(p2, p0, p) * inv_area;
+				float w2 = _edge_function(p0, p1, p) * inv_area;
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+					continue;
+				}
+				Vector3 world_pos = v0 * w0 + v1 * w1 + v2 * w2;
+				Vector3 world_nrm = (n0 * w0 + n1 * w1 + n2 * w2).normalized();
+				uint32_t visibility = 0;
+				Color lit = _evaluate_direct_lighting(world_pos, world_nrm, lights, light_count, r_edges != nullptr ? &visibility : nullptr);
+				r_target.set_texel(x, y, lit.r * surface_albedo.r, lit.g * surface_albedo.g, lit.b * surface_albedo.b);
+				r_target.set_covered(x, y);
+				const size_t index = (size_t)y * (size_t)w + (size_t)x;
+				if (r_guide != nullptr) {
+					r_guide->position[index] = world_pos;
+					r_guide->normal[index] = world_nrm;
+				}
+				if (r_edges != nullptr) {
+					r_edges->triangle[index] = (int32_t)p_triangle;
+					r_edges->visibility[index] = visibility;
+				}
+			}
+		}
+	};
+
+	for (uint32_t t = triangle_begin; t < triangle_end; t++) {
+		sample_triangle(t);
 	}
 
-	return atlas_layers;
+	if (p_supersample) {
+		// The texel center counts as one more sample.
+		for (int y = row_begin; y < row_end; y++) {
+			for (int x = 0; x < w; x++) {
+				const size_t band_index = (size_t)(y - row_begin) * (size_t)w + (size_t)x;
+				if (refine_count[band_index] == 0) {
+					continue;
+				}
+				float *c = r_target.texel(x, y);
+				const float inv_count = 1.0f / (float)(refine_count[band_index] + 1);
+				c[0] = (c[0] + refine_sum[band_index * 3 + 0] * surface_albedo.r) * inv_count;
+				c[1] = (c[1] + refine_sum[band_index * 3 + 1] * surface_albedo.g) * inv_count;
+				c[2] = (c[2] + refine_sum[band_index * 3 + 2] * surface_albedo.b) * inv_count;
+			}
+		}
+	}
 }
 
-// Utility
-void LightmapBaker::_report_progress(float p_progress, const String &p_status, BakeProgressFunc p_callback, void *p_userdata) {
-	if (p_callback != nullptr) {
-		p_callback(p_progress, p_status, p_userdata);
+static bool _lm_light_reaches_bounds(const LightData &p_light, const Vector3 &p_aabb_min, const Vector3 &p_aabb_max) {
+	if (p_light.type == 0) {
+		return true;
+	}
+
+	// Range sphere against the box (closest point test).
+	const float range = std::max(0.001f, p_light.range);
+	const Vector3 closest(
+			Math::clamp(p_light.position.x, p_aabb_min.x, p_aabb_max.x),
+			Math::clamp(p_light.position.y, p_aabb_min.y, p_aabb_max.y),
+			Math::clamp(p_light.position.z, p_aabb_min.z, p_aabb_max.z));
+	if ((closest - p_light.position).length_squared() > range * range) {
+		return false;
+	}
+	if (p_light.type != 2 || p_light.cos_spot_angle <= -1.0f) {
+		return true;
+	}
+
+	// Spot cone against the box's bounding sphere: the sphere is reached if the angle to its
+	// center is within the cone angle plus the sphere's angular radius.
+	const Vector3 center = (p_aabb_min + p_aabb_max) * 0.5f;
+	const float radius = (p_aabb_max - p_aabb_min).length() * 0.5f;
+	const Vector3 to_center = center - p_light.position;
+	const float dist = to_center.length();
+	if (dist <= radius) {
+		return true;
 	}
+	const Vector3 axis = p_light.direction.normalized();
+	const float angle_to_center = Math::acos(Math::clamp(axis.dot(to_center) / dist, -1.0f, 1.0f));
+	const float cone_angle = Math::acos(Math::clamp(p_light.cos_spot_angle, -1.0f, 1.0f));
+	return angle_to_center <= cone_angle + Math::asin(Math::min(1.0f, radius / dist));
 }
 
-Ref<Texture2DArray> LightmapBaker::_create_texture_array_from_images(const Vector<Ref<Image>> &p_layers) {
-	if (p_layers.is_empty()) {
-		return Ref<Texture2DArray>();
+#ifdef DEV_ENABLED
+// True if a spot light's axis enters the box within the light's range. Such a box is lit by the
+// spot, so culling the spot from it would be a bug in the cone test.
+static bool _lm_spot_axis_hits_bounds(const LightData &p_light, const Vector3 &p_aabb_min, const Vector3 &p_aabb_max) {
+	if (p_light.type != 2) {
+		return false;
 	}
-	if (p_layers[0].is_null() || p_layers[0]->is_empty()) {
-		return Ref<Texture2DArray>();
+	const Vector3 dir = p_light.direction.normalized();
+	float t_min = 0.0f;
+	float t_max = std::max(0.001f, p_light.range);
+	for (int axis = 0; axis < 3; axis++) {
+		const float origin = (float)p_light.position[axis];
+		const float d = (float)dir[axis];
+		if (Math::abs(d) < 1e-8f) {
+			if (origin < (float)p_aabb_min[axis] || origin > (float)p_aabb_max[axis]) {
+				return false;
+			}
+			continue;
+		}
+		float t0 = ((float)p_aabb_min[axis] - origin) / d;
+		float t1 = ((float)p_aabb_max[axis] - origin) / d;
+		if (t0 > t1) {
+			std::swap(t0, t1);
+		}
+		t_min = std::max(t_min, t0);
+		t_max = std::min(t_max, t1);
+		if (t_min > t_max) {
+			return false;
+		}
 	}
-	const Vector2i expected_size = p_layers[0]->get_size();
-	const Image::Format expected_format = p_layers[0]->get_format();
-	if (expected_size.x <= 0 || expected_size.y <= 0) {
-		return Ref<Texture2DArray>();
+	return true;
+}
+#endif
+
+void LightmapBaker::_cull_lights(const Vector3 &p_aabb_min, const Vector3 &p_aabb_max, const std::vector<uint32_t> &p_candidates, std::vector<uint32_t> &r_lights) const {
+	for (uint32_t index : p_candidates) {
+		if (_lm_light_reaches_bounds(gathered_lights[index], p_aabb_min, p_aabb_max)) {
+			r_lights.push_back(index);
+			continue;
+		}
+#ifdef DEV_ENABLED
+		// A spot aimed at the box must stay in its list.
+		DEV_ASSERT(!_lm_spot_axis_hits_bounds(gathered_lights[index], p_aabb_min, p_aabb_max));
+#endif
 	}
+}
 
-	TypedArray<Ref<Image>> images;
-	images.resize(p_layers.size());
-	for (int i = 0; i < p_layers.size(); i++) {
-		if (p_layers[i].is_null() || p_layers[i]->is_empty()) {
-			UtilityFunctions::push_error("LightmapBaker: Texture2DArray layer is null/empty at index " + String::num_int64(i));
-			return Ref<Texture2DArray>();
+bool LightmapBaker::_evaluate_light(uint32_t p_light, const Vector3 &p_world_pos, const Vector3 &p_world_normal, Vector3 &r_radiance) const {
+	const LightData &l = gathered_lights[p_light];
+	Vector3 L;
+	float atten = 1.0f;
+
+	if (l.type == 0) {
+		L = (-l.direction).normalized();
+	} else {
+		Vector3 to_light = l.position - p_world_pos;
+		float dist = to_light.length();
+		if (dist <= 1e-4f) {
+			return false;
 		}
-		if (p_layers[i]->get_size() != expected_size) {
-			UtilityFunctions::push_error("LightmapBaker: Texture2DArray layer size mismatch at index " + String::num_int64(i));
-			return Ref<Texture2DArray>();
+		L = to_light / dist;
+
+		float range = std::max(0.001f, l.range);
+		if (dist > range) {
+			atten = 0.0f;
+		} else if (light_falloff_mode == LIGHT_FALLOFF_INVERSE_SQUARE) {
+			// Use the light's normal attenuation curve, but boost near-source brightness
+			float x = std::max(0.0f, 1.0f - dist / range);
+			atten = Math::pow(x, std::max(0.0001f, l.attenuation));
+			// Reduce overall brightness by 30%
+			atten *= 0.7f;
+			// Add concentrated near-source boost (stronger and more focused)
+			const float d = std::max(0.5f, dist);
+			const float boost_amount = (3.0f / d) * x * x * x;  // cubic falloff for more concentration
+			atten *= (1.0f + std::min(boost_amount, 6.5f));
+		} else {
+			float x = std::max(0.0f, 1.0f - dist / range);
+			atten = Math::pow(x, std::max(0.0001f, l.attenuation));
 		}
-		if (p_layers[i]->get_format() != expected_format) {
-			UtilityFunctions::push_error("LightmapBaker: Texture2DArray layer format mismatch at index " + String::num_int64(i));
-			return Ref<Texture2DArray>();
+
+		if (l.type == 2) {
+			float spot_dot = L.dot((-l.direction).normalized());
+			if (spot_dot < l.cos_spot_angle) {
+				atten = 0.0f;
+			} else {
+				float edge = (spot_dot - l.cos_spot_angle) / std::max(1e-4f, 1.0f - l.cos_spot_angle);
+				atten *= Math::pow(edge, std::max(0.01f, l.inv_spot_attenuation));
+			}
 		}
-		images[i] = p_layers[i];
 	}
 
-	Ref<Texture2DArray> tex;
-	tex.instantiate();
-	Error err = tex->create_from_images(images);
-	if (err != OK) {
-		UtilityFunctions::push_error("LightmapBaker: Texture2DArray::create_from_images failed (err=" + String::num_int64((int64_t)err) + ")");
-		return Ref<Texture2DArray>();
+	float ndotl = std::max(0.0f, p_world_normal.dot(L));
+	if (ndotl <= 0.0f || atten <= 0.0f) {
+		return false;
 	}
-	return tex;
+	if (use_lambert_normalization) {
+		ndotl *= (float)(1.0 / Math_PI);
+	}
+	float lit = 1.0f;
+	if (use_shadowing && l.cast_shadow) {
+		const LightShadowMap *shadow_map = light_shadow_maps.empty() ? nullptr : light_shadow_maps[p_light].get();
+		if (shadow_map != nullptr) {
+			lit = shadow_map->sample(p_world_pos, p_world_normal);
+		} else {
+			lit = _shadow_visibility(p_world_pos, p_world_normal, p_light);
+		}
+		if (lit <= 0.0f) {
+			return false;
+		}
+	}
+	r_radiance = Vector3(l.color.r, l.color.g, l.color.b) * (l.energy * ndotl * atten * lit);
+	return true;
 }
 
-void LightmapBaker::_write_output_data(Ref<LightmapGIData> p_output_data, const Ref<Texture2DArray> &p_tex_array) {
-	TypedArray<Ref<TextureLayered>> textures;
-	textures.resize(1);
-	textures[0] = p_tex_array;
-	p_output_data->set_lightmap_textures(textures);
-	p_output_data->set_light_texture(p_tex_array);
-	p_output_data->set_uses_spherical_harmonics(false);
+Color LightmapBaker::_evaluate_direct_lighting(const Vector3 &p_world_pos, const Vector3 &p_world_normal, const uint32_t *p_lights, int p_light_count, uint32_t *r_visibility) const {
+	const float amb = std::max(0.0f, ambient_energy);
+	Vector3 accum(amb, amb, amb);
+	uint32_t visibility = 0;
+	accum += baked_environment_ambient;
+	Vector3 n = p_world_normal.normalized();
+
+	// With many lights, omni and spot lights come from the sample grid below; directional lights
+	// are always shaded exactly. Sampled lights leave no visibility bits, so their noise doesn't
+	// read as shadow edges to supersampling.
+	const bool sample_lights = light_sample_grid && p_light_count > light_sample_count;
+	for (int light_index = 0; light_index < p_light_count; light_index++) {
+		if (sample_lights && gathered_lights[p_lights[light_index]].type != 0) {
+			continue;
+		}
+		Vector3 radiance;
+		if (_evaluate_light(p_lights[light_index], p_world_pos, n, radiance)) {
+			accum += radiance;
+			visibility |= 1u << (p_lights[light_index] & 31u);
+		}
+	}
+
+	if (sample_lights) {
+		const int cell = light_sample_grid->cell_index(p_world_pos);
+		const uint32_t first = light_sample_grid->cell_first[(size_t)cell];
+		const uint32_t count = light_sample_grid->cell_first[(size_t)cell + 1] - first;
+		const _LM_LightAlias *table = light_sample_grid->entries.data() + first;
+		if (count <= (uint32_t)light_sample_count) {
+			// Few enough lights reach this cell to shade them all.
+			for (uint32_t i = 0; i < count; i++) {
+				Vector3 radiance;
+				if (_evaluate_light(table[i].light, p_world_pos, n, radiance)) {
+					accum += radiance;
+				}
+			}
+		} else if (count > 0) {
+			// Stratified picks: sample s draws from its own 1/N slice of the table. Seeding from the
+			// position makes supersampling add fresh samples and keeps results independent of threads.
+			uint64_t seed = _lm_hash_float(_lm_hash_float(_lm_hash_float(0x9e3779b97f4a7c15ULL, (float)p_world_pos.x), (float)p_world_pos.y), (float)p_world_pos.z);
+			const float inv_samples = 1.0f / (float)light_sample_count;
+			for (int s = 0; s < light_sample_count; s++) {
+				seed = _lm_mix64(seed + (uint64_t)s);
+				const float u = ((float)s + (float)(seed & 0xffffff) * (1.0f / 16777216.0f)) * inv_samples;
+				const float scaled = u * (float)count;
+				const uint32_t bucket = std::min((uint32_t)scaled, count - 1);
+				const _LM_LightAlias &entry = scaled - (float)bucket < table[bucket].threshold ? table[bucket] : table[table[bucket].alias];
+				Vector3 radiance;
+				if (_evaluate_light(entry.light, p_world_pos, n, radiance)) {
+					accum += radiance * (inv_samples / entry.pdf);
+				}
+			}
+		}
+	}
+	if (r_visibility != nullptr) {
+		*r_visibility = visibility;
+	}
+
+	accum *= std::max(0.0f, lightmap_energy_scale);
+	return Color(accum.x, accum.y, accum.z, 1.0f);
+}
+
+static inline bool _ray_intersects_bounds(const Vector3 &orig, const Vector3 &inv_dir, const Vector3 &bmin, const Vector3 &bmax, float tmax, float &r_tmin) {
+	Vector3 t0 = (bmin - orig) * inv_dir;
+	Vector3 t1 = (bmax - orig) * inv_dir;
+	Vector3 tmin_v(Math::min(t0.x, t1.x), Math::min(t0.y, t1.y), Math::min(t0.z, t1.z));
+	Vector3 tmax_v(Math::max(t0.x, t1.x), Math::max(t0.y, t1.y), Math::max(t0.z, t1.z));
+	float tmin = Math::max(0.0f, Math::max(tmin_v.x, Math::max(tmin_v.y, tmin_v.z)));
+	float tmax_hit = Math::min(tmax, Math::min(tmax_v.x, Math::min(tmax_v.y, tmax_v.z)));
+	r_tmin = tmin;
+	return tmax_hit >= tmin;
+}
+
+// Moller–Trumbore against the four triangles of a packet. Returns a bit mask of the lanes hit
+// closer than p_tmax and writes their distance and barycentrics.
+#ifdef LM_RAY_USE_SSE2
+struct _LM_PacketRay {
+	__m128 ox, oy, oz;
+	__m128 dx, dy, dz;
+
+	_LM_PacketRay(const Vector3 &p_origin, const Vector3 &p_dir) {
+		ox = _mm_set1_ps((float)p_origin.x);
+		oy = _mm_set1_ps((float)p_origin.y);
+		oz = _mm_set1_ps((float)p_origin.z);
+		dx = _mm_set1_ps((float)p_dir.x);
+		dy = _mm_set1_ps((float)p_dir.y);
+		dz = _mm_set1_ps((float)p_dir.z);
+	}
+};
+
+static inline int _ray_intersects_tri4(const _LM_PacketRay &p_ray, const _LM_RayTri4 &p_tris, float p_tmax, float *r_t, float *r_u, float *r_v) {
+	const __m128 eps = _mm_set1_ps(1e-7f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+
+	const __m128 e1x = _mm_load_ps(p_tris.e1[0]);
+	const __m128 e1y = _mm_load_ps(p_tris.e1[1]);
+	const __m128 e1z = _mm_load_ps(p_tris.e1[2]);
+	const __m128 e2x = _mm_load_ps(p_tris.e2[0]);
+	const __m128 e2y = _mm_load_ps(p_tris.e2[1]);
+	const __m128 e2z = _mm_load_ps(p_tris.e2[2]);
+
+	// p = dir x e2
+	const __m128 px = _mm_sub_ps(_mm_mul_ps(p_ray.dy, e2z), _mm_mul_ps(p_ray.dz, e2y));
+	const __m128 py = _mm_sub_ps(_mm_mul_ps(p_ray.dz, e2x), _mm_mul_ps(p_ray.dx, e2z));
+	const __m128 pz = _mm_sub_ps(_mm_mul_ps(p_ray.dx, e2y), _mm_mul_ps(p_ray.dy, e2x));
+	const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 mask = _mm_cmpge_ps(_mm_andnot_ps(sign_mask, det), eps);
+	if (_mm_movemask_ps(mask) == 0) {
+		return 0;
+	}
+	const __m128 inv_det = _mm_div_ps(one, det);
+
+	const __m128 tx = _mm_sub_ps(p_ray.ox, _mm_load_ps(p_tris.v0[0]));
+	const __m128 ty = _mm_sub_ps(p_ray.oy, _mm_load_ps(p_tris.v0[1]));
+	const __m128 tz = _mm_sub_ps(p_ray.oz, _mm_load_ps(p_tris.v0[2]));
+	const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+
+	// q = tvec x e1
+	const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+	const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p_ray.dx, qx), _mm_mul_ps(p_ray.dy, qy)), _mm_mul_ps(p_ray.dz, qz)), inv_det);
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+
+	const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+	mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, eps));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(p_tmax)));
+
+	const int bits = _mm_movemask_ps(mask);
+	if (bits != 0) {
+		_mm_storeu_ps(r_t, t);
+		_mm_storeu_ps(r_u, u);
+		_mm_storeu_ps(r_v, v);
+	}
+	return bits;
+}
+#else
+// Scalar fallback over the same packet layout, for targets without SSE2 (e.g. ARM).
+struct _LM_PacketRay {
+	Vector3 origin;
+	Vector3 dir;
+
+	_LM_PacketRay(const Vector3 &p_origin, const Vector3 &p_dir) :
+			origin(p_origin), dir(p_dir) {}
+};
+
+static inline int _ray_intersects_tri4(const _LM_PacketRay &p_ray, const _LM_RayTri4 &p_tris, float p_tmax, float *r_t, float *r_u, float *r_v) {
+	const float eps = 1e-7f;
+	int bits = 0;
+	for (int lane = 0; lane < 4; lane++) {
+		const Vector3 e1(p_tris.e1[0][lane], p_tris.e1[1][lane], p_tris.e1[2][lane]);
+		const Vector3 e2(p_tris.e2[0][lane], p_tris.e2[1][lane], p_tris.e2[2][lane]);
+		const Vector3 p = p_ray.dir.cross(e2);
+		const float det = e1.dot(p);
+		if (Math::abs(det) < eps) {
+			continue;
+		}
+		const float inv_det = 1.0f / det;
+		const Vector3 tvec = p_ray.origin - Vector3(p_tris.v0[0][lane], p_tris.v0[1][lane], p_tris.v0[2][lane]);
+		const float u = tvec.dot(p) * inv_det;
+		if (u < 0.0f) {
+			continue;
+		}
+		const Vector3 q = tvec.cross(e1);
+		const float v = p_ray.dir.dot(q) * inv_det;
+		if (v < 0.0f || u + v > 1.0f) {
+			continue;
+		}
+		const float t = e2.dot(q) * inv_det;
+		if (t > eps && t < p_tmax) {
+			r_t[lane] = t;
+			r_u[lane] = u;
+			r_v[lane] = v;
+			bits |= 1 << lane;
+		}
+	}
+	return bits;
+}
+#endif
+
+// Binned SAH BVH construction.
+static constexpr int LM_BVH_BIN_COUNT = 16;
+static constexpr uint32_t LM_BVH_MAX_LEAF_TRIS = 8;
+static constexpr int LM_BVH_MAX_DEPTH = 64;
+static constexpr float LM_BVH_TRAVERSAL_COST = 1.0f;
+// Per triangle; one kernel call tests four of them for about the price of a node visit.
+static constexpr float LM_BVH_INTERSECT_COST = 0.25f;
+
+// Per-thread traversal counters, folded into RayBVH's totals by flush_thread_stats()
+// so worker threads don't contend on the shared atomics for every ray.
+static thread_local uint64_t _lm_tls_rays_cast = 0;
+static thread_local uint64_t _lm_tls_nodes_visited = 0;
+static thread_local uint64_t _lm_tls_triangles_tested = 0;
+
+struct _LM_BVHBuildRef {
+	Vector3 aabb_min;
+	Vector3 aabb_max;
+	Vector3 centroid;
+	uint32_t tri = 0;
+};
+
+static inline float _lm_bounds_half_area(const Vector3 &p_min, const Vector3 &p_max) {
+	const Vector3 d = p_max - p_min;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+static uint32_t _lm_bvh_build_recursive(std::vector<_LM_BVHNode> &r_nodes, std::vector<_LM_BVHBuildRef> &p_refs, uint32_t p_begin, uint32_t p_end, int p_depth) {
+	const uint32_t node_index = (uint32_t)r_nodes.size();
+	r_nodes.push_back(_LM_BVHNode());
+
+	Vector3 bmin = p_refs[p_begin].aabb_min;
+	Vector3 bmax = p_refs[p_begin].aabb_max;
+	Vector3 cmin = p_refs[p_begin].centroid;
+	Vector3 cmax = p_refs[p_begin].centroid;
+	for (uint32_t i = p_begin + 1; i < p_end; i++) {
+		const _LM_BVHBuildRef &r = p_refs[i];
+		bmin = Vector3(Math::min(bmin.x, r.aabb_min.x), Math::min(bmin.y, r.aabb_min.y), Math::min(bmin.z, r.aabb_min.z));
+		bmax = Vector3(Math::max(bmax.x, r.aabb_max.x), Math::max(bmax.y, r.aabb_max.y), Math::max(bmax.z, r.aabb_max.z));
+		cmin = Vector3(Math::min(cmin.x, r.centroid.x), Math::min(cmin.y, r.centroid.y), Math::min(cmin.z, r.centroid.z));
+		cmax = Vector3(Math::max(cmax.x, r.centroid.x), Math::max(cmax.y, r.centroid.y), Math::max(cmax.z, r.centroid.z));
+	}
+	r_nodes[node_index].aabb_min = bmin;
+	r_nodes[node_index].aabb_max = bmax;
+
+	const uint32_t count = p_end - p_begin;
+	auto make_leaf = [&]() {
+		r_nodes[node_index].offset = p_begin;
+		r_nodes[node_index].tri_count = count;
+		return node_index;
+	};
+	if (count <= 2 || p_depth >= LM_BVH_MAX_DEPTH) {
+		return make_leaf();
+	}
+
+	struct Bin {
+		Vector3 aabb_min;
+		Vector3 aabb_max;
+		uint32_t count = 0;
+	};
+
+	float best_cost = 1e30f;
+	int best_axis = -1;
+	int best_split = -1;
+	for (int axis = 0; axis < 3; axis++) {
+		const float extent = cmax[axis] - cmin[axis];
+		if (extent <= 1e-12f) {
+			continue;
+		}
+		const float bin_scale = (float)LM_BVH_BIN_COUNT / extent;
+
+		Bin bins[LM_BVH_BIN_COUNT];
+		for (uint32_t i = p_begin; i < p_end; i++) {
+			const _LM_BVHBuildRef &r = p_refs[i];
+			const int b = std::min(LM_BVH_BIN_COUNT - 1, (int)((r.centroid[axis] - cmin[axis]) * bin_scale));
+			Bin &bin = bins[b];
+			if (bin.count == 0) {
+				bin.aabb_min = r.aabb_min;
+				bin.aabb_max = r.aabb_max;
+			} else {
+				bin.aabb_min = Vector3(Math::min(bin.aabb_min.x, r.aabb_min.x), Math::min(bin.aabb_min.y, r.aabb_min.y), Math::min(bin.aabb_min.z, r.aabb_min.z));
+				bin.aabb_max = Vector3(Math::max(bin.aabb_max.x, r.aabb_max.x), Math::max(bin.aabb_max.y, r.aabb_max.y), Math::max(bin.aabb_max.z, r.aabb_max.z));
+			}
+			bin.count++;
+		}
+
+		// Sweep from the right to get the area/count of every right-hand partition.
+		float right_area[LM_BVH_BIN_COUNT];
+		uint32_t right_count[LM_BVH_BIN_COUNT];
+		{
+			Vector3 rmin, rmax;
+			uint32_t n = 0;
+			for (int b = LM_BVH_BIN_COUNT - 1; b > 0; b--) {
+				if (bins[b].count > 0) {
+					if (n == 0) {
+						rmin = bins[b].aabb_min;
+						rmax = bins[b].aabb_max;
+					} else {
+						rmin = Vector3(Math::min(rmin.x, bins[b].aabb_min.x), Math::min(rmin.y, bins[b].aabb_min.y), Math::min(rmin.z, bins[b].aabb_min.z));
+						rmax = Vector3(Math::max(rmax.x, bins[b].aabb_max.x), Math::max(rmax.y, bins[b].aabb_max.y), Math::max(rmax.z, bins[b].aabb_max.z));
+					}
+					n += bins[b].count;
+				}
+				right_count[b] = n;
+				right_area[b] = n > 0 ? _lm_bounds_half_area(rmin, rmax) : 0.0f;
+			}
+		}
+
+		Vector3 lmin, lmax;
+		uint32_t n = 0;
+		for (int b = 0; b < LM_BVH_BIN_COUNT - 1; b++) {
+			if (bins[b].count > 0) {
+				if (n == 0) {
+					lmin = bins[b].aabb_min;
+					lmax = bins[b].aabb_max;
+				} else {
+					lmin = Vector3(Math::min(lmin.x, bins[b].aabb_min.x), Math::min(lmin.y, bins[b].aabb_min.y), Math::min(lmin.z, bins[b].aabb_min.z));
+					lmax = Vector3(Math::max(lmax.x, bins[b].aabb_max.x), Math::max(lmax.y, bins[b].aabb_max.y), Math::max(lmax.z, bins[b].aabb_max.z));
+				}
+				n += bins[b].count;
+			}
+			if (n == 0 || right_count[b + 1] == 0) {
+				continue;
+			}
+			const float cost = _lm_bounds_half_area(lmin, lmax) * (float)n + right_area[b + 1] * (float)right_count[b + 1];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = b;
+			}
+		}
+	}
+
+	const float node_area = _lm_bounds_half_area(bmin, bmax);
+	uint32_t mid = p_begin;
+	if (best_axis >= 0) {
+		const float split_cost = LM_BVH_TRAVERSAL_COST + LM_BVH_INTERSECT_COST * best_cost / Math::max(node_area, 1e-20f);
+		const float leaf_cost = LM_BVH_INTERSECT_COST * (float)count;
+		if (split_cost >= leaf_cost && count <= LM_BVH_MAX_LEAF_TRIS) {
+			return make_leaf();
+		}
+		const int axis = best_axis;
+		const float bin_scale = (float)LM_BVH_BIN_COUNT / (cmax[axis] - cmin[axis]);
+		const float axis_min = cmin[axis];
+		const int split = best_split;
+		mid = (uint32_t)(std::partition(p_refs.begin() + p_begin, p_refs.begin() + p_end, [&](const _LM_BVHBuildRef &r) {
+			return std::min(LM_BVH_BIN_COUNT - 1, (int)((r.centroid[axis] - axis_min) * bin_scale)) <= split;
+		}) - p_refs.begin());
+	}
+
+	if (mid == p_begin || mid == p_end) {
+		// Degenerate centroids (all coincident); fall back to an object-median split.
+		if (count <= LM_BVH_MAX_LEAF_TRIS) {
+			return make_leaf();
+		}
+		const int axis = (cmax - cmin).max_axis_index();
+		mid = p_begin + count / 2;
+		std::nth_element(p_refs.begin() + p_begin, p_refs.begin() + mid, p_refs.begin() + p_end, [axis](const _LM_BVHBuildRef &a, const _LM_BVHBuildRef &b) {
+			return a.centroid[axis] < b.centroid[axis];
+		});
+	}
+
+	_lm_bvh_build_recursive(r_nodes, p_refs, p_begin, mid, p_depth + 1);
+	const uint32_t right = _lm_bvh_build_recursive(r_nodes, p_refs, mid, p_end, p_depth + 1);
+	r_nodes[node_index].offset = right;
+	r_nodes[node_index].tri_count = 0;
+	return node_index;
+}
+
+void LightmapBaker::RayBVH::build(std::vector<_LM_RayTri> &&p_tris, std::vector<_LM_RayTriInfo> &&p_infos) {
+	nodes.clear();
+	tri_packets.clear();
+	tri_infos.clear();
+	triangle_count = 0;
+	rays_cast.store(0);
+	nodes_visited.store(0);
+	triangles_tested.store(0);
+	if (p_tris.empty()) {
+		return;
+	}
+
+	std::vector<_LM_BVHBuildRef> refs;
+	refs.resize(p_tris.size());
+	for (size_t i = 0; i < p_tris.size(); i++) {
+		const _LM_RayTri &t = p_tris[i];
+		_LM_BVHBuildRef &r = refs[i];
+		r.aabb_min = Vector3(Math::min(t.a.x, Math::min(t.b.x, t.c.x)), Math::min(t.a.y, Math::min(t.b.y, t.c.y)), Math::min(t.a.z, Math::min(t.b.z, t.c.z)));
+		r.aabb_max = Vector3(Math::max(t.a.x, Math::max(t.b.x, t.c.x)), Math::max(t.a.y, Math::max(t.b.y, t.c.y)), Math::max(t.a.z, Math::max(t.b.z, t.c.z)));
+		r.centroid = (r.aabb_min + r.aabb_max) * 0.5f;
+		r.tri = (uint32_t)i;
+	}
+
+	nodes.reserve(refs.size());
+	_lm_bvh_build_recursive(nodes, refs, 0, (uint32_t)refs.size(), 0);
+	nodes.shrink_to_fit();
+
+	// Lay the leaves out packet by packet; each leaf starts on a fresh packet so the kernel never
+	// mixes triangles of two leaves.
+	size_t packet_count = 0;
+	for (const _LM_BVHNode &node : nodes) {
+		packet_count += (node.tri_count + 3) / 4;
+	}
+	tri_packets.resize(packet_count);
+	memset(tri_packets.data(), 0, packet_count * sizeof(_LM_RayTri4));
+	tri_infos.resize(packet_count * 4);
+
+	uint32_t next_packet = 0;
+	for (_LM_BVHNode &node : nodes) {
+		if (node.tri_count == 0) {
+			continue;
+		}
+		for (uint32_t i = 0; i < node.tri_count; i++) {
+			const uint32_t src = refs[node.offset + i].tri;
+			const _LM_RayTri &t = p_tris[src];
+			_LM_RayTri4 &packet = tri_packets[next_packet + i / 4];
+			const int lane = (int)(i % 4);
+			const Vector3 e1 = t.b - t.a;
+			const Vector3 e2 = t.c - t.a;
+			for (int axis = 0; axis < 3; axis++) {
+				packet.v0[axis][lane] = (float)t.a[axis];
+				packet.e1[axis][lane] = (float)e1[axis];
+				packet.e2[axis][lane] = (float)e2[axis];
+			}
+			if (src < p_infos.size()) {
+				tri_infos[(size_t)next_packet * 4 + i] = p_infos[src];
+			}
+		}
+		node.offset = next_packet * 4;
+		next_packet += (node.tri_count + 3) / 4;
+	}
+	triangle_count = (uint32_t)refs.size();
+	p_tris.clear();
+	p_infos.clear();
+}
+
+bool LightmapBaker::RayBVH::intersects_any(const Vector3 &p_origin, const Vector3 &p_dir, float p_max_dist) const {
+	if (nodes.empty()) {
+		return false;
+	}
+
+	const Vector3 inv_dir(1.0f / (p_dir.x == 0.0f ? 1e-20f : p_dir.x), 1.0f / (p_dir.y == 0.0f ? 1e-20f : p_dir.y), 1.0f / (p_dir.z == 0.0f ? 1e-20f : p_dir.z));
+	const _LM_BVHNode *node_data = nodes.data();
+	const _LM_RayTri4 *packet_data = tri_packets.data();
+	const _LM_PacketRay ray(p_origin, p_dir);
+	float lane_t[4], lane_u[4], lane_v[4];
+
+	uint32_t stack[LM_BVH_MAX_DEPTH * 2 + 2];
+	int stack_size = 0;
+	uint64_t visited = 1;
+	uint64_t tested = 0;
+	bool hit = false;
+
+	float t_root = 0.0f;
+	if (_ray_intersects_bounds(p_origin, inv_dir, node_data[0].aabb_min, node_data[0].aabb_max, p_max_dist, t_root)) {
+		stack[stack_size++] = 0;
+	}
+
+	while (stack_size > 0 && !hit) {
+		const uint32_t index = stack[--stack_size];
+		const _LM_BVHNode &node = node_data[index];
+
+		if (node.tri_count > 0) {
+			const uint32_t first = node.offset / 4;
+			const uint32_t end = first + (node.tri_count + 3) / 4;
+			for (uint32_t i = first; i < end; i++) {
+				tested += std::min(4u, node.tri_count - (i - first) * 4);
+				if (_ray_intersects_tri4(ray, packet_data[i], p_max_dist, lane_t, lane_u, lane_v) != 0) {
+					hit = true;
+					break;
+				}
+			}
+			continue;
+		}
+
+		// Test both children and descend into the nearer one first.
+		const uint32_t left = index + 1;
+		const uint32_t right = node.offset;
+		float t_left = 0.0f;
+		float t_right = 0.0f;
+		const bool hit_left = _ray_intersects_bounds(p_origin, inv_dir, node_data[left].aabb_min, node_data[left].aabb_max, p_max_dist, t_left);
+		const bool hit_right = _ray_intersects_bounds(p_origin, inv_dir, node_data[right].aabb_min, node_data[right].aabb_max, p_max_dist, t_right);
+		visited += 2;
+		if (hit_left && hit_right) {
+			if (t_left <= t_right) {
+				stack[stack_size++] = right;
+				stack[stack_size++] = left;
+			} else {
+				stack[stack_size++] = left;
+				stack[stack_size++] = right;
+			}
+		} else if (hit_left) {
+			stack[stack_size++] = left;
+		} else if (hit_right) {
+			stack[stack_size++] = right;
+		}
+	}
+
+	_lm_tls_rays_cast++;
+	_lm_tls_nodes_visited += visited;
+	_lm_tls_triangles_tested += tested;
+	return hit;
+}
+
+bool LightmapBaker::RayBVH::intersect_closest(const Vector3 &p_origin, const Vector3 &p_dir, float p_max_dist, _LM_RayHit &r_hit) const {
+	if (nodes.empty()) {
+		return false;
+	}
+
+	const Vector3 inv_dir(1.0f / (p_dir.x == 0.0f ? 1e-20f : p_dir.x), 1.0f / (p_dir.y == 0.0f ? 1e-20f : p_dir.y), 1.0f / (p_dir.z == 0.0f ? 1e-20f : p_dir.z));
+	const _LM_BVHNode *node_data = nodes.data();
+	const _LM_RayTri4 *packet_data = tri_packets.data();
+	const _LM_PacketRay ray(p_origin, p_dir);
+	float lane_t[4], lane_u[4], lane_v[4];
+
+	// Entry distances ride along on the stack so subtrees behind the closest hit are skipped.
+	struct StackEntry {
+		uint32_t index;
+		float t_enter;
+	};
+	StackEntry stack[LM_BVH_MAX_DEPTH * 2 + 2];
+	int stack_size = 0;
+	uint64_t visited = 1;
+	uint64_t tested = 0;
+	float closest = p_max_dist;
+	bool hit = false;
+
+	float t_root = 0.0f;
+	if (_ray_intersects_bounds(p_origin, inv_dir, node_data[0].aabb_min, node_data[0].aabb_max, closest, t_root)) {
+		stack[stack_size++] = StackEntry{ 0, t_root };
+	}
 
-	p_output_data->clear_users();
-	for (size_t i = 0; i < gathered_meshes.size(); i++) {
-		const MeshData &md = gathered_meshes[i];
-		if (md.owner_node == nullptr) {
+	while (stack_size > 0) {
+		const StackEntry entry = stack[--stack_size];
+		if (entry.t_enter > closest) {
 			continue;
 		}
-		p_output_data->add_user(md.owner_node->get_path(), md.lightmap_uv_scale, md.lightmap_slice, md.sub_instance);
+		const _LM_BVHNode &node = node_data[entry.index];
+
+		if (node.tri_count > 0) {
+			const uint32_t first = node.offset / 4;
+			const uint32_t end = first + (node.tri_count + 3) / 4;
+			tested += node.tri_count;
+			for (uint32_t i = first; i < end; i++) {
+				const int bits = _ray_intersects_tri4(ray, packet_data[i], closest, lane_t, lane_u, lane_v);
+				if (bits == 0) {
+					continue;
+				}
+				for (int lane = 0; lane < 4; lane++) {
+					if ((bits & (1 << lane)) && lane_t[lane] < closest) {
+						closest = lane_t[lane];
+						r_hit.tri = i * 4 + (uint32_t)lane;
+						r_hit.t = lane_t[lane];
+						r_hit.u = lane_u[lane];
+						r_hit.v = lane_v[lane];
+						hit = true;
+					}
+				}
+			}
+			continue;
+		}
+
+		const uint32_t left = entry.index + 1;
+		const uint32_t right = node.offset;
+		float t_left = 0.0f;
+		float t_right = 0.0f;
+		const bool hit_left = _ray_intersects_bounds(p_origin, inv_dir, node_data[left].aabb_min, node_data[left].aabb_max, closest, t_left);
+		const bool hit_right = _ray_intersects_bounds(p_origin, inv_dir, node_data[right].aabb_min, node_data[right].aabb_max, closest, t_right);
+		visited += 2;
+		if (hit_left && hit_right) {
+			if (t_left <= t_right) {
+				stack[stack_size++] = StackEntry{ right, t_right };
+				stack[stack_size++] = StackEntry{ left, t_left };
+			} else {
+				stack[stack_size++] = StackEntry{ left, t_left };
+				stack[stack_size++] = StackEntry{ right, t_right };
+			}
+		} else if (hit_left) {
+			stack[stack_size++] = StackEntry{ left, t_left };
+		} else if (hit_right) {
+			stack[stack_size++] = StackEntry{ right, t_right };
+		}
 	}
+
+	_lm_tls_rays_cast++;
+	_lm_tls_nodes_visited += visited;
+	_lm_tls_triangles_tested += tested;
+	return hit;
 }
 
-static inline float _edge_function(const Vector2 &a, const Vector2 &b, const Vector2 &c) {
-	return (c.x - a.x) * (b.y - a.y) - (c.y - a.y) * (b.x - a.x);
+void LightmapBaker::RayBVH::flush_thread_stats() const {
+	rays_cast.fetch_add(_lm_tls_rays_cast, std::memory_order_relaxed);
+	nodes_visited.fetch_add(_lm_tls_nodes_visited, std::memory_order_relaxed);
+	triangles_tested.fetch_add(_lm_tls_triangles_tested, std::memory_order_relaxed);
+	_lm_tls_rays_cast = 0;
+	_lm_tls_nodes_visited = 0;
+	_lm_tls_triangles_tested = 0;
 }
 
-void LightmapBaker::_rasterize_mesh_direct_lighting(const MeshData &p_mesh, Ref<Image> p_target) {
-	const int w = p_target->get_width();
-	const int h = p_target->get_height();
+// Soft shadows: rays traced toward a light with a size before deciding whether its texel is in
+// the penumbra and needs the rest of soft_shadow_samples.
+static constexpr int LM_SOFT_SHADOW_INITIAL_SAMPLES = 4;
+
+// Shirley's concentric map from the unit square to the unit disk; keeps the strata of the
+// square's samples intact.
+static Vector2 _lm_concentric_disk(float p_u, float p_v) {
+	const float a = 2.0f * p_u - 1.0f;
+	const float b = 2.0f * p_v - 1.0f;
+	if (a == 0.0f && b == 0.0f) {
+		return Vector2();
+	}
+	float r;
+	float phi;
+	if (Math::abs(a) > Math::abs(b)) {
+		r = a;
+		phi = (float)(Math_PI * 0.25) * (b / a);
+	} else {
+		r = b;
+		phi = (float)(Math_PI * 0.5) - (float)(Math_PI * 0.25) * (a / b);
+	}
+	return Vector2(r * Math::cos(phi), r * Math::sin(phi));
+}
 
-	Color surface_albedo(1, 1, 1, 1);
-	if (use_material_albedo && p_mesh.material.is_valid()) {
-		BaseMaterial3D *bm = Object::cast_to<BaseMaterial3D>(p_mesh.material.ptr());
-		if (bm != nullptr) {
-			surface_albedo = bm->get_albedo();
+float LightmapBaker::_shadow_visibility(const Vector3 &p_world_pos, const Vector3 &p_world_normal, uint32_t p_light) const {
+	if (!ray_bvh) {
+		return 1.0f;
+	}
+	const LightData &l = gathered_lights[p_light];
+	const Vector3 origin = p_world_pos + p_world_normal * bias;
+
+	// Direction and distance to the light's center; soft samples are spread over a disk around it
+	// facing the point.
+	Vector3 center_dir;
+	float center_dist = 1e20f;
+	if (l.type == 0) {
+		center_dir = (-l.direction).normalized();
+	} else {
+		const Vector3 to_light = l.position - origin;
+		center_dist = to_light.length();
+		if (center_dist <= 1e-4f) {
+			return 1.0f;
 		}
+		center_dir = to_light / center_dist;
 	}
+	auto visible = [&](const Vector3 &p_dir, float p_dist) {
+		if (l.type == 0) {
+			return !ray_bvh->intersects_any(origin, p_dir, 1e20f);
+		}
+		const float max_dist = Math::max(0.0f, p_dist - bias);
+		return max_dist <= 1e-4f || !ray_bvh->intersects_any(origin, p_dir, max_dist);
+	};
 
-	const int vertex_count = p_mesh.vertices.size();
-	if (vertex_count < 3 || p_mesh.uv2s.size() != vertex_count) {
-		return;
+	const int max_samples = soft_shadow_samples;
+	if (l.size <= 0.0f || max_samples <= 1) {
+		return visible(center_dir, center_dist) ? 1.0f : 0.0f;
 	}
 
-	auto sample_triangle = [&](int i0, int i1, int i2) {
-		Vector2 uv0 = p_mesh.uv2s[i0];
-		Vector2 uv1 = p_mesh.uv2s[i1];
-		Vector2 uv2 = p_mesh.uv2s[i2];
+	const Vector3 tangent = (Math::abs(center_dir.y) < 0.99f ? Vector3(0, 1, 0) : Vector3(1, 0, 0)).cross(center_dir).normalized();
+	const Vector3 bitangent = center_dir.cross(tangent);
+	// R2 sequence, shifted per texel and light: any prefix of it covers the disk evenly, so the
+	// first samples are as well spread as the full set, and neighboring texels don't share a pattern.
+	const uint64_t seed = _lm_mix64(_lm_hash_float(_lm_hash_float(_lm_hash_float((uint64_t)p_light, (float)p_world_pos.x), (float)p_world_pos.y), (float)p_world_pos.z));
+	const float shift_u = (float)(seed & 0xffffff) * (1.0f / 16777216.0f);
+	const float shift_v = (float)((seed >> 24) & 0xffffff) * (1.0f / 16777216.0f);
+	auto trace_sample = [&](int p_index) {
+		const float u = Math::fposmod(shift_u + 0.7548776662f * (float)p_index, 1.0f);
+		const float v = Math::fposmod(shift_v + 0.5698402910f * (float)p_index, 1.0f);
+		const Vector2 disk = _lm_concentric_disk(u, v) * l.size;
+		if (l.type == 0) {
+			return visible((center_dir + tangent * disk.x + bitangent * disk.y).normalized(), 1e20f);
+		}
+		const Vector3 to_sample = center_dir * center_dist + tangent * disk.x + bitangent * disk.y;
+		const float dist = to_sample.length();
+		return visible(to_sample / dist, dist);
+	};
 
-		Vector2 p0 = uv0 * Vector2((float)w, (float)h);
-		Vector2 p1 = uv1 * Vector2((float)w, (float)h);
-		Vector2 p2 = uv2 * Vector2((float)w, (float)h);
+	int lit = 0;
+	int taken = 0;
+	const int initial = std::min(LM_SOFT_SHADOW_INITIAL_SAMPLES, max_samples);
+	for (; taken < initial; taken++) {
+		lit += trace_sample(taken) ? 1 : 0;
+	}
+	if (lit == 0 || lit == taken) {
+		return (float)lit / (float)taken;
+	}
+	for (; taken < max_samples; taken++) {
+		lit += trace_sample(taken) ? 1 : 0;
+	}
+	return (float)lit / (float)taken;
+}
 
-		float area = _edge_function(p0, p1, p2);
-		if (Math::abs(area) < 1e-8f) {
+void LightmapBaker::LightShadowMap::render(const std::vector<_LM_RayTri4> &p_packets, int p_thread_count) {
+	// Project every triangle once. q is the depth for orthographic maps and 1 / depth for
+	// perspective ones; either is linear in texel space.
+	struct ShadowTri {
+		Vector2 p[3];
+		float q[3];
+		float min_y = 0.0f;
+		float max_y = 0.0f;
+	};
+	std::vector<ShadowTri> tris;
+	tris.reserve(p_packets.size() * 4);
+	const float map_size = (float)size;
+	auto emit = [&](const Vector3 &p_a, const Vector3 &p_b, const Vector3 &p_c) {
+		ShadowTri tri;
+		const Vector3 verts[3] = { p_a, p_b, p_c };
+		for (int k = 0; k < 3; k++) {
+			tri.p[k] = to_texel(verts[k]);
+			tri.q[k] = perspective ? 1.0f / (float)verts[k].z : (float)verts[k].z;
+		}
+		tri.min_y = std::min({ tri.p[0].y, tri.p[1].y, tri.p[2].y });
+		tri.max_y = std::max({ tri.p[0].y, tri.p[1].y, tri.p[2].y });
+		const float min_x = std::min({ tri.p[0].x, tri.p[1].x, tri.p[2].x });
+		const float max_x = std::max({ tri.p[0].x, tri.p[1].x, tri.p[2].x });
+		if (tri.max_y < 0.0f || tri.min_y > map_size || max_x < 0.0f || min_x > map_size) {
 			return;
 		}
-		float inv_area = 1.0f / area;
-
-		int min_x = (int)Math::floor(std::min({ p0.x, p1.x, p2.x }));
-		int max_x = (int)Math::ceil(std::max({ p0.x, p1.x, p2.x }));
-		int min_y = (int)Math::floor(std::min({ p0.y, p1.y, p2.y }));
-		int max_y = (int)Math::ceil(std::max({ p0.y, p1.y, p2.y }));
-		min_x = std::clamp(min_x, 0, w - 1);
-		max_x = std::clamp(max_x, 0, w - 1);
-		min_y = std::clamp(min_y, 0, h - 1);
-		max_y = std::clamp(max_y, 0, h - 1);
-
-		Vector3 v0 = p_mesh.transform.xform(p_mesh.vertices[i0]);
-		Vector3 v1 = p_mesh.transform.xform(p_mesh.vertices[i1]);
-		Vector3 v2 = p_mesh.transform.xform(p_mesh.vertices[i2]);
-
-		Vector3 nn0 = p_mesh.normals.is_empty() ? Vector3(0, 1, 0) : p_mesh.normals[i0];
-		Vector3 nn1 = p_mesh.normals.is_empty() ? Vector3(0, 1, 0) : p_mesh.normals[i1];
-		Vector3 nn2 = p_mesh.normals.is_empty() ? Vector3(0, 1, 0) : p_mesh.normals[i2];
-		Vector3 n0 = p_mesh.transform.basis.xform(nn0).normalized();
-		Vector3 n1 = p_mesh.transform.basis.xform(nn1).normalized();
-		Vector3 n2 = p_mesh.transform.basis.xform(nn2).normalized();
-
-		for (int y = min_y; y <= max_y; y++) {
-			for (int x = min_x; x <= max_x; x++) {
-				Vector2 p((float)x + 0.5f, (float)y + 0.5f);
-				float w0 = _edge_function(p1, p2, p) * inv_area;
-				float w1 = _edge_function(p2, p0, p) * inv_area;
-				float w2 = _edge_function(p0, p1, p) * inv_area;
-				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
-					continue;
+		tris.push_back(tri);
+	};
+	for (const _LM_RayTri4 &packet : p_packets) {
+		for (int lane = 0; lane < 4; lane++) {
+			const Vector3 a(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+			const Vector3 e1(packet.e1[0][lane], packet.e1[1][lane], packet.e1[2][lane]);
+			const Vector3 e2(packet.e2[0][lane], packet.e2[1][lane], packet.e2[2][lane]);
+			if (e1.cross(e2).length_squared() <= 0.0f) {
+				continue;
+			}
+			const Vector3 verts[3] = { to_light_space(a), to_light_space(a + e1), to_light_space(a + e2) };
+			if (!perspective) {
+				emit(verts[0], verts[1], verts[2]);
+				continue;
+			}
+			// Clip against the near plane; the result is a triangle or a quad.
+			Vector3 poly[4];
+			int count = 0;
+			for (int k = 0; k < 3; k++) {
+				const Vector3 &current = verts[k];
+				const Vector3 &next = verts[(k + 1) % 3];
+				const bool current_in = current.z >= near;
+				if (current_in) {
+					poly[count++] = current;
 				}
-				Vector3 world_pos = v0 * w0 + v1 * w1 + v2 * w2;
-				Vector3 world_nrm = (n0 * w0 + n1 * w1 + n2 * w2).normalized();
-				Color lit = _evaluate_direct_lighting(world_pos, world_nrm);
-				lit.r *= surface_albedo.r;
-				lit.g *= surface_albedo.g;
-				lit.b *= surface_albedo.b;
-				lit.a = 1.0f;
-				p_target->set_pixel(x, y, lit);
+				if (current_in != (next.z >= near)) {
+					poly[count++] = current + (next - current) * ((near - current.z) / (next.z - current.z));
+				}
+			}
+			if (count >= 3) {
+				emit(poly[0], poly[1], poly[2]);
+			}
+			if (count == 4) {
+				emit(poly[0], poly[2], poly[3]);
 			}
 		}
-	};
+	}
 
-	if (!p_mesh.indices.is_empty()) {
-		const int idx_count = p_mesh.indices.size();
-		for (int i = 0; i + 2 < idx_count; i += 3) {
-			int i0 = p_mesh.indices[i + 0];
-			int i1 = p_mesh.indices[i + 1];
-			int i2 = p_mesh.indices[i + 2];
-			if (i0 < 0 || i1 < 0 || i2 < 0 || i0 >= vertex_count || i1 >= vertex_count || i2 >= vertex_count) {
+	// Bands of rows run in parallel; each keeps the closest depth at its texel centers.
+	const int band_rows = 32;
+	_lm_parallel_for((size + band_rows - 1) / band_rows, p_thread_count, [&](int p_band) {
+		const int row_begin = p_band * band_rows;
+		const int row_end = std::min(size, row_begin + band_rows);
+		for (const ShadowTri &tri : tris) {
+			if (tri.max_y < (float)row_begin || tri.min_y > (float)row_end) {
+				continue;
+			}
+			const float area = _edge_function(tri.p[0], tri.p[1], tri.p[2]);
+			if (Math::abs(area) < 1e-8f) {
 				continue;
 			}
-			sample_triangle(i0, i1, i2);
+			const float inv_area = 1.0f / area;
+			const int min_x = std::max(0, (int)Math::floor(std::min({ tri.p[0].x, tri.p[1].x, tri.p[2].x })));
+			const int max_x = std::min(size - 1, (int)Math::ceil(std::max({ tri.p[0].x, tri.p[1].x, tri.p[2].x })));
+			const int min_y = std::max(row_begin, (int)Math::floor(tri.min_y));
+			const int max_y = std::min(row_end - 1, (int)Math::ceil(tri.max_y));
+			for (int y = min_y; y <= max_y; y++) {
+				for (int x = min_x; x <= max_x; x++) {
+					const Vector2 p((float)x + 0.5f, (float)y + 0.5f);
+					const float w0 = _edge_function(tri.p[1], tri.p[2], p) * inv_area;
+					const float w1 = _edge_function(tri.p[2], tri.p[0], p) * inv_area;
+					const float w2 = _edge_function(tri.p[0], tri.p[1], p) * inv_area;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+						continue;
+					}
+					const float q = tri.q[0] * w0 + tri.q[1] * w1 + tri.q[2] * w2;
+					const float d = perspective ? 1.0f / q : q;
+					float &stored = depth[(size_t)y * (size_t)size + (size_t)x];
+					stored = std::min(stored, d);
+				}
+			}
 		}
-	} else {
-		for (int i = 0; i + 2 < vertex_count; i += 3) {
-			sample_triangle(i, i + 1, i + 2);
+	});
+}
+
+float LightmapBaker::LightShadowMap::sample(const Vector3 &p_world_pos, const Vector3 &p_world_normal) const {
+	const Vector3 light_pos = to_light_space(p_world_pos);
+	if (perspective && light_pos.z <= near) {
+		return 1.0f;
+	}
+	// Push the receiver about a texel off its surface, and allow for the depth slope across the
+	// neighboring PCF taps, so surfaces don't shadow themselves.
+	const float texel = texel_world_size((float)light_pos.z);
+	const Vector3 to_light = perspective ? (origin - p_world_pos).normalized() : -axis_z;
+	const float cos_theta = Math::clamp((float)p_world_normal.dot(to_light), 0.05f, 1.0f);
+	const float slope = std::min(Math::sqrt(1.0f - cos_theta * cos_theta) / cos_theta, 10.0f);
+	const Vector3 receiver = to_light_space(p_world_pos + p_world_normal * (texel * 1.5f + bias));
+	if (perspective && receiver.z <= near) {
+		return 1.0f;
+	}
+	const Vector2 t = to_texel(receiver);
+	const int cx = (int)Math::floor(t.x);
+	const int cy = (int)Math::floor(t.y);
+	if (cx < 0 || cy < 0 || cx >= size || cy >= size) {
+		return 1.0f; // Outside the spot cone or the scene bounds.
+	}
+	const float receiver_depth = (float)receiver.z - texel * (1.0f + slope);
+	int lit = 0;
+	for (int dy = -1; dy <= 1; dy++) {
+		const int y = std::clamp(cy + dy, 0, size - 1);
+		for (int dx = -1; dx <= 1; dx++) {
+			const int x = std::clamp(cx + dx, 0, size - 1);
+			if (depth[(size_t)y * (size_t)size + (size_t)x] >= receiver_depth) {
+				lit++;
+			}
 		}
 	}
+	return (float)lit / 9.0f;
 }
 
-Color LightmapBaker::_evaluate_direct_lighting(const Vector3 &p_world_pos, const Vector3 &p_world_normal) const {
-	const float amb = std::max(0.0f, ambient_energy);
-	Vector3 accum(amb, amb, amb);
-	accum += baked_environment_ambient;
-	Vector3 n = p_world_normal.normalized();
+void LightmapBaker::_build_shadow_maps() {
+	_clear_shadow_maps();
+	if (!use_shadowing || !ray_bvh || ray_bvh->tri_packets.empty() || gathered_meshes.empty()) {
+		return;
+	}
 
-	for (const LightData &l : gathered_lights) {
-		Vector3 L;
-		float atten = 1.0f;
+	Vector3 scene_min = gathered_meshes[0].world_aabb_min;
+	Vector3 scene_max = gathered_meshes[0].world_aabb_max;
+	for (const MeshData &md : gathered_meshes) {
+		scene_min = Vector3(Math::min(scene_min.x, md.world_aabb_min.x), Math::min(scene_min.y, md.world_aabb_min.y), Math::min(scene_min.z, md.world_aabb_min.z));
+		scene_max = Vector3(Math::max(scene_max.x, md.world_aabb_max.x), Math::max(scene_max.y, md.world_aabb_max.y), Math::max(scene_max.z, md.world_aabb_max.z));
+	}
 
+	light_shadow_maps.resize(gathered_lights.size());
+	for (size_t i = 0; i < gathered_lights.size(); i++) {
+		const LightData &l = gathered_lights[i];
+		if (!l.cast_shadow || !l.use_shadow_map || (l.type != 0 && l.type != 2)) {
+			continue;
+		}
+		std::unique_ptr<LightShadowMap> map = std::make_unique<LightShadowMap>();
+		map->size = shadow_map_size;
+		map->bias = bias;
+		map->axis_z = l.direction.normalized();
+		const Vector3 up = Math::abs(map->axis_z.y) < 0.99f ? Vector3(0, 1, 0) : Vector3(1, 0, 0);
+		map->axis_x = up.cross(map->axis_z).normalized();
+		map->axis_y = map->axis_z.cross(map->axis_x);
+		// Two texels of margin keep the PCF taps of the outermost geometry inside the map.
+		const float usable_half = (float)map->size * 0.5f - 2.0f;
 		if (l.type == 0) {
-			L = (-l.direction).normalized();
+			map->origin = (scene_min + scene_max) * 0.5f;
+			float half_extent = 1e-3f;
+			for (int corner = 0; corner < 8; corner++) {
+				const Vector3 p((corner & 1) ? scene_max.x : scene_min.x, (corner & 2) ? scene_max.y : scene_min.y, (corner & 4) ? scene_max.z : scene_min.z);
+				const Vector3 light_pos = map->to_light_space(p);
+				half_extent = std::max({ half_extent, (float)Math::abs(light_pos.x), (float)Math::abs(light_pos.y) });
+			}
+			map->scale = usable_half / half_extent;
 		} else {
-			Vector3 to_light = l.position - p_world_pos;
-			float dist = to_light.length();
-			if (dist <= 1e-4f) {
+			// Very wide cones would stretch the perspective map too far; they keep ray-traced shadows.
+			const float half_angle = Math::acos(Math::clamp(l.cos_spot_angle, -1.0f, 1.0f));
+			if (half_angle > Math::deg_to_rad(80.0f)) {
 				continue;
 			}
-			L = to_light / dist;
+			map->perspective = true;
+			map->origin = l.position;
+			map->near = std::max(1e-3f, l.range * 1e-4f);
+			map->scale = usable_half / std::max(1e-3f, Math::tan(half_angle));
+		}
+		map->depth.assign((size_t)map->size * (size_t)map->size, std::numeric_limits<float>::max());
+		_track_bake_memory((int64_t)map->depth.size() * (int64_t)sizeof(float));
+		map->render(ray_bvh->tri_packets, _get_worker_thread_count());
+		light_shadow_maps[i] = std::move(map);
+		if (_is_bake_aborted()) {
+			return;
+		}
+	}
+}
 
-			float range = std::max(0.001f, l.range);
-			if (dist > range) {
-				atten = 0.0f;
-			} else if (light_falloff_mode == LIGHT_FALLOFF_INVERSE_SQUARE) {
-				// Use the light's normal attenuation curve, but boost near-source brightness
-				float x = std::max(0.0f, 1.0f - dist / range);
-				atten = Math::pow(x, std::max(0.0001f, l.attenuation));
-				// Reduce overall brightness by 30%
-				atten *= 0.7f;
-				// Add concentrated near-source boost (stronger and more focused)
-				const float d = std::max(0.5f, dist);
-				const float boost_amount = (3.0f / d) * x * x * x;  // cubic falloff for more concentration
-				atten *= (1.0f + std::min(boost_amount, 6.5f));
-			} else {
-				float x = std::max(0.0f, 1.0f - dist / range);
-				atten = Math::pow(x, std::max(0.0001f, l.attenuation));
-			}
+void LightmapBaker::_clear_shadow_maps() {
+	for (const std::unique_ptr<LightShadowMap> &map : light_shadow_maps) {
+		if (map) {
+			_track_bake_memory(-(int64_t)map->depth.size() * (int64_t)sizeof(float));
+		}
+	}
+	light_shadow_maps.clear();
+}
 
-			if (l.type == 2) {
-				float spot_dot = L.dot((-l.direction).normalized());
-				if (spot_dot < l.cos_spot_angle) {
-					atten = 0.0f;
-				} else {
-					float edge = (spot_dot - l.cos_spot_angle) / std::max(1e-4f, 1.0f - l.cos_spot_angle);
-					atten *= Math::pow(edge, std::max(0.01f, l.inv_spot_attenuation));
-				}
-			}
+// Cells along the longest axis of the scene bounds for many-light sampling.
+static constexpr int LM_LIGHT_SAMPLE_GRID_RESOLUTION = 16;
+
+// Upper estimate of what a light contributes inside a box: its brightest channel, attenuated to
+// the box point closest to it and, for spots, by the cone falloff at the box's bounding-sphere
+// point nearest the axis. Lights that can't reach the box are culled before this.
+static float _lm_light_sample_weight(const LightData &p_light, const Vector3 &p_aabb_min, const Vector3 &p_aabb_max) {
+	const Vector3 closest(
+			Math::clamp(p_light.position.x, p_aabb_min.x, p_aabb_max.x),
+			Math::clamp(p_light.position.y, p_aabb_min.y, p_aabb_max.y),
+			Math::clamp(p_light.position.z, p_aabb_min.z, p_aabb_max.z));
+	const float x = std::max(0.0f, 1.0f - (float)(closest - p_light.position).length() / std::max(0.001f, p_light.range));
+	const float brightest = std::max({ p_light.color.r, p_light.color.g, p_light.color.b });
+	float weight = Math::abs(p_light.energy) * brightest * Math::pow(x, std::max(0.0001f, p_light.attenuation));
+
+	if (p_light.type == 2 && p_light.cos_spot_angle > -1.0f) {
+		const Vector3 center = (p_aabb_min + p_aabb_max) * 0.5f;
+		const float radius = (p_aabb_max - p_aabb_min).length() * 0.5f;
+		const Vector3 to_center = center - p_light.position;
+		const float dist = to_center.length();
+		if (dist > radius) {
+			const float angle_to_center = Math::acos(Math::clamp((float)p_light.direction.normalized().dot(to_center) / dist, -1.0f, 1.0f));
+			const float min_angle = std::max(0.0f, angle_to_center - Math::asin(Math::min(1.0f, radius / dist)));
+			const float edge = (Math::cos(min_angle) - p_light.cos_spot_angle) / std::max(1e-4f, 1.0f - p_light.cos_spot_angle);
+			weight *= Math::pow(Math::clamp(edge, 0.0f, 1.0f), std::max(0.01f, p_light.inv_spot_attenuation));
+		}
+	}
+	return weight;
+}
+
+void LightmapBaker::_build_light_sample_grid() {
+	_clear_light_sample_grid();
+	if (light_sample_count <= 0 || gathered_meshes.empty()) {
+		return;
+	}
+	std::vector<uint32_t> local_lights;
+	for (size_t i = 0; i < gathered_lights.size(); i++) {
+		if (gathered_lights[i].type != 0) {
+			local_lights.push_back((uint32_t)i);
+		}
+	}
+	if (local_lights.size() <= (size_t)light_sample_count) {
+		return;
+	}
+
+	Vector3 scene_min = gathered_meshes[0].world_aabb_min;
+	Vector3 scene_max = gathered_meshes[0].world_aabb_max;
+	for (const MeshData &md : gathered_meshes) {
+		scene_min = Vector3(Math::min(scene_min.x, md.world_aabb_min.x), Math::min(scene_min.y, md.world_aabb_min.y), Math::min(scene_min.z, md.world_aabb_min.z));
+		scene_max = Vector3(Math::max(scene_max.x, md.world_aabb_max.x), Math::max(scene_max.y, md.world_aabb_max.y), Math::max(scene_max.z, md.world_aabb_max.z));
+	}
+	std::unique_ptr<LightSampleGrid> grid = std::make_unique<LightSampleGrid>();
+	const Vector3 extent = scene_max - scene_min;
+	const float cell_size = std::max(1e-3f, (float)std::max({ extent.x, extent.y, extent.z }) / (float)LM_LIGHT_SAMPLE_GRID_RESOLUTION);
+	grid->origin = scene_min;
+	grid->inv_cell_size = 1.0f / cell_size;
+	for (int axis = 0; axis < 3; axis++) {
+		grid->dims[axis] = CLAMP((int)Math::ceil((float)extent[axis] / cell_size), 1, LM_LIGHT_SAMPLE_GRID_RESOLUTION);
+	}
+	const int cell_count = grid->dims[0] * grid->dims[1] * grid->dims[2];
+
+	std::vector<std::vector<_LM_LightAlias>> cells((size_t)cell_count);
+	_lm_parallel_for(cell_count, _get_worker_thread_count(), [&](int p_cell) {
+		const int cx = p_cell % grid->dims[0];
+		const int cy = (p_cell / grid->dims[0]) % grid->dims[1];
+		const int cz = p_cell / (grid->dims[0] * grid->dims[1]);
+		const Vector3 cell_min = grid->origin + Vector3((float)cx, (float)cy, (float)cz) * cell_size;
+		const Vector3 cell_max = cell_min + Vector3(cell_size, cell_size, cell_size);
+		std::vector<uint32_t> lights;
+		_cull_lights(cell_min, cell_max, local_lights, lights);
+		if (lights.empty()) {
+			return;
 		}
 
-		float ndotl = std::max(0.0f, n.dot(L));
-		if (ndotl <= 0.0f) {
-			continue;
+		// Every light that reaches the cell keeps a small probability, so the estimate stays unbiased
+		// even where the weight underestimates a light.
+		const size_t count = lights.size();
+		std::vector<float> weights(count);
+		float total = 0.0f;
+		float max_weight = 0.0f;
+		for (size_t i = 0; i < count; i++) {
+			weights[i] = _lm_light_sample_weight(gathered_lights[lights[i]], cell_min, cell_max);
+			max_weight = std::max(max_weight, weights[i]);
 		}
-		if (use_lambert_normalization) {
-			ndotl *= (float)(1.0 / Math_PI);
+		for (size_t i = 0; i < count; i++) {
+			weights[i] = max_weight > 0.0f ? std::max(weights[i], max_weight * 1e-3f) : 1.0f;
+			total += weights[i];
 		}
-		if (use_shadowing && l.cast_shadow) {
-			if (_is_shadowed(p_world_pos, n, l)) {
-				continue;
+
+		// Vose's alias method: split entries into under- and over-full buckets of the uniform pick
+		// and let each under-full bucket borrow the rest of its slot from an over-full one.
+		std::vector<_LM_LightAlias> &table = cells[(size_t)p_cell];
+		table.resize(count);
+		std::vector<float> scaled(count);
+		std::vector<uint32_t> small;
+		std::vector<uint32_t> large;
+		for (size_t i = 0; i < count; i++) {
+			table[i].light = lights[i];
+			table[i].alias = (uint32_t)i;
+			table[i].pdf = weights[i] / total;
+			scaled[i] = table[i].pdf * (float)count;
+			(scaled[i] < 1.0f ? small : large).push_back((uint32_t)i);
+		}
+		while (!small.empty() && !large.empty()) {
+			const uint32_t under = small.back();
+			small.pop_back();
+			const uint32_t over = large.back();
+			table[under].threshold = scaled[under];
+			table[under].alias = over;
+			scaled[over] -= 1.0f - scaled[under];
+			if (scaled[over] < 1.0f) {
+				large.pop_back();
+				small.push_back(over);
 			}
 		}
-		Vector3 col(l.color.r, l.color.g, l.color.b);
-		accum += col * (l.energy * ndotl * atten);
-	}
+		// Whatever is left is full up to rounding.
+		for (uint32_t i : small) {
+			table[i].threshold = 1.0f;
+		}
+		for (uint32_t i : large) {
+			table[i].threshold = 1.0f;
+		}
+	});
 
-	accum *= std::max(0.0f, lightmap_energy_scale);
-	return Color(accum.x, accum.y, accum.z, 1.0f);
+	size_t entry_count = 0;
+	for (const std::vector<_LM_LightAlias> &table : cells) {
+		entry_count += table.size();
+	}
+	grid->cell_first.resize((size_t)cell_count + 1);
+	grid->entries.reserve(entry_count);
+	for (int cell = 0; cell < cell_count; cell++) {
+		grid->cell_first[(size_t)cell] = (uint32_t)grid->entries.size();
+		grid->entries.insert(grid->entries.end(), cells[(size_t)cell].begin(), cells[(size_t)cell].end());
+	}
+	grid->cell_first[(size_t)cell_count] = (uint32_t)grid->entries.size();
+	_track_bake_memory((int64_t)grid->get_memory_usage());
+	light_sample_grid = std::move(grid);
 }
 
-static inline bool _ray_intersects_aabb(const Vector3 &orig, const Vector3 &dir, const AABB &aabb, float tmax) {
-	Vector3 inv_dir(1.0f / (dir.x == 0.0f ? 1e-20f : dir.x), 1.0f / (dir.y == 0.0f ? 1e-20f : dir.y), 1.0f / (dir.z == 0.0f ? 1e-20f : dir.z));
-	Vector3 t0 = (aabb.position - orig) * inv_dir;
-	Vector3 t1 = (aabb.position + aabb.size - orig) * inv_dir;
-	Vector3 tmin_v(Math::min(t0.x, t1.x), Math::min(t0.y, t1.y), Math::min(t0.z, t1.z));
-	Vector3 tmax_v(Math::max(t0.x, t1.x), Math::max(t0.y, t1.y), Math::max(t0.z, t1.z));
-	float tmin = Math::max(0.0f, Math::max(tmin_v.x, Math::max(tmin_v.y, tmin_v.z)));
-	float tmax_hit = Math::min(tmax, Math::min(tmax_v.x, Math::min(tmax_v.y, tmax_v.z)));
-	return tmax_hit >= tmin;
+void LightmapBaker::_clear_light_sample_grid() {
+	if (light_sample_grid) {
+		_track_bake_memory(-(int64_t)light_sample_grid->get_memory_usage());
+		light_sample_grid.reset();
+	}
 }
 
-static inline bool _ray_intersects_tri(const Vector3 &orig, const Vector3 &dir, const _LM_RayTri &tri, float tmax, float &r_t) {
-	// Moller–Trumbore
-	const float eps = 1e-7f;
-	Vector3 e1 = tri.b - tri.a;
-	Vector3 e2 = tri.c - tri.a;
-	Vector3 p = dir.cross(e2);
-	float det = e1.dot(p);
-	if (Math::abs(det) < eps) {
-		return false;
-	}
-	float inv_det = 1.0f / det;
-	Vector3 tvec = orig - tri.a;
-	float u = tvec.dot(p) * inv_det;
-	if (u < 0.0f || u > 1.0f) {
-		return false;
-	}
-	Vector3 q = tvec.cross(e1);
-	float v = dir.dot(q) * inv_det;
-	if (v < 0.0f || u + v > 1.0f) {
-		return false;
-	}
-	float t = e2.dot(q) * inv_det;
-	if (t > eps && t < tmax) {
-		r_t = t;
-		return true;
+// Upper bound on cells along one axis of the grid that finds a surface's occluders.
+static constexpr int LM_OCCLUDER_GRID_MAX_RESOLUTION = 256;
+// Upper bound on the boxes one shadow volume is split into.
+static constexpr int LM_OCCLUDER_MAX_SEGMENTS = 256;
+
+void LightmapBaker::_compute_surface_bake_hashes(const std::vector<std::vector<uint32_t>> &p_mesh_lights, const std::vector<LightmapBuffer> &p_lightmaps, std::vector<uint64_t> &r_hashes) const {
+	const size_t surface_count = gathered_meshes.size();
+	r_hashes.assign(surface_count, 0);
+	const int worker_count = _get_worker_thread_count();
+
+	// Settings that change every texel of the direct pass.
+	uint64_t settings_hash = _lm_hash_combine(0, (uint64_t)light_falloff_mode);
+	settings_hash = _lm_hash_combine(settings_hash, (uint64_t)use_lambert_normalization | ((uint64_t)use_shadowing << 1) | ((uint64_t)use_material_albedo << 2));
+	settings_hash = _lm_hash_float(settings_hash, ambient_energy);
+	settings_hash = _lm_hash_float(settings_hash, lightmap_energy_scale);
+	settings_hash = _lm_hash_float(settings_hash, bias);
+	settings_hash = _lm_hash_combine(settings_hash, (uint64_t)supersample_count);
+	settings_hash = _lm_hash_combine(settings_hash, (uint64_t)shadow_map_size);
+	settings_hash = _lm_hash_combine(settings_hash, (uint64_t)light_sample_count);
+	settings_hash = _lm_hash_combine(settings_hash, (uint64_t)soft_shadow_samples);
+	for (int axis = 0; axis < 3; axis++) {
+		settings_hash = _lm_hash_float(settings_hash, (float)baked_environment_ambient[axis]);
 	}
-	return false;
-}
 
-bool LightmapBaker::_is_shadowed(const Vector3 &p_world_pos, const Vector3 &p_world_normal, const LightData &p_light) const {
-	Vector3 origin = p_world_pos + p_world_normal * bias;
-	Vector3 dir;
-	float max_dist = 1e20f;
+	// Geometry and placement of every surface; reused as its occluder signature.
+	std::vector<uint64_t> geometry_hashes(surface_count);
+	_lm_parallel_for((int)surface_count, worker_count, [&](int p_index) {
+		const MeshData &md = gathered_meshes[(size_t)p_index];
+		uint64_t h = _lm_hash_bytes(0, md.vertices.ptr(), (size_t)md.vertices.size() * sizeof(Vector3));
+		h = _lm_hash_bytes(h, md.normals.ptr(), (size_t)md.normals.size() * sizeof(Vector3));
+		h = _lm_hash_bytes(h, md.uv2s.ptr(), (size_t)md.uv2s.size() * sizeof(Vector2));
+		h = _lm_hash_bytes(h, md.indices.ptr(), (size_t)md.indices.size() * sizeof(int32_t));
+		for (int row = 0; row < 3; row++) {
+			for (int axis = 0; axis < 3; axis++) {
+				h = _lm_hash_float(h, (float)md.transform.basis[row][axis]);
+			}
+			h = _lm_hash_float(h, (float)md.transform.origin[row]);
+		}
+		geometry_hashes[(size_t)p_index] = h;
+	});
 
-	if (p_light.type == 0) {
-		dir = (-p_light.direction).normalized();
-	} else {
-		Vector3 to_light = p_light.position - origin;
-		float dist = to_light.length();
-		if (dist <= 1e-4f) {
-			return false;
+	Vector3 scene_min = gathered_meshes[0].world_aabb_min;
+	Vector3 scene_max = gathered_meshes[0].world_aabb_max;
+	for (const MeshData &md : gathered_meshes) {
+		scene_min = Vector3(Math::min(scene_min.x, md.world_aabb_min.x), Math::min(scene_min.y, md.world_aabb_min.y), Math::min(scene_min.z, md.world_aabb_min.z));
+		scene_max = Vector3(Math::max(scene_max.x, md.world_aabb_max.x), Math::max(scene_max.y, md.world_aabb_max.y), Math::max(scene_max.z, md.world_aabb_max.z));
+	}
+	const float scene_diagonal = (scene_max - scene_min).length();
+
+	std::vector<uint64_t> light_hashes(gathered_lights.size());
+	for (size_t i = 0; i < gathered_lights.size(); i++) {
+		const LightData &l = gathered_lights[i];
+		uint64_t h = _lm_hash_combine(0, (uint64_t)l.type | ((uint64_t)l.cast_shadow << 8) | ((uint64_t)l.use_shadow_map << 9));
+		for (int axis = 0; axis < 3; axis++) {
+			h = _lm_hash_float(h, (float)l.position[axis]);
+			h = _lm_hash_float(h, (float)l.direction[axis]);
 		}
-		dir = to_light / dist;
-		max_dist = Math::max(0.0f, dist - bias);
-		if (max_dist <= 1e-4f) {
-			return false;
+		h = _lm_hash_float(h, l.color.r);
+		h = _lm_hash_float(h, l.color.g);
+		h = _lm_hash_float(h, l.color.b);
+		h = _lm_hash_float(h, l.energy);
+		h = _lm_hash_float(h, l.range);
+		h = _lm_hash_float(h, l.attenuation);
+		h = _lm_hash_float(h, l.size);
+		h = _lm_hash_float(h, l.cos_spot_angle);
+		h = _lm_hash_float(h, l.inv_spot_attenuation);
+		// A directional shadow map is fitted to the scene bounds, so its texels move whenever the
+		// bounds do, even for surfaces whose own inputs didn't change.
+		if (l.type == 0 && l.cast_shadow && l.use_shadow_map) {
+			for (int axis = 0; axis < 3; axis++) {
+				h = _lm_hash_float(h, (float)scene_min[axis]);
+				h = _lm_hash_float(h, (float)scene_max[axis]);
+			}
 		}
+		light_hashes[i] = h;
 	}
 
-	for (const RayMesh &rm : ray_meshes) {
-		if (!_ray_intersects_aabb(origin, dir, rm.aabb, max_dist)) {
-			continue;
+	// Grid of surface bounds, so shadow volumes only test the surfaces near them instead of every
+	// surface in the scene. Cells are grown until there are about as many as surfaces, which keeps a
+	// handful of surfaces per cell whatever the scene's size or shape.
+	const Vector3 scene_extent = scene_max - scene_min;
+	float cell_size = std::max(1e-3f, (float)std::max({ scene_extent.x, scene_extent.y, scene_extent.z }) / (float)LM_OCCLUDER_GRID_MAX_RESOLUTION);
+	int grid_dims[3];
+	while (true) {
+		size_t cell_count = 1;
+		for (int axis = 0; axis < 3; axis++) {
+			grid_dims[axis] = CLAMP((int)Math::ceil((float)scene_extent[axis] / cell_size), 1, LM_OCCLUDER_GRID_MAX_RESOLUTION);
+			cell_count *= (size_t)grid_dims[axis];
+		}
+		if (cell_count <= surface_count * 2 || cell_count == 1) {
+			break;
 		}
-		for (const _LM_RayTri &tri : rm.tris) {
-			float t = 0.0f;
-			if (_ray_intersects_tri(origin, dir, tri, max_dist, t)) {
-				return true;
+		cell_size *= 2.0f;
+	}
+	// Boxes reaching past the scene bounds are clamped to the border cells; no surface lies beyond.
+	auto cell_range = [&](const Vector3 &p_min, const Vector3 &p_max, int *r_from, int *r_to) {
+		for (int axis = 0; axis < 3; axis++) {
+			r_from[axis] = CLAMP((int)Math::floor((float)(p_min[axis] - scene_min[axis]) / cell_size), 0, grid_dims[axis] - 1);
+			r_to[axis] = CLAMP((int)Math::floor((float)(p_max[axis] - scene_min[axis]) / cell_size), 0, grid_dims[axis] - 1);
+		}
+	};
+	std::vector<std::vector<uint32_t>> grid_cells((size_t)grid_dims[0] * (size_t)grid_dims[1] * (size_t)grid_dims[2]);
+	for (size_t j = 0; j < surface_count; j++) {
+		int from[3];
+		int to[3];
+		cell_range(gathered_meshes[j].world_aabb_min, gathered_meshes[j].world_aabb_max, from, to);
+		for (int z = from[2]; z <= to[2]; z++) {
+			for (int y = from[1]; y <= to[1]; y++) {
+				for (int x = from[0]; x <= to[0]; x++) {
+					grid_cells[((size_t)z * (size_t)grid_dims[1] + (size_t)y) * (size_t)grid_dims[0] + (size_t)x].push_back((uint32_t)j);
+				}
 			}
 		}
 	}
 
-	return false;
+	_lm_parallel_for((int)surface_count, worker_count, [&](int p_index) {
+		const MeshData &md = gathered_meshes[(size_t)p_index];
+		const Color albedo = _get_surface_albedo(md);
+		uint64_t h = _lm_hash_combine(settings_hash, geometry_hashes[(size_t)p_index]);
+		h = _lm_hash_float(h, albedo.r);
+		h = _lm_hash_float(h, albedo.g);
+		h = _lm_hash_float(h, albedo.b);
+		h = _lm_hash_combine(h, ((uint64_t)p_lightmaps[(size_t)p_index].width << 32) | (uint64_t)p_lightmaps[(size_t)p_index].height);
+
+		// Lights and occluders are combined order-independently, so unrelated nodes moving
+		// around in the scene tree don't invalidate the surface.
+		uint64_t light_sum = 0;
+		std::vector<uint32_t> occluders;
+		for (uint32_t light_index : p_mesh_lights[(size_t)p_index]) {
+			light_sum += light_hashes[light_index];
+			const LightData &l = gathered_lights[light_index];
+			if (!use_shadowing || !l.cast_shadow) {
+				continue;
+			}
+			// Every shadow ray of the surface towards this light stays inside the volume swept from
+			// the surface's bounds to the far box. The volume is split into boxes about a cell long so
+			// a long ray only visits the cells along its path.
+			Vector3 far_min = l.position;
+			Vector3 far_max = l.position;
+			if (l.type == 0) {
+				const Vector3 offset = (-l.direction).normalized() * scene_diagonal;
+				far_min = md.world_aabb_min + offset;
+				far_max = md.world_aabb_max + offset;
+			}
+			// Soft shadow rays aim anywhere on the light's disk. For directional lights the size is
+			// the tangent of the disk's half angle, so rays spread by at most that per unit travelled.
+			if (soft_shadow_samples > 1 && l.size > 0.0f) {
+				const float spread = l.type == 0 ? scene_diagonal * l.size : l.size;
+				far_min -= Vector3(spread, spread, spread);
+				far_max += Vector3(spread, spread, spread);
+			}
+			const Vector3 sweep = (far_min + far_max - md.world_aabb_min - md.world_aabb_max) * 0.5f;
+			const float sweep_length = std::max({ Math::abs((float)sweep.x), Math::abs((float)sweep.y), Math::abs((float)sweep.z) });
+			const int segments = CLAMP((int)Math::ceil(sweep_length / cell_size), 1, LM_OCCLUDER_MAX_SEGMENTS);
+			for (int segment = 0; segment < segments; segment++) {
+				const float t0 = (float)segment / (float)segments;
+				const float t1 = (float)(segment + 1) / (float)segments;
+				const Vector3 from_min = md.world_aabb_min.lerp(far_min, t0);
+				const Vector3 from_max = md.world_aabb_max.lerp(far_max, t0);
+				const Vector3 to_min = md.world_aabb_min.lerp(far_min, t1);
+				const Vector3 to_max = md.world_aabb_max.lerp(far_max, t1);
+				const Vector3 box_min(Math::min(from_min.x, to_min.x), Math::min(from_min.y, to_min.y), Math::min(from_min.z, to_min.z));
+				const Vector3 box_max(Math::max(from_max.x, to_max.x), Math::max(from_max.y, to_max.y), Math::max(from_max.z, to_max.z));
+				int from[3];
+				int to[3];
+				cell_range(box_min, box_max, from, to);
+				for (int z = from[2]; z <= to[2]; z++) {
+					for (int y = from[1]; y <= to[1]; y++) {
+						for (int x = from[0]; x <= to[0]; x++) {
+							for (uint32_t other_index : grid_cells[((size_t)z * (size_t)grid_dims[1] + (size_t)y) * (size_t)grid_dims[0] + (size_t)x]) {
+								const MeshData &other = gathered_meshes[other_index];
+								if (other.world_aabb_min.x <= box_max.x && other.world_aabb_max.x >= box_min.x &&
+										other.world_aabb_min.y <= box_max.y && other.world_aabb_max.y >= box_min.y &&
+										other.world_aabb_min.z <= box_max.z && other.world_aabb_max.z >= box_min.z) {
+									occluders.push_back(other_index);
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+		h = _lm_hash_combine(h, light_sum);
+
+		std::sort(occluders.begin(), occluders.end());
+		occluders.erase(std::unique(occluders.begin(), occluders.end()), occluders.end());
+		uint64_t occluder_sum = 0;
+		for (uint32_t other_index : occluders) {
+			occluder_sum += geometry_hashes[other_index];
+		}
+		r_hashes[(size_t)p_index] = _lm_hash_combine(h, occluder_sum);
+	});
 }
 
-void LightmapBaker::_build_ray_meshes() {
-	ray_meshes.clear();
-	ray_meshes.reserve(gathered_meshes.size());
+void LightmapBaker::_build_bake_geometry() {
+	_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_RAY_BUILD]);
+	_clear_bake_geometry();
+	BakeGeometry &geometry = bake_geometry;
+	const size_t surface_count = gathered_meshes.size();
 
+	// Triangles first (serially, dropping out-of-range indices), so every surface knows its ranges.
+	size_t vertex_total = 0;
+	size_t triangle_total = 0;
 	for (const MeshData &md : gathered_meshes) {
-		RayMesh rm;
-		rm.aabb = AABB();
-		bool aabb_inited = false;
-
+		vertex_total += (size_t)md.vertices.size();
+		triangle_total += (size_t)(md.indices.is_empty() ? md.vertices.size() : md.indices.size()) / 3;
+	}
+	geometry.indices.reserve(triangle_total * 3);
+	geometry.triangle_surface.reserve(triangle_total);
+	geometry.surface_first_vertex.resize(surface_count + 1);
+	geometry.surface_first_triangle.resize(surface_count + 1);
+	uint32_t first_vertex = 0;
+	for (size_t surface = 0; surface < surface_count; surface++) {
+		const MeshData &md = gathered_meshes[surface];
 		const int vcount = md.vertices.size();
-		if (vcount < 3) {
-			continue;
-		}
-
+		geometry.surface_first_vertex[surface] = first_vertex;
+		geometry.surface_first_triangle[surface] = (uint32_t)geometry.triangle_surface.size();
 		auto push_tri = [&](int i0, int i1, int i2) {
-			Vector3 a = md.transform.xform(md.vertices[i0]);
-			Vector3 b = md.transform.xform(md.vertices[i1]);
-			Vector3 c = md.transform.xform(md.vertices[i2]);
-			_LM_RayTri t{ a, b, c };
-			rm.tris.push_back(t);
-
-			if (!aabb_inited) {
-				rm.aabb.position = a;
-				rm.aabb.size = Vector3(0, 0, 0);
-				aabb_inited = true;
-			}
-			rm.aabb.expand_to(a);
-			rm.aabb.expand_to(b);
-			rm.aabb.expand_to(c);
+			geometry.indices.push_back(first_vertex + (uint32_t)i0);
+			geometry.indices.push_back(first_vertex + (uint32_t)i1);
+			geometry.indices.push_back(first_vertex + (uint32_t)i2);
+			geometry.triangle_surface.push_back((uint32_t)surface);
 		};
-
 		if (!md.indices.is_empty()) {
 			const int icount = md.indices.size();
-			rm.tris.reserve((size_t)(icount / 3));
+			const int32_t *indices = md.indices.ptr();
 			for (int i = 0; i + 2 < icount; i += 3) {
-				int i0 = md.indices[i + 0];
-				int i1 = md.indices[i + 1];
-				int i2 = md.indices[i + 2];
+				const int i0 = indices[i + 0];
+				const int i1 = indices[i + 1];
+				const int i2 = indices[i + 2];
 				if (i0 < 0 || i1 < 0 || i2 < 0 || i0 >= vcount || i1 >= vcount || i2 >= vcount) {
 					continue;
 				}
 				push_tri(i0, i1, i2);
 			}
 		} else {
-			rm.tris.reserve((size_t)(vcount / 3));
 			for (int i = 0; i + 2 < vcount; i += 3) {
 				push_tri(i, i + 1, i + 2);
 			}
 		}
+		first_vertex += (uint32_t)vcount;
+	}
+	geometry.surface_first_vertex[surface_count] = first_vertex;
+	geometry.surface_first_triangle[surface_count] = (uint32_t)geometry.triangle_surface.size();
+
+	// Vertices per surface; the ranges are disjoint, so surfaces transform in parallel.
+	geometry.positions.resize(vertex_total);
+	geometry.normals.resize(vertex_total);
+	geometry.uv2s.resize(vertex_total);
+	_lm_parallel_for((int)surface_count, _get_worker_thread_count(), [&](int p_index) {
+		const MeshData &md = gathered_meshes[(size_t)p_index];
+		const int vcount = md.vertices.size();
+		const uint32_t first = geometry.surface_first_vertex[(size_t)p_index];
+		const bool has_normals = md.normals.size() == vcount;
+		const bool has_uv2 = md.uv2s.size() == vcount;
+		Vector3 *positions = &geometry.positions[first];
+		Vector3 *normals = &geometry.normals[first];
+		for (int v = 0; v < vcount; v++) {
+			positions[v] = md.transform.xform(md.vertices[v]);
+			normals[v] = has_normals ? md.transform.basis.xform(md.normals[v]) : Vector3();
+			geometry.uv2s[first + (uint32_t)v] = has_uv2 ? md.uv2s[v] : Vector2();
+		}
+		if (!has_normals) {
+			// Area-weighted face normals, summed at shared vertices.
+			for (uint32_t t = geometry.surface_first_triangle[(size_t)p_index]; t < geometry.surface_first_triangle[(size_t)p_index + 1]; t++) {
+				const uint32_t *corners = &geometry.indices[(size_t)t * 3];
+				const Vector3 face = (geometry.positions[corners[1]] - geometry.positions[corners[0]]).cross(geometry.positions[corners[2]] - geometry.positions[corners[0]]);
+				geometry.normals[corners[0]] += face;
+				geometry.normals[corners[1]] += face;
+				geometry.normals[corners[2]] += face;
+			}
+		}
+		for (int v = 0; v < vcount; v++) {
+			normals[v] = normals[v].length_squared() > 1e-20f ? normals[v].normalized() : Vector3(0, 1, 0);
+		}
+	});
+	_track_bake_memory((int64_t)geometry.get_memory_usage());
+}
+
+void LightmapBaker::_clear_bake_geometry() {
+	_track_bake_memory(-(int64_t)bake_geometry.get_memory_usage());
+	bake_geometry = BakeGeometry();
+}
+
+void LightmapBaker::_build_ray_meshes() {
+	_LM_StageTimer timer(bake_stats.stage_usec[BAKE_STAGE_RAY_BUILD]);
+	if (!ray_bvh) {
+		ray_bvh = std::make_unique<RayBVH>();
+	}
+
+	// Every triangle of the shared world-space geometry; the BVH is built over all of them.
+	const BakeGeometry &geometry = bake_geometry;
+	const size_t triangle_count = geometry.triangle_surface.size();
+	std::vector<_LM_RayTri> tris;
+	std::vector<_LM_RayTriInfo> infos;
+	tris.resize(triangle_count);
+	infos.resize(triangle_count);
+	for (size_t t = 0; t < triangle_count; t++) {
+		const uint32_t *corners = &geometry.indices[t * 3];
+		const Vector3 &a = geometry.positions[corners[0]];
+		const Vector3 &b = geometry.positions[corners[1]];
+		const Vector3 &c = geometry.positions[corners[2]];
+		tris[t] = _LM_RayTri{ a, b, c };
+
+		_LM_RayTriInfo &info = infos[t];
+		info.surface = geometry.triangle_surface[t];
+		info.triangle = (uint32_t)t;
+		info.normal = geometry.normals[corners[0]] + geometry.normals[corners[1]] + geometry.normals[corners[2]];
+		if (info.normal.length_squared() < 1e-12f) {
+			info.normal = (b - a).cross(c - a);
+		}
+	}
+
+	ray_bvh->build(std::move(tris), std::move(infos));
+	_track_bake_memory((int64_t)ray_bvh->get_memory_usage());
+}
+
+Dictionary LightmapBaker::get_ray_stats() const {
+	Dictionary stats;
+	const uint64_t rays = ray_bvh ? ray_bvh->rays_cast.load() : 0;
+	const uint64_t visited = ray_bvh ? ray_bvh->nodes_visited.load() : 0;
+	stats["bvh_node_count"] = ray_bvh ? (int64_t)ray_bvh->nodes.size() : (int64_t)0;
+	stats["bvh_triangle_count"] = ray_bvh ? (int64_t)ray_bvh->triangle_count : (int64_t)0;
+	stats["rays_cast"] = (int64_t)rays;
+	stats["nodes_visited"] = (int64_t)visited;
+	stats["average_nodes_visited_per_ray"] = rays > 0 ? (double)visited / (double)rays : 0.0;
+	stats["triangles_tested"] = ray_bvh ? (int64_t)ray_bvh->triangles_tested.load() : (int64_t)0;
+	return stats;
+}
+
+Dictionary LightmapBaker::get_last_bake_stats() const {
+	static const char *stage_names[BAKE_STAGE_MAX] = { "gather", "unwrap", "ray_build", "direct", "indirect", "denoise", "dilation", "packing", "atlas_layers", "texture_creation" };
+
+	Dictionary stage_sec;
+	uint64_t total_usec = 0;
+	for (int i = 0; i < BAKE_STAGE_MAX; i++) {
+		stage_sec[stage_names[i]] = (double)last_bake_stats.stage_usec[i] / 1000000.0;
+		total_usec += last_bake_stats.stage_usec[i];
+	}
+
+	Dictionary stats;
+	stats["stage_sec"] = stage_sec;
+	stats["total_sec"] = (double)total_usec / 1000000.0;
+	stats["rays_cast"] = (int64_t)last_bake_stats.rays_cast;
+	stats["triangles_tested"] = (int64_t)last_bake_stats.triangles_tested;
+	stats["atlas_occupancy"] = last_bake_stats.atlas_occupancy;
+	stats["slice_count"] = last_bake_stats.slice_count;
+	stats["peak_memory_bytes"] = last_bake_stats.peak_memory;
+	stats["bake_cache_bytes"] = last_bake_stats.bake_cache_memory;
+	return stats;
+}
+
+// LightmapBakeJob
+
+void LightmapBakeJob::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("cancel"), &LightmapBakeJob::cancel);
+	ClassDB::bind_method(D_METHOD("wait"), &LightmapBakeJob::wait);
+	ClassDB::bind_method(D_METHOD("is_done"), &LightmapBakeJob::is_done);
+	ClassDB::bind_method(D_METHOD("get_progress"), &LightmapBakeJob::get_progress);
+	ClassDB::bind_method(D_METHOD("get_status"), &LightmapBakeJob::get_status);
+	ClassDB::bind_method(D_METHOD("get_result"), &LightmapBakeJob::get_result);
+
+	// Deferred targets for the worker thread.
+	ClassDB::bind_method(D_METHOD("_emit_progress"), &LightmapBakeJob::_emit_progress);
+	ClassDB::bind_method(D_METHOD("_finish"), &LightmapBakeJob::_finish);
+
+	ADD_SIGNAL(MethodInfo("progress_changed", PropertyInfo(Variant::FLOAT, "progress"), PropertyInfo(Variant::STRING, "status")));
+	ADD_SIGNAL(MethodInfo("completed", PropertyInfo(Variant::INT, "error")));
+}
+
+LightmapBakeJob::~LightmapBakeJob() {
+	// The baker holds the job while its thread runs and joins it before letting go, so this is
+	// only a safety net.
+	if (thread.joinable()) {
+		if (baker != nullptr) {
+			baker->bake_abort.store(true);
+		}
+		thread.join();
+	}
+}
+
+void LightmapBakeJob::_progress_callback(float p_progress, const String &p_status, void *p_userdata) {
+	static_cast<LightmapBakeJob *>(p_userdata)->_set_progress(p_progress, p_status);
+}
+
+void LightmapBakeJob::_set_progress(float p_progress, const String &p_status) {
+	std::lock_guard<std::mutex> lock(state_mutex);
+	progress = p_progress;
+	status = p_status;
+	// Coalesce: at most one pending deferred emit, which picks up the latest values.
+	if (!progress_pending) {
+		progress_pending = true;
+		call_deferred("_emit_progress");
+	}
+}
+
+void LightmapBakeJob::_thread_main() {
+	result = baker->_run_bake(&LightmapBakeJob::_progress_callback, this);
+	work_done.store(true);
+	call_deferred("_finish");
+}
+
+void LightmapBakeJob::_emit_progress() {
+	float current_progress;
+	String current_status;
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		progress_pending = false;
+		current_progress = progress;
+		current_status = status;
+	}
+	if (!finished) {
+		emit_signal("progress_changed", current_progress, current_status);
+	}
+}
+
+void LightmapBakeJob::_finish() {
+	if (finished || !work_done.load()) {
+		return;
+	}
+	if (thread.joinable()) {
+		thread.join();
+	}
+
+	// Without a baker the bake was aborted by its destructor; only completion is left to report.
+	if (result == LightmapBaker::BAKE_ERROR_OK && baker != nullptr) {
+		_set_progress(0.9f, "Finalizing lightmaps...");
+		result = baker->_finish_bake(output_data);
+	}
+	if (baker != nullptr) {
+		baker->bake_running.store(false);
+	}
+	finished = true;
+	if (result == LightmapBaker::BAKE_ERROR_OK) {
+		std::lock_guard<std::mutex> lock(state_mutex);
+		progress = 1.0f;
+		status = "Bake complete!";
+	}
+
+	// Release the baker's reference last; the local keeps this object alive through the signal.
+	Ref<LightmapBakeJob> keep_alive(this);
+	if (baker != nullptr) {
+		baker->active_job.unref();
+	}
+	emit_signal("completed", (int)result);
+}
+
+void LightmapBakeJob::cancel() {
+	if (!finished && baker != nullptr) {
+		baker->bake_abort.store(true);
+	}
+}
 
-		if (!rm.tris.empty()) {
-			ray_meshes.push_back(std::move(rm));
+LightmapBaker::BakeError LightmapBakeJob::wait() {
+	if (!finished) {
+		if (thread.joinable()) {
+			thread.join();
 		}
+		_finish();
 	}
+	return result;
+}
+
+float LightmapBakeJob::get_progress() const {
+	std::lock_guard<std::mutex> lock(state_mutex);
+	return progress;
+}
+
+String LightmapBakeJob::get_status() const {
+	std::lock_guard<std::mutex> lock(state_mutex);
+	return status;
 }
 
 } // namespace godot
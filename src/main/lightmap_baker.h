@@ -21,13 +21,20 @@
 #include <godot_cpp/variant/rect2.hpp>
 #include <godot_cpp/variant/color.hpp>
 #include <godot_cpp/variant/transform3d.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <atomic>
 #include <vector>
+#include <memory>
 #include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace godot {
 
 // Forward declarations
 class LightmapBaker;
+class LightmapBakeJob;
 using BakeProgressFunc = void (*)(float p_progress, const String &p_status, void *p_userdata);
 
 struct MeshData {
@@ -37,13 +44,69 @@ struct MeshData {
 	PackedInt32Array indices;
 	Transform3D transform;
 	Ref<Material> material;
+	Color albedo = Color(1, 1, 1, 1); // Material albedo, read during the gather.
 	Node *owner_node = nullptr;
 	int sub_instance = -1;
 	Vector2i lightmap_size_hint;
+	float lightmap_importance = 1.0f; // "lightmap_importance" metadata of the owner node.
 	int lightmap_slice = 0;
+	Vector2i lightmap_atlas_offset; // Texel position inside the atlas slice.
+	// World-space bounds, filled in at the start of the bake.
+	Vector3 world_aabb_min;
+	Vector3 world_aabb_max;
 	Rect2 lightmap_uv_scale;
 };
 
+// Intermediate per-surface lightmap shared by every bake stage: linear RGB floats plus a 1-bit
+// coverage plane (set for texels inside UV2 islands). Rows of the coverage plane are padded to
+// 64-bit words so jobs writing disjoint rows never touch the same word.
+struct LightmapBuffer {
+	int width = 0;
+	int height = 0;
+	int coverage_stride = 0; // 64-bit words per row
+	std::vector<float> color;
+	std::vector<uint64_t> coverage;
+
+	bool create(int p_width, int p_height);
+	bool is_empty() const { return width <= 0 || height <= 0; }
+
+	float *texel(int p_x, int p_y) { return &color[((size_t)p_y * (size_t)width + (size_t)p_x) * 3]; }
+	const float *texel(int p_x, int p_y) const { return &color[((size_t)p_y * (size_t)width + (size_t)p_x) * 3]; }
+	void set_texel(int p_x, int p_y, float p_r, float p_g, float p_b) {
+		float *c = texel(p_x, p_y);
+		c[0] = p_r;
+		c[1] = p_g;
+		c[2] = p_b;
+	}
+
+	bool is_covered(int p_x, int p_y) const { return (coverage[(size_t)p_y * (size_t)coverage_stride + (size_t)(p_x >> 6)] >> (p_x & 63)) & 1u; }
+	void set_covered(int p_x, int p_y) { coverage[(size_t)p_y * (size_t)coverage_stride + (size_t)(p_x >> 6)] |= (uint64_t)1 << (p_x & 63); }
+};
+
+// World-space position and normal of every covered texel of a LightmapBuffer, recorded by the
+// direct rasterizer so later stages can shoot rays from texels without re-rasterizing UV2.
+struct LightmapGuide {
+	std::vector<Vector3> position;
+	std::vector<Vector3> normal;
+
+	void create(int p_width, int p_height) {
+		position.assign((size_t)p_width * (size_t)p_height, Vector3());
+		normal.assign((size_t)p_width * (size_t)p_height, Vector3());
+	}
+};
+
+// Triangle and light visibility of every covered texel, recorded by the direct rasterizer for
+// adaptive supersampling: texels whose neighbors differ in either sit on a geometry or shadow edge.
+struct LightmapEdgeInfo {
+	std::vector<int32_t> triangle; // -1 for uncovered texels.
+	std::vector<uint32_t> visibility; // Bit (light index & 31) set for every light reaching the texel.
+
+	void create(int p_width, int p_height) {
+		triangle.assign((size_t)p_width * (size_t)p_height, -1);
+		visibility.assign((size_t)p_width * (size_t)p_height, 0);
+	}
+};
+
 struct LightData {
 	Vector3 position;
 	Vector3 direction;
@@ -51,11 +114,12 @@ struct LightData {
 	float energy = 1.0f;
 	float range = 10.0f;
 	float attenuation = 1.0f;
-	float size = 0.0f;
+	float size = 0.0f; // Radius of omni/spot lights; tangent of the half angle of directional lights.
 	float cos_spot_angle = -1.0f;
 	float inv_spot_attenuation = 1.0f;
 	int type = 0; // 0=directional, 1=omni, 2=spot
 	bool cast_shadow = true;
+	bool use_shadow_map = false; // Shadows from a CPU depth map instead of rays (directional/spot only).
 	String name;
 };
 
@@ -68,6 +132,22 @@ public:
 		LIGHT_FALLOFF_INVERSE_SQUARE = 1,
 	};
 
+	enum AtlasPacker {
+		ATLAS_PACKER_SHELF = 0,
+		ATLAS_PACKER_MAX_RECTS = 1,
+	};
+
+	enum ShadowMode {
+		SHADOW_MODE_RAY_TRACED = 0,
+		SHADOW_MODE_SHADOW_MAP = 1,
+	};
+
+	enum OutputFormat {
+		OUTPUT_FORMAT_RGBH = 0,
+		OUTPUT_FORMAT_RGBE9995 = 1,
+		OUTPUT_FORMAT_BC6H = 2,
+	};
+
 	enum BakeQuality {
 		BAKE_QUALITY_LOW = 0,
 		BAKE_QUALITY_MEDIUM = 1,
@@ -86,6 +166,7 @@ public:
 		BAKE_ERROR_TEXTURE_SIZE_TOO_SMALL = 7,
 		BAKE_ERROR_LIGHTMAP_TOO_SMALL = 8,
 		BAKE_ERROR_ATLAS_TOO_SMALL = 9,
+		BAKE_ERROR_IN_PROGRESS = 10,
 	};
 
 	LightmapBaker();
@@ -115,9 +196,23 @@ public:
 	void set_atlas_padding(int p_padding);
 	int get_atlas_padding() const;
 
+	// Packing strategy for surface lightmaps inside the atlas slices.
+	void set_atlas_packer(AtlasPacker p_packer);
+	AtlasPacker get_atlas_packer() const;
+	// Surface texels / total atlas texels of the most recent bake (0 before the first bake).
+	float get_atlas_occupancy() const;
+
+	// Texel format of the baked Texture2DArray layers. BC6H falls back to RGBH when the rendering
+	// device can't sample it.
+	void set_output_format(OutputFormat p_format);
+	OutputFormat get_output_format() const;
+
 	// Post-process: dilate lightmap UV island borders (0 disables)
 	void set_seam_dilation_radius(int p_radius);
 	int get_seam_dilation_radius() const;
+	// Dilate into every empty texel (ignores the radius), so mipmaps never sample unlit padding
+	void set_seam_dilation_fill(bool p_enabled);
+	bool get_seam_dilation_fill() const;
 
 	void set_texel_scale(float p_scale);
 	float get_texel_scale() const;
@@ -138,6 +233,40 @@ public:
 
 	void set_use_shadowing(bool p_enabled);
 	bool get_use_shadowing() const;
+	// How directional and spot lights test visibility. A light's "lightmap_shadow_mode" metadata
+	// (a ShadowMode value) overrides this per light; omni lights always use rays.
+	void set_shadow_mode(ShadowMode p_mode);
+	ShadowMode get_shadow_mode() const;
+	void set_shadow_map_size(int p_size);
+	int get_shadow_map_size() const;
+	// Most shadow rays per texel toward a light with a size, for soft shadows. Texels whose first
+	// few rays all agree are fully lit or fully shadowed and take no more.
+	void set_soft_shadow_samples(int p_samples);
+	int get_soft_shadow_samples() const;
+
+	// Indirect pass: gather full hemispheres only at sparse irradiance cache records, placed where
+	// the lighting is expected to vary, and interpolate between them. Lower error places more records.
+	void set_use_irradiance_cache(bool p_enabled);
+	bool get_use_irradiance_cache() const;
+	void set_irradiance_cache_error(float p_error);
+	float get_irradiance_cache_error() const;
+
+	// Post-process: edge-aware filtering of the baked lighting, guided by texel position/normal.
+	// The number of filter passes follows bake_quality; strength scales how much is smoothed.
+	void set_use_denoiser(bool p_enabled);
+	bool get_use_denoiser() const;
+	void set_denoiser_strength(float p_strength);
+	float get_denoiser_strength() const;
+
+	// Adaptive supersampling (0 = off): after shading texel centers, texels on shadow or geometry
+	// edges are shaded again with this many stratified sub-samples (4, 9 or 16).
+	void set_supersample_count(int p_count);
+	int get_supersample_count() const;
+
+	// Many-light sampling (0 = off): texels reached by more omni/spot lights than this pick that
+	// many of them per sample from a per-cell importance distribution instead of shading them all.
+	void set_light_sample_count(int p_count);
+	int get_light_sample_count() const;
 
 	// Light shading controls
 	void set_light_falloff_mode(LightFalloffMode p_mode);
@@ -157,14 +286,53 @@ public:
 	void set_mesh_layer_mask(uint32_t p_mask);
 	uint32_t get_mesh_layer_mask() const;
 
+	// Worker threads used by the bake stages (0 = one per logical CPU core).
+	void set_thread_count(int p_count);
+	int get_thread_count() const;
+
+	// Texel budget (0 = off): instead of lightmap_size_hint, surface lightmap sizes are solved so
+	// the baked lightmaps fit this many megabytes at a uniform texel density over world-space area,
+	// weighted by each MeshInstance3D's "lightmap_importance" metadata.
+	void set_texel_budget_mb(int p_megabytes);
+	int get_texel_budget_mb() const;
+
+	// Incremental rebakes: keep each surface's direct lighting between bakes and reuse it while
+	// its geometry, transform, albedo, affecting lights, occluders and bake settings are unchanged.
+	void set_use_bake_cache(bool p_enabled);
+	bool get_use_bake_cache() const;
+	void clear_bake_cache();
+
+	// Out-of-core baking (0 = off): bakes the atlas in tiles sized to stay within this working-set
+	// budget and keeps finished layers on disk until the bake completes.
+	void set_max_memory_mb(int p_megabytes);
+	int get_max_memory_mb() const;
+
 	// Main bake function
 	BakeError bake(Node *p_from_node, Ref<LightmapGIData> p_output_data);
 
+	// Gathers the scene on the calling thread, then bakes on a background thread.
+	// Returns a null job if the arguments are invalid or a bake is already running. Freeing the
+	// baker before the job completes aborts the bake.
+	Ref<LightmapBakeJob> bake_async(Node *p_from_node, Ref<LightmapGIData> p_output_data);
+	bool is_baking() const { return bake_running.load(); }
+
 	// UV2 generation only (does not bake).
 	// Static so you can call: LightmapBaker.lightmap_unwrap(mesh, xform, texel_size)
 	// Returns an Error code (OK on success).
 	// If p_texel_size <= 0, uses the project setting rendering/lightmapping/primitive_meshes/texel_size (fallback 0.1).
 	static int lightmap_unwrap(const Ref<ArrayMesh> &p_mesh, const Transform3D &p_transform, float p_texel_size = 0.0f);
+	// Unwraps several meshes at once, running the surfaces on all cores. Returns one Error code per
+	// entry of p_meshes (ERR_INVALID_PARAMETER for entries that aren't ArrayMeshes).
+	static PackedInt32Array lightmap_unwrap_many(const Array &p_meshes, float p_texel_size = 0.0f);
+
+	// Process-wide xatlas result cache, keyed by the unwrap inputs' content and bounded by an LRU
+	// memory budget. save/load persist it (e.g. under user://) so later sessions skip xatlas.
+	static void set_unwrap_cache_max_memory_mb(int p_megabytes);
+	static int get_unwrap_cache_max_memory_mb();
+	static int64_t get_unwrap_cache_memory_usage();
+	static void clear_unwrap_cache();
+	static int save_unwrap_cache(const String &p_path);
+	static int load_unwrap_cache(const String &p_path);
 
 	// Advanced: Step-by-step baking with progress callback
 	BakeError bake_with_progress(Node *p_from_node, Ref<LightmapGIData> p_output_data,
@@ -173,11 +341,18 @@ public:
 	// Debug/inspection
 	int get_gathered_mesh_count() const { return gathered_meshes.size(); }
 	int get_gathered_light_count() const { return gathered_lights.size(); }
+	// Shadow-ray BVH readout from the most recent bake (node/triangle counts, rays cast, nodes visited).
+	Dictionary get_ray_stats() const;
+	// Stage timings, ray/triangle counts, atlas usage and peak intermediate memory of the most
+	// recent successful bake.
+	Dictionary get_last_bake_stats() const;
 
 protected:
 	static void _bind_methods();
 
 private:
+	friend class LightmapBakeJob;
+
 	// Configuration
 	BakeQuality bake_quality = BAKE_QUALITY_MEDIUM;
 	int bounces = 3;
@@ -187,54 +362,249 @@ private:
 	int atlas_size_override = 0;
 	int atlas_padding = 2;
 	int seam_dilation_radius = 2;
+	bool seam_dilation_fill = false;
 	float texel_scale = 1.0f;
+	int texel_budget_mb = 0;
 	float lightmap_energy_scale = 1.0f;
 	float ambient_energy = 0.0f;
 	bool use_material_albedo = true;
 	bool use_lambert_normalization = true;
 	bool use_shadowing = true;
+	ShadowMode shadow_mode = SHADOW_MODE_RAY_TRACED;
+	int shadow_map_size = 2048;
+	int soft_shadow_samples = 16;
+	bool use_irradiance_cache = false;
+	float irradiance_cache_error = 0.3f;
+	bool use_denoiser = false;
+	float denoiser_strength = 0.5f;
+	int supersample_count = 0;
+	int light_sample_count = 0;
 	LightFalloffMode light_falloff_mode = LIGHT_FALLOFF_LEGACY;
+	AtlasPacker atlas_packer = ATLAS_PACKER_MAX_RECTS;
+	float atlas_occupancy = 0.0f;
+	OutputFormat output_format = OUTPUT_FORMAT_RGBH;
+	bool output_bc6h_supported = false; // Resolved by _prepare_bake() on the main thread.
 	bool use_environment_ambient = false;
 	float environment_ambient_scale = 1.0f;
 	Vector3 baked_environment_ambient;
 	bool auto_unwrap_uv2 = false;
 	uint32_t mesh_layer_mask = 0xFFFFFFFFu;
+	int thread_count = 0;
+	bool use_bake_cache = false;
+	int max_memory_mb = 0;
+
+	// Direct lighting of the surfaces of the previous bake, keyed by _compute_surface_bake_hashes().
+	struct BakeCacheEntry {
+		LightmapBuffer lightmap;
+		LightmapGuide guide; // Empty when the surface was baked without bounces.
+	};
+	std::unordered_map<uint64_t, BakeCacheEntry> bake_cache;
+
+	// Set while bake()/bake_async() is running; settings must not be changed meanwhile.
+	std::atomic<bool> bake_running{ false };
+	// Set by LightmapBakeJob::cancel(); bake stages poll it between jobs.
+	std::atomic<bool> bake_abort{ false };
+	// Job started by bake_async(), held until its completion has run on the main thread. The
+	// destructor aborts and joins it, so the worker never outlives the baker.
+	Ref<LightmapBakeJob> active_job;
 
 	// State during bake
 	std::vector<MeshData> gathered_meshes;
 	std::vector<LightData> gathered_lights;
-	struct RayMesh;
-	std::vector<RayMesh> ray_meshes;
+	// Surface arrays of every Mesh resource seen during the gather, keyed by RID, so instances of
+	// a shared mesh copy its arrays across the GDExtension boundary only once. Cleared after the
+	// gather; the Packed arrays in gathered_meshes keep sharing the same buffers.
+	struct GatheredSurface {
+		int surface_idx = 0;
+		PackedVector3Array vertices;
+		PackedVector3Array normals;
+		PackedVector2Array uv2s;
+		PackedInt32Array indices;
+		Ref<Material> material;
+	};
+	struct GatheredMesh {
+		std::vector<GatheredSurface> surfaces; // Only surfaces with UV2; empty if the mesh can't be baked.
+		Vector2i lightmap_size_hint;
+	};
+	std::unordered_map<uint64_t, GatheredMesh> gathered_mesh_cache;
+	// World-space copy of every gathered surface, built once per bake and read by the rasterizer,
+	// the ray BVH, light culling and the texel budget solver. Vertices of surface s are
+	// [surface_first_vertex[s], surface_first_vertex[s + 1]), its triangles likewise.
+	struct BakeGeometry {
+		std::vector<Vector3> positions;
+		std::vector<Vector3> normals; // Normalized. Surfaces without normals get smoothed face normals.
+		std::vector<Vector2> uv2s;
+		std::vector<uint32_t> indices; // Three per triangle, into the vertex arrays; invalid triangles are dropped.
+		std::vector<uint32_t> triangle_surface; // Index into gathered_meshes.
+		std::vector<uint32_t> surface_first_vertex;
+		std::vector<uint32_t> surface_first_triangle;
+
+		size_t get_memory_usage() const {
+			return (positions.capacity() + normals.capacity()) * sizeof(Vector3) + uv2s.capacity() * sizeof(Vector2) +
+					(indices.capacity() + triangle_surface.capacity() + surface_first_vertex.capacity() + surface_first_triangle.capacity()) * sizeof(uint32_t);
+		}
+	};
+	BakeGeometry bake_geometry;
+	struct RayBVH;
+	std::unique_ptr<RayBVH> ray_bvh;
+	// Indexed like gathered_lights; null for lights that cast shadows with rays.
+	struct LightShadowMap;
+	std::vector<std::unique_ptr<LightShadowMap>> light_shadow_maps;
+	// Null unless many-light sampling is enabled and the scene has enough omni/spot lights.
+	struct LightSampleGrid;
+	std::unique_ptr<LightSampleGrid> light_sample_grid;
+	// Instrumentation: bake_stats is filled while a bake runs and copied to last_bake_stats once
+	// it succeeds, so get_last_bake_stats() never sees a bake in progress.
+	enum BakeStage {
+		BAKE_STAGE_GATHER,
+		BAKE_STAGE_UNWRAP,
+		BAKE_STAGE_RAY_BUILD,
+		BAKE_STAGE_DIRECT,
+		BAKE_STAGE_INDIRECT,
+		BAKE_STAGE_DENOISE,
+		BAKE_STAGE_DILATION,
+		BAKE_STAGE_PACKING,
+		BAKE_STAGE_ATLAS_LAYERS,
+		BAKE_STAGE_TEXTURE_CREATION,
+		BAKE_STAGE_MAX,
+	};
+	struct BakeStats {
+		uint64_t stage_usec[BAKE_STAGE_MAX] = {};
+		uint64_t rays_cast = 0;
+		uint64_t triangles_tested = 0;
+		float atlas_occupancy = 0.0f;
+		int slice_count = 0;
+		int64_t memory = 0; // Intermediate bytes currently held by the bake.
+		int64_t peak_memory = 0;
+		int64_t bake_cache_memory = 0; // Held by bake_cache once the bake is done.
+	};
+	BakeStats bake_stats;
+	BakeStats last_bake_stats;
+
+	// Atlas layers produced by _run_bake(), consumed by _finish_bake(). Out-of-core bakes leave a
+	// null layer here and its file path in spilled_layers.
+	Vector<Ref<Image>> baked_layers;
+	std::vector<String> spilled_layers;
 
 	// Helper functions
 	void _find_meshes_and_lights(Node *p_at_node, std::vector<MeshData> &r_meshes, std::vector<LightData> &r_lights);
+	void _collect_meshes_to_unwrap(Node *p_at_node, std::vector<MeshInstance3D *> &r_instances, std::unordered_map<uint64_t, bool> &r_has_uv2);
+	void _auto_unwrap_meshes(Node *p_from_node);
+	// lightmap_unwrap_many() on p_thread_count threads.
+	static PackedInt32Array _unwrap_many(const Array &p_meshes, float p_texel_size, int p_thread_count);
+	const GatheredMesh &_gather_mesh(const Ref<Mesh> &p_mesh);
 	void _process_mesh_instance(MeshInstance3D *p_mesh, std::vector<MeshData> &r_meshes);
 	void _process_light(Light3D *p_light, std::vector<LightData> &r_lights);
 
 	// Validation
 	bool _validate_meshes(const std::vector<MeshData> &p_meshes);
 
+	// Bake phases: _prepare_bake() and _finish_bake() touch the scene tree and resources and run on
+	// the main thread; _run_bake() only works on the gathered copies and may run on any thread.
+	BakeError _prepare_bake(Node *p_from_node);
+	BakeError _run_bake(BakeProgressFunc p_progress_func, void *p_userdata);
+	BakeError _finish_bake(Ref<LightmapGIData> p_output_data);
+	bool _is_bake_aborted() const { return bake_abort.load(std::memory_order_relaxed); }
+
 	// Baking stages
-	BakeError _bake_direct_light(Ref<LightmapGIData> p_output_data, BakeProgressFunc p_progress = nullptr, void *p_userdata = nullptr);
-	BakeError _bake_indirect_light(Vector<Ref<Image>> &p_lightmaps, BakeProgressFunc p_progress = nullptr, void *p_userdata = nullptr);
+	void _compute_lightmap_sizes(int p_atlas_size, int p_padding, std::vector<Vector2i> &r_sizes);
+	BakeError _bake_direct_light(BakeProgressFunc p_progress = nullptr, void *p_userdata = nullptr);
+	BakeError _bake_indirect_light(std::vector<LightmapBuffer> &p_lightmaps, const std::vector<LightmapGuide> &p_guides, BakeProgressFunc p_progress = nullptr, void *p_userdata = nullptr);
+	// Out-of-core variant of everything after light culling in _bake_direct_light().
+	BakeError _bake_streaming(const std::vector<Vector2i> &p_sizes, const std::vector<std::vector<uint32_t>> &p_mesh_lights, int p_atlas_size, int p_padding, BakeProgressFunc p_progress, void *p_userdata);
+	// Rasterizes the listed surfaces (indices into gathered_meshes) in parallel row bands.
+	void _rasterize_surfaces(const std::vector<int> &p_surfaces, const std::vector<std::vector<uint32_t>> &p_mesh_lights, std::vector<LightmapBuffer> &p_lightmaps, std::vector<LightmapGuide> *p_guides, float p_progress_from, float p_progress_to, BakeProgressFunc p_progress, void *p_userdata);
+	int _get_indirect_ray_count() const;
 
 	// Post-processing
-	void _dilate_lightmaps(Vector<Ref<Image>> &p_lightmaps, int p_dilation_radius = 1);
+	void _denoise_lightmaps(std::vector<LightmapBuffer> &p_lightmaps, const std::vector<LightmapGuide> &p_guides, BakeProgressFunc p_progress = nullptr, void *p_userdata = nullptr);
+	// A negative radius fills every uncovered texel.
+	void _dilate_lightmaps(std::vector<LightmapBuffer> &p_lightmaps, int p_dilation_radius = 1);
 
 	// Texture management
-	Ref<Image> _create_lightmap_image(int p_width, int p_height);
-	Vector<Ref<Image>> _pack_lightmaps_to_atlas(std::vector<MeshData> &p_meshes, const Vector<Ref<Image>> &p_lightmaps, int p_atlas_size, int p_padding);
+	// Assigns atlas slices/offsets to every surface; returns the slice count (0 on failure).
+	int _pack_lightmaps_to_atlas(std::vector<MeshData> &p_meshes, const std::vector<LightmapBuffer> &p_lightmaps, int p_atlas_size, int p_padding);
+	Vector<Ref<Image>> _create_atlas_layers(const std::vector<MeshData> &p_meshes, const std::vector<LightmapBuffer> &p_lightmaps, int p_atlas_size, int p_slice_count);
+	OutputFormat _resolve_output_format(int p_atlas_size) const;
+	// Turns half-float (or RGBE9995) layer data into an Image, encoding BC6H if requested.
+	Ref<Image> _finish_atlas_layer(PackedByteArray &p_data, int p_atlas_size, OutputFormat p_format, int p_slice);
+	bool _spill_atlas_layer(const Ref<Image> &p_layer, int p_slice, String &r_path) const;
+	Ref<Image> _load_spilled_layer(const String &p_path) const;
+	void _clear_spilled_layers();
 	Ref<Texture2DArray> _create_texture_array_from_images(const Vector<Ref<Image>> &p_layers);
 	void _write_output_data(Ref<LightmapGIData> p_output_data, const Ref<Texture2DArray> &p_tex_array);
 
 	// CPU rasterization in UV2 space
-	void _rasterize_mesh_direct_lighting(const MeshData &p_mesh, Ref<Image> p_target);
-	Color _evaluate_direct_lighting(const Vector3 &p_world_pos, const Vector3 &p_world_normal) const;
-	bool _is_shadowed(const Vector3 &p_world_pos, const Vector3 &p_world_normal, const LightData &p_light) const;
+	// Shades texel centers; with r_edges, also records each texel's triangle and light visibility.
+	// With p_supersample, instead re-shades the texels r_edges marks as edges with sub-samples.
+	void _rasterize_mesh_direct_lighting(int p_surface, const std::vector<uint32_t> &p_lights, LightmapBuffer &r_target, LightmapGuide *r_guide, LightmapEdgeInfo *r_edges, int p_row_begin, int p_row_end, bool p_supersample = false);
+	Color _get_surface_albedo(const MeshData &p_mesh) const;
+	Color _evaluate_direct_lighting(const Vector3 &p_world_pos, const Vector3 &p_world_normal, const uint32_t *p_lights, int p_light_count, uint32_t *r_visibility = nullptr) const;
+	// Appends the lights of p_candidates (indices into gathered_lights) that can reach the box.
+	void _cull_lights(const Vector3 &p_aabb_min, const Vector3 &p_aabb_max, const std::vector<uint32_t> &p_candidates, std::vector<uint32_t> &r_lights) const;
+	// Radiance one light adds at a point (before the energy scale); false if it doesn't reach it.
+	bool _evaluate_light(uint32_t p_light, const Vector3 &p_world_pos, const Vector3 &p_world_normal, Vector3 &r_radiance) const;
+	// Fraction of the light visible from the point, traced with rays (1.0 = fully lit).
+	float _shadow_visibility(const Vector3 &p_world_pos, const Vector3 &p_world_normal, uint32_t p_light) const;
+	void _build_shadow_maps();
+	void _clear_shadow_maps();
+	void _build_light_sample_grid();
+	void _clear_light_sample_grid();
+	void _build_bake_geometry();
+	void _clear_bake_geometry();
 	void _build_ray_meshes();
+	void _compute_surface_bake_hashes(const std::vector<std::vector<uint32_t>> &p_mesh_lights, const std::vector<LightmapBuffer> &p_lightmaps, std::vector<uint64_t> &r_hashes) const;
 
 	// Utility
+	int _get_worker_thread_count() const;
 	void _report_progress(float p_progress, const String &p_status, BakeProgressFunc p_callback, void *p_userdata);
+	// Settings are read by the bake thread, so setters refuse to change them mid-bake.
+	bool _reject_while_baking(const char *p_method) const;
+	// Adds (or, with a negative delta, releases) intermediate memory and updates the bake's peak.
+	void _track_bake_memory(int64_t p_delta);
+	int64_t _get_bake_cache_memory() const;
+};
+
+// Handle for a bake started with LightmapBaker::bake_async(). Signals are always emitted on the
+// main thread (deferred), and the output LightmapGIData is only written there.
+class LightmapBakeJob : public RefCounted {
+	GDCLASS(LightmapBakeJob, RefCounted)
+	friend class LightmapBaker;
+
+	LightmapBaker *baker = nullptr; // Cleared if the baker is freed before the job completes.
+	Ref<LightmapGIData> output_data;
+	std::thread thread;
+
+	mutable std::mutex state_mutex;
+	float progress = 0.0f;
+	String status;
+	bool progress_pending = false;
+
+	std::atomic<bool> work_done{ false };
+	bool finished = false;
+	LightmapBaker::BakeError result = LightmapBaker::BAKE_ERROR_OK;
+
+	static void _progress_callback(float p_progress, const String &p_status, void *p_userdata);
+	void _set_progress(float p_progress, const String &p_status);
+	void _thread_main();
+	void _emit_progress();
+	void _finish();
+
+protected:
+	static void _bind_methods();
+
+public:
+	void cancel();
+	// Blocks until the bake is done, writes the output and returns the result.
+	LightmapBaker::BakeError wait();
+
+	bool is_done() const { return finished; }
+	float get_progress() const;
+	String get_status() const;
+	// The worker thread writes result until _finish() joins it, so it is only read once finished.
+	LightmapBaker::BakeError get_result() const { return finished ? result : LightmapBaker::BAKE_ERROR_IN_PROGRESS; }
+
+	~LightmapBakeJob();
 };
 
 } // namespace godot
@@ -242,5 +612,8 @@ private:
 VARIANT_ENUM_CAST(godot::LightmapBaker::BakeQuality);
 VARIANT_ENUM_CAST(godot::LightmapBaker::BakeError);
 VARIANT_ENUM_CAST(godot::LightmapBaker::LightFalloffMode);
+VARIANT_ENUM_CAST(godot::LightmapBaker::AtlasPacker);
+VARIANT_ENUM_CAST(godot::LightmapBaker::OutputFormat);
+VARIANT_ENUM_CAST(godot::LightmapBaker::ShadowMode);
 
 #endif // LIGHTMAP_BAKER_H
@@ -29,6 +29,7 @@ void initialize_extensions_module(ModuleInitializationLevel p_level) {
 		ClassDB::register_class<MidiStream>();
 		ClassDB::register_class<MidiStreamPlayback>();
 		ClassDB::register_class<LightmapBaker>();
+		ClassDB::register_class<LightmapBakeJob>();
 		ClassDB::register_class<CompoundMeshInstance3D>();
 		ClassDB::register_class<CompoundPartProxy>();
 		ClassDB::register_class<CompoundPartNode3D>();